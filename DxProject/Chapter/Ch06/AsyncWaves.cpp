@@ -0,0 +1,265 @@
+#include "AsyncWaves.h"
+#include "WavesKernels.h"
+
+#include <cassert>
+#include <chrono>
+
+AsyncWaves::AsyncWaves()
+	: mbQuit(false)
+	, mWriteIndex(0)
+	, mReadIndex(2)
+	, mShared(1)
+	, mStepCount(0)
+	, mHeightExport(NULL)
+{
+}
+
+AsyncWaves::~AsyncWaves()
+{
+	Stop();
+}
+
+Waves& AsyncWaves::Simulation()
+{
+	assert(!IsRunning());
+	return mWaves;
+}
+
+void AsyncWaves::Start()
+{
+	if (IsRunning())
+	{
+		return;
+	}
+
+	const UINT m = mWaves.RowCount();
+	const UINT n = mWaves.ColumnCount();
+
+	// x and z never change, so only heights (and normals) are published.
+	mColumnX.resize(n);
+	mRowZ.resize(m);
+	for (UINT j = 0; j < n; ++j)
+	{
+		mColumnX[j] = mWaves[j].x;
+	}
+	for (UINT i = 0; i < m; ++i)
+	{
+		mRowZ[i] = mWaves[i * n].z;
+	}
+
+	// Every frame starts as the current solution, so the reader has something
+	// valid before the first step is published.
+	for (UINT f = 0; f < 3; ++f)
+	{
+		mFrames[f].Heights.resize(m * n);
+		for (UINT a = 0; a < 3; ++a)
+		{
+			mFrames[f].Normals[a].resize(mWaves.NormalsEnabled() ? m * n : 0);
+		}
+		FillFrame(mFrames[f]);
+	}
+
+	if (mHeightExport != NULL)
+	{
+		mHeightExport->Publish(mWaves, mStepCount);
+	}
+
+	// The shared frame counts as fresh so the first AcquireLatest() succeeds.
+	mWriteIndex = 0;
+	mShared.store(1 | FreshBit);
+	mReadIndex = 2;
+
+	mbQuit.store(false);
+	mThread = std::thread(&AsyncWaves::SimulationLoop, this);
+}
+
+void AsyncWaves::Stop()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+
+	mbQuit.store(true);
+	mThread.join();
+}
+
+bool AsyncWaves::IsRunning() const
+{
+	return mThread.joinable();
+}
+
+void AsyncWaves::SetHeightExport(SharedHeightsPublisher* publisher)
+{
+	assert(!IsRunning());
+	mHeightExport = publisher;
+}
+
+bool AsyncWaves::Disturb(UINT i, UINT j, float magnitude)
+{
+	Waves::Impulse impulse;
+	impulse.Row = i;
+	impulse.Col = j;
+	impulse.Magnitude = magnitude;
+	impulse.Radius = 0.f;
+	return Disturb(impulse);
+}
+
+bool AsyncWaves::Disturb(const Waves::Impulse& impulse)
+{
+	return mImpulses.Push(impulse);
+}
+
+bool AsyncWaves::AcquireLatest()
+{
+	if ((mShared.load(std::memory_order_relaxed) & FreshBit) == 0)
+	{
+		return false;
+	}
+
+	// Hand back the frame we were reading and take the published one; the
+	// acquire makes the writer's stores to that frame visible.
+	mReadIndex = mShared.exchange(mReadIndex, std::memory_order_acq_rel) & ~FreshBit;
+	return true;
+}
+
+UINT64 AsyncWaves::FrameStep() const
+{
+	return mFrames[mReadIndex].Step;
+}
+
+UINT AsyncWaves::RowCount() const
+{
+	return mWaves.RowCount();
+}
+
+UINT AsyncWaves::ColumnCount() const
+{
+	return mWaves.ColumnCount();
+}
+
+UINT AsyncWaves::VertexCount() const
+{
+	return mWaves.VertexCount();
+}
+
+UINT AsyncWaves::TriangleCount() const
+{
+	return mWaves.TriangleCount();
+}
+
+XMFLOAT3 AsyncWaves::operator[](int i) const
+{
+	const UINT n = (UINT)mColumnX.size();
+	const UINT row = i / n;
+	const UINT col = i - row * n;
+	return XMFLOAT3(mColumnX[col], mFrames[mReadIndex].Heights[i], mRowZ[row]);
+}
+
+void AsyncWaves::WriteVertices(void* dest, UINT stride, UINT positionOffset, UINT normalOffset, UINT attributes) const
+{
+	const Frame& frame = mFrames[mReadIndex];
+	assert((attributes & Waves::VERTEX_NORMAL) == 0 || !frame.Normals[0].empty());
+
+	const UINT m = (UINT)mRowZ.size();
+	const UINT n = (UINT)mColumnX.size();
+	BYTE* base = static_cast<BYTE*>(dest);
+
+	for (UINT i = 0; i < m; ++i)
+	{
+		BYTE* v = base + i * n * stride;
+		const float* h = &frame.Heights[i * n];
+
+		if (attributes & Waves::VERTEX_POSITION)
+		{
+			WavesKernels::StreamFloat3Row(v + positionOffset, stride, n,
+				&mColumnX[0], 1, h, 1, &mRowZ[i], 0);
+		}
+		else if (attributes & Waves::VERTEX_HEIGHT)
+		{
+			WavesKernels::StreamFloatRow(v + positionOffset + sizeof(float), stride, n, h, 1);
+		}
+
+		if (attributes & Waves::VERTEX_NORMAL)
+		{
+			WavesKernels::StreamFloat3Row(v + normalOffset, stride, n,
+				&frame.Normals[0][i * n], 1, &frame.Normals[1][i * n], 1, &frame.Normals[2][i * n], 1);
+		}
+	}
+
+	WavesKernels::EndStreaming();
+}
+
+void AsyncWaves::SimulationLoop()
+{
+	typedef std::chrono::steady_clock Clock;
+
+	const std::chrono::duration<float> nap(0.5f * mWaves.TimeStep());
+	Clock::time_point last = Clock::now();
+
+	while (!mbQuit.load())
+	{
+		// Everything queued so far goes in as one batch before the next step.
+		Waves::Impulse impulse;
+		while (mImpulses.Pop(impulse))
+		{
+			mPendingImpulses.push_back(impulse);
+		}
+		if (!mPendingImpulses.empty())
+		{
+			mWaves.DisturbBatch(&mPendingImpulses[0], (UINT)mPendingImpulses.size());
+			mPendingImpulses.clear();
+		}
+
+		// Update() keeps the fractional step and caps catch-up as usual.
+		const Clock::time_point now = Clock::now();
+		const UINT steps = mWaves.Update(std::chrono::duration<float>(now - last).count());
+		last = now;
+
+		if (steps > 0)
+		{
+			mStepCount += steps;
+			Publish();
+		}
+
+		// Waking twice per step keeps the published frame less than a step late.
+		std::this_thread::sleep_for(nap);
+	}
+}
+
+void AsyncWaves::Publish()
+{
+	FillFrame(mFrames[mWriteIndex]);
+
+	// Swap the filled frame with the shared one; the release makes its
+	// stores visible to the reader that picks it up.
+	mWriteIndex = mShared.exchange(mWriteIndex | FreshBit, std::memory_order_acq_rel) & ~FreshBit;
+
+	if (mHeightExport != NULL)
+	{
+		mHeightExport->Publish(mWaves, mStepCount);
+	}
+}
+
+void AsyncWaves::FillFrame(Frame& frame)
+{
+	const UINT m = mWaves.RowCount();
+	const UINT n = mWaves.ColumnCount();
+
+	mWaves.ReadHeights(&frame.Heights[0], n);
+
+	if (!frame.Normals[0].empty())
+	{
+		const UINT pitch = mWaves.NormalPitch();
+		for (UINT a = 0; a < 3; ++a)
+		{
+			const float* field = mWaves.NormalField(a);
+			for (UINT i = 0; i < m; ++i)
+			{
+				CopyMemory(&frame.Normals[a][i * n], field + i * pitch, n * sizeof(float));
+			}
+		}
+	}
+
+	frame.Step = mStepCount;
+}
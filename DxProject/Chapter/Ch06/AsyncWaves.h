@@ -0,0 +1,107 @@
+#pragma once
+
+#include "Waves.h"
+#include "SharedHeights.h"
+#include "../../Common/SpscRing.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+///<summary>
+/// Runs a Waves simulation on its own thread at the simulation's fixed time
+/// step, so stepping overlaps with rendering instead of adding to the frame.
+///
+/// Finished solutions are published through a lock-free triple buffer: the
+/// simulation always has a free frame to fill and the render thread always
+/// reads the newest complete one, and neither ever waits for the other.
+/// Disturbances go the other way through a single-producer ring and are
+/// applied before the next step.
+///
+/// All calls except Simulation() come from one render thread.
+///</summary>
+class AsyncWaves
+{
+public:
+	AsyncWaves();
+	~AsyncWaves();
+
+	// The wrapped simulation.  Init and configure it only while stopped.
+	Waves& Simulation();
+
+	void Start();
+	void Stop();
+	bool IsRunning() const;
+
+	// Also publishes every new solution to another process through
+	// publisher, initialised for the same grid, from the simulation thread.
+	// NULL turns it off.  Set only while stopped.
+	void SetHeightExport(SharedHeightsPublisher* publisher);
+
+	// Queues an impulse for the simulation thread (a Radius of 0 is the
+	// Disturb() splat).  Returns false and drops it if the queue is full.
+	bool Disturb(UINT i, UINT j, float magnitude);
+	bool Disturb(const Waves::Impulse& impulse);
+
+	///<summary>
+	/// Switches the read frame to the newest published one, if there is a
+	/// newer one, and returns whether it changed.  The queries below all read
+	/// the frame picked by the last call.  Never blocks.
+	///</summary>
+	bool AcquireLatest();
+
+	// Simulation steps behind the current read frame.
+	UINT64 FrameStep() const;
+
+	UINT RowCount() const;
+	UINT ColumnCount() const;
+	UINT VertexCount() const;
+	UINT TriangleCount() const;
+
+	XMFLOAT3 operator[](int i) const;
+
+	// Same contract as Waves::WriteVertices, from the current read frame.
+	// VERTEX_NORMAL needs normals enabled on the simulation before Start().
+	void WriteVertices(void* dest, UINT stride, UINT positionOffset, UINT normalOffset, UINT attributes) const;
+
+private:
+	struct Frame
+	{
+		std::vector<float> Heights;
+		std::vector<float> Normals[3];
+		UINT64 Step;
+	};
+
+	void SimulationLoop();
+	void Publish();
+	void FillFrame(Frame& frame);
+
+	AsyncWaves(const AsyncWaves&);
+	AsyncWaves& operator=(const AsyncWaves&);
+
+private:
+	static const UINT FreshBit = 4;
+	static const UINT QueueCapacity = 1024;
+
+	Waves mWaves;
+
+	std::thread mThread;
+	std::atomic<bool> mbQuit;
+
+	// Frame index owned by each side; mShared holds the third plus FreshBit
+	// when it is newer than what the reader has.
+	Frame mFrames[3];
+	UINT mWriteIndex;
+	UINT mReadIndex;
+	std::atomic<UINT> mShared;
+	UINT64 mStepCount;
+
+	SharedHeightsPublisher* mHeightExport;
+
+	SpscRing<Waves::Impulse, QueueCapacity> mImpulses;
+	std::vector<Waves::Impulse> mPendingImpulses;
+
+	// Grid layout, read once the simulation is initialised.
+	std::vector<float> mColumnX;
+	std::vector<float> mRowZ;
+};
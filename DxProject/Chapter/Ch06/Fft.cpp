@@ -0,0 +1,230 @@
+#include "Fft.h"
+#include "WavesKernels.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	// The first two stages of a transform in place over blocks of four:
+	// twiddles 1 and +-i need no multiplies, and the SIMD butterflies would
+	// only see one or two lanes.  sign picks +i or -i.
+	void Radix4Pass(float* re, float* im, UINT length, float sign)
+	{
+		for (UINT s = 0; s < length; s += 4)
+		{
+			const float u0r = re[s] + re[s + 1];
+			const float u0i = im[s] + im[s + 1];
+			const float u1r = re[s] - re[s + 1];
+			const float u1i = im[s] - im[s + 1];
+			const float u2r = re[s + 2] + re[s + 3];
+			const float u2i = im[s + 2] + im[s + 3];
+			const float u3r = re[s + 2] - re[s + 3];
+			const float u3i = im[s + 2] - im[s + 3];
+
+			// u3 times sign * i.
+			const float tr = -sign * u3i;
+			const float ti = sign * u3r;
+
+			re[s] = u0r + u2r;
+			im[s] = u0i + u2i;
+			re[s + 2] = u0r - u2r;
+			im[s + 2] = u0i - u2i;
+			re[s + 1] = u1r + tr;
+			im[s + 1] = u1i + ti;
+			re[s + 3] = u1r - tr;
+			im[s + 3] = u1i - ti;
+		}
+	}
+}
+
+Fft::Fft()
+	: mSize(0)
+{
+}
+
+void Fft::Init(UINT n)
+{
+	assert(n >= 4 && (n & (n - 1)) == 0);
+
+	mSize = n;
+
+	UINT bits = 0;
+	while ((1u << bits) < n)
+	{
+		++bits;
+	}
+
+	mReverse.resize(n);
+	for (UINT k = 0; k < n; ++k)
+	{
+		UINT r = 0;
+		for (UINT b = 0; b < bits; ++b)
+		{
+			r |= ((k >> b) & 1u) << (bits - 1 - b);
+		}
+		mReverse[k] = r;
+	}
+
+	// Twiddles in double so every one is correctly rounded.
+	const double pi = 3.14159265358979323846;
+	mTwiddleRe.resize(n - 1);
+	mTwiddleIm.resize(n - 1);
+	mTwiddleImNeg.resize(n - 1);
+	for (UINT h = 1; h < n; h *= 2)
+	{
+		for (UINT j = 0; j < h; ++j)
+		{
+			// A quarter turn is exact, so the i of every stage matches the
+			// multiply-free first pass.
+			const double angle = pi * j / h;
+			const float c = 2 * j == h ? 0.f : (float)cos(angle);
+			const float s = 2 * j == h ? 1.f : (float)sin(angle);
+			mTwiddleRe[h - 1 + j] = c;
+			mTwiddleIm[h - 1 + j] = s;
+			mTwiddleImNeg[h - 1 + j] = -s;
+		}
+	}
+}
+
+UINT Fft::Size() const
+{
+	return mSize;
+}
+
+void Fft::TransformRow(float* re, float* im, UINT length, int sign) const
+{
+	const UINT shift = length == mSize ? 0 : 1;
+	for (UINT k = 0; k < length; ++k)
+	{
+		const UINT r = mReverse[k] >> shift;
+		if (r > k)
+		{
+			std::swap(re[k], re[r]);
+			std::swap(im[k], im[r]);
+		}
+	}
+
+	UINT h = 1;
+	if (length >= 4)
+	{
+		Radix4Pass(re, im, length, sign > 0 ? 1.f : -1.f);
+		h = 4;
+	}
+
+	const float* twiddleIm = sign > 0 ? &mTwiddleIm[0] : &mTwiddleImNeg[0];
+	for (; h < length; h *= 2)
+	{
+		const float* wr = &mTwiddleRe[h - 1];
+		const float* wi = twiddleIm + h - 1;
+		for (UINT s = 0; s < length; s += 2 * h)
+		{
+			WavesKernels::Butterfly(re + s, im + s, re + s + h, im + s + h, wr, wi, h);
+		}
+	}
+}
+
+void Fft::TransformColumns(float* re, float* im, UINT pitch, UINT count, int sign) const
+{
+	const UINT n = mSize;
+
+	for (UINT k = 0; k < n; ++k)
+	{
+		const UINT r = mReverse[k];
+		if (r > k)
+		{
+			std::swap_ranges(re + k * pitch, re + k * pitch + count, re + r * pitch);
+			std::swap_ranges(im + k * pitch, im + k * pitch + count, im + r * pitch);
+		}
+	}
+
+	const float* twiddleIm = sign > 0 ? &mTwiddleIm[0] : &mTwiddleImNeg[0];
+	for (UINT h = 1; h < n; h *= 2)
+	{
+		for (UINT s = 0; s < n; s += 2 * h)
+		{
+			for (UINT j = 0; j < h; ++j)
+			{
+				const UINT a = (s + j) * pitch;
+				const UINT b = (s + j + h) * pitch;
+				WavesKernels::ButterflyBroadcast(re + a, im + a, re + b, im + b,
+					mTwiddleRe[h - 1 + j], twiddleIm[h - 1 + j], count);
+			}
+		}
+	}
+}
+
+void Fft::ForwardReal(const float* x, float* re, float* im, float* scratch) const
+{
+	const UINT half = mSize / 2;
+	float* zr = scratch;
+	float* zi = scratch + half;
+
+	// Even samples in the real part, odd ones in the imaginary part.
+	for (UINT m = 0; m < half; ++m)
+	{
+		zr[m] = x[2 * m];
+		zi[m] = x[2 * m + 1];
+	}
+
+	TransformRow(zr, zi, half, -1);
+
+	// Untangle: E = (Z[k] + conj Z[h - k]) / 2 and O = (Z[k] - conj Z[h - k]) / 2i
+	// are the transforms of the even and odd samples; X[k] = E + e^(-2 pi i k / n) O.
+	const float* wr = &mTwiddleRe[half - 1];
+	const float* wi = &mTwiddleImNeg[half - 1];
+	for (UINT k = 0; k <= half; ++k)
+	{
+		const UINT a = k < half ? k : 0;
+		const UINT b = k > 0 ? half - k : 0;
+		const float er = 0.5f * (zr[a] + zr[b]);
+		const float ei = 0.5f * (zi[a] - zi[b]);
+		const float orr = 0.5f * (zi[a] + zi[b]);
+		const float oi = -0.5f * (zr[a] - zr[b]);
+
+		if (k < half)
+		{
+			re[k] = er + (wr[k] * orr - wi[k] * oi);
+			im[k] = ei + (wr[k] * oi + wi[k] * orr);
+		}
+		else
+		{
+			re[k] = er - orr;
+			im[k] = ei - oi;
+		}
+	}
+}
+
+void Fft::InverseReal(const float* re, const float* im, float* x, float* scratch) const
+{
+	const UINT half = mSize / 2;
+	float* zr = scratch;
+	float* zi = scratch + half;
+
+	// With B = conj X[h - k], Z[k] = (X[k] + B) + i e^(2 pi i k / n) (X[k] - B)
+	// transforms to even samples in the real part and odd ones in the
+	// imaginary part.
+	const float* wr = &mTwiddleRe[half - 1];
+	const float* wi = &mTwiddleIm[half - 1];
+	for (UINT k = 0; k < half; ++k)
+	{
+		const float sr = re[k] + re[half - k];
+		const float si = im[k] - im[half - k];
+		const float dr = re[k] - re[half - k];
+		const float di = im[k] + im[half - k];
+
+		const float tr = wr[k] * dr - wi[k] * di;
+		const float ti = wr[k] * di + wi[k] * dr;
+		zr[k] = sr - ti;
+		zi[k] = si + tr;
+	}
+
+	TransformRow(zr, zi, half, 1);
+
+	for (UINT m = 0; m < half; ++m)
+	{
+		x[2 * m] = zr[m];
+		x[2 * m + 1] = zi[m];
+	}
+}
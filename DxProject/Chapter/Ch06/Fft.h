@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Windows.h>
+#include <vector>
+
+///<summary>
+/// Unnormalised radix-2 FFTs of one power-of-two size n on split-complex
+/// data (separate re and im arrays), so every butterfly stage is a run of
+/// SIMD adds and multiplies through WavesKernels.  sign -1 is the forward
+/// transform X[k] = sum x[j] e^(-2 pi i jk / n) and +1 the inverse, without
+/// the 1 / n.
+///</summary>
+class Fft
+{
+public:
+	Fft();
+
+	// n is a power of two, at least 4.
+	void Init(UINT n);
+	UINT Size() const;
+
+	// Length-n complex transforms of count adjacent columns in place:
+	// element k of column c is re[k * pitch + c].  The columns sit side by
+	// side in the SIMD lanes of every butterfly.
+	void TransformColumns(float* re, float* im, UINT pitch, UINT count, int sign) const;
+
+	///<summary>
+	/// Real transforms of length n through one complex transform of length
+	/// n / 2.  The spectrum is bins 0 to n / 2 (n / 2 + 1 of them); the
+	/// inverse takes the other half to be their conjugate mirror, as it is
+	/// for any real signal.  scratch holds n floats.
+	///</summary>
+	void ForwardReal(const float* x, float* re, float* im, float* scratch) const;
+	void InverseReal(const float* re, const float* im, float* x, float* scratch) const;
+
+private:
+	// Length-length complex transform of one row in place; length is n or n / 2.
+	void TransformRow(float* re, float* im, UINT length, int sign) const;
+
+private:
+	UINT mSize;
+
+	// Bit reversal of log2(n) bits; shifted right once it serves n / 2.
+	std::vector<UINT> mReverse;
+
+	// Stage twiddles e^(+-pi i j / h) for j < h, stored from index h - 1 for
+	// each stage h = 1, 2, 4, ..., n / 2.  The last stage doubles as the
+	// e^(+-2 pi i k / n) factors of the real transforms.
+	std::vector<float> mTwiddleRe;
+	std::vector<float> mTwiddleIm;
+	std::vector<float> mTwiddleImNeg;
+};
@@ -0,0 +1,90 @@
+#include "FixedStepClock.h"
+#include "../../Common/MathHelper.h"
+
+#include <cmath>
+
+FixedStepClock::FixedStepClock()
+	: mTimeStep(0.f)
+	, mBankedTime(0.f)
+	, mDroppedTime(0.f)
+	, mMaxStepsPerUpdate(4)
+{
+}
+
+void FixedStepClock::Reset(float timeStep)
+{
+	mTimeStep = timeStep;
+	mBankedTime = 0.f;
+	mDroppedTime = 0.f;
+}
+
+UINT FixedStepClock::Advance(float dt)
+{
+	if (mTimeStep <= 0.f)
+	{
+		return 0;
+	}
+
+	// Accumulate time.  A clock that went backwards adds nothing rather
+	// than eating into time already banked.
+	mBankedTime += dt > 0.f ? dt : 0.f;
+
+	// Only update the simulation at the specified time step, as many
+	// whole steps as have built up.  The quotient stays a float until it is
+	// known to be in range; casting one a UINT cannot hold, e.g. after a
+	// long stall, is undefined.
+	const float dueSteps = floorf(mBankedTime / mTimeStep);
+	UINT numSteps = mMaxStepsPerUpdate;
+	if (dueSteps <= (float)mMaxStepsPerUpdate)
+	{
+		// Rounding can leave the bank a hair below zero.
+		numSteps = dueSteps > 0.f ? static_cast<UINT>(dueSteps) : 0;
+	}
+	else
+	{
+		const float dropped = (dueSteps - mMaxStepsPerUpdate) * mTimeStep;
+		mDroppedTime += dropped;
+		mBankedTime -= dropped;
+
+		// A bank too large to subtract from exactly, or infinite, keeps
+		// just what the capped steps need.
+		if (!(mBankedTime >= mMaxStepsPerUpdate * mTimeStep && mBankedTime < (mMaxStepsPerUpdate + 1) * mTimeStep))
+		{
+			mBankedTime = mMaxStepsPerUpdate * mTimeStep;
+		}
+	}
+
+	mBankedTime -= numSteps * mTimeStep;
+	return numSteps;
+}
+
+float FixedStepClock::TimeStep() const
+{
+	return mTimeStep;
+}
+
+void FixedStepClock::SetMaxStepsPerUpdate(UINT maxSteps)
+{
+	mMaxStepsPerUpdate = MathHelper::Max(maxSteps, 1u);
+}
+
+UINT FixedStepClock::MaxStepsPerUpdate() const
+{
+	return mMaxStepsPerUpdate;
+}
+
+float FixedStepClock::BankedTime() const
+{
+	return mBankedTime;
+}
+
+float FixedStepClock::DroppedTime() const
+{
+	return mDroppedTime;
+}
+
+void FixedStepClock::Restore(float bankedTime, float droppedTime)
+{
+	mBankedTime = bankedTime;
+	mDroppedTime = droppedTime;
+}
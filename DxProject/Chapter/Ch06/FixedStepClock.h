@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Windows.h>
+
+///<summary>
+/// Turns variable frame times into a whole number of fixed simulation steps.
+/// Advance() banks dt and hands out every step that is due, up to a
+/// catch-up cap; time beyond the cap is dropped, and counted, so a long
+/// frame cannot snowball into ever longer ones.  Every simulation with an
+/// Update(dt) runs on one, so they all agree on how many steps a given
+/// sequence of frame times produces.
+///</summary>
+class FixedStepClock
+{
+public:
+	FixedStepClock();
+
+	// Starts over at timeStep seconds per step with nothing banked or
+	// dropped.  The cap is kept.
+	void Reset(float timeStep);
+
+	// Adds dt and returns the number of steps to run now, removing their
+	// time from the bank.  Always 0 if the time step is not positive; a
+	// negative dt counts as 0.
+	UINT Advance(float dt);
+
+	float TimeStep() const;
+
+	// Upper bound on steps returned by one Advance() call.
+	void SetMaxStepsPerUpdate(UINT maxSteps);
+	UINT MaxStepsPerUpdate() const;
+
+	// Time not yet consumed by a whole step.
+	float BankedTime() const;
+
+	// Time discarded by the cap since Reset().
+	float DroppedTime() const;
+
+	// Puts back a bank and drop count saved from BankedTime() and
+	// DroppedTime(), e.g. from a checkpoint.
+	void Restore(float bankedTime, float droppedTime);
+
+private:
+	float mTimeStep;
+	float mBankedTime;
+	float mDroppedTime;
+	UINT mMaxStepsPerUpdate;
+};
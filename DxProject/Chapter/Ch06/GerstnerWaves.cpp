@@ -0,0 +1,164 @@
+#include "GerstnerWaves.h"
+#include "../../Common/MathHelper.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	const double Gravity = 9.81;
+	const double TwoPi = 2.0 * 3.14159265358979323846;
+
+	// Points per kernel call; the outputs stay on the stack.
+	const UINT ChunkPoints = 256;
+}
+
+GerstnerWaves::GerstnerWaves()
+	: mNumRows(0)
+	, mNumCols(0)
+{
+}
+
+void GerstnerWaves::Init(UINT m, UINT n, float dx, const Wave* waves, UINT waveCount)
+{
+	assert(waveCount <= MaxWaves);
+
+	mNumRows = m;
+	mNumCols = n;
+
+	// Same grid as Waves.
+	const float halfWidth = (n - 1) * dx * 0.5f;
+	const float halfDepth = (m - 1) * dx * 0.5f;
+
+	mColumnX.resize(n);
+	mRowZ.resize(m);
+	for (UINT j = 0; j < n; ++j)
+	{
+		mColumnX[j] = -halfWidth + j * dx;
+	}
+	for (UINT i = 0; i < m; ++i)
+	{
+		mRowZ[i] = halfDepth - i * dx;
+	}
+
+	mKx.resize(waveCount);
+	mKz.resize(waveCount);
+	mOmega.resize(waveCount);
+	mPhase.resize(waveCount);
+	mAmplitude.resize(waveCount);
+	mDisplaceX.resize(waveCount);
+	mDisplaceZ.resize(waveCount);
+
+	for (UINT w = 0; w < waveCount; ++w)
+	{
+		const Wave& wave = waves[w];
+
+		float dirX = wave.Direction.x;
+		float dirZ = wave.Direction.y;
+		const float length = sqrtf(dirX * dirX + dirZ * dirZ);
+		if (length > 0.f)
+		{
+			dirX /= length;
+			dirZ /= length;
+		}
+
+		const float k = 2.f * MathHelper::Pi / wave.Wavelength;
+		mKx[w] = k * dirX;
+		mKz[w] = k * dirZ;
+
+		// w t is only as exact as w, so the frequency is worked out in
+		// double from the wavelength, not from the float k.
+		mOmega[w] = sqrt(Gravity * (TwoPi / wave.Wavelength));
+		mPhase[w] = wave.Phase;
+		mAmplitude[w] = wave.Amplitude;
+		mDisplaceX[w] = wave.Steepness * wave.Amplitude * dirX;
+		mDisplaceZ[w] = wave.Steepness * wave.Amplitude * dirZ;
+	}
+}
+
+UINT GerstnerWaves::RowCount() const
+{
+	return mNumRows;
+}
+
+UINT GerstnerWaves::ColumnCount() const
+{
+	return mNumCols;
+}
+
+UINT GerstnerWaves::VertexCount() const
+{
+	return mNumRows * mNumCols;
+}
+
+UINT GerstnerWaves::TriangleCount() const
+{
+	return (mNumRows - 1) * (mNumCols - 1) * 2;
+}
+
+UINT GerstnerWaves::WaveCount() const
+{
+	return (UINT)mKx.size();
+}
+
+void GerstnerWaves::BuildTerms(double t, WavesKernels::GerstnerTerm* terms) const
+{
+	// -w t grows without bound; reducing it in double, from a double t and
+	// a double w, keeps the float phase the kernels see small and exact to
+	// float precision whatever the time.
+	for (UINT w = 0; w < WaveCount(); ++w)
+	{
+		terms[w].Kx = mKx[w];
+		terms[w].Kz = mKz[w];
+		terms[w].Offset = (float)fmod(mPhase[w] - mOmega[w] * t, TwoPi);
+		terms[w].Amplitude = mAmplitude[w];
+		terms[w].DisplaceX = mDisplaceX[w];
+		terms[w].DisplaceZ = mDisplaceZ[w];
+	}
+}
+
+void GerstnerWaves::WriteVertices(double t, UINT rowBegin, UINT rowEnd,
+	void* dest, UINT stride, UINT positionOffset) const
+{
+	assert(rowEnd <= mNumRows);
+
+	WavesKernels::GerstnerTerm terms[MaxWaves];
+	BuildTerms(t, terms);
+
+	const UINT n = mNumCols;
+	BYTE* base = static_cast<BYTE*>(dest);
+
+	float outX[ChunkPoints];
+	float outY[ChunkPoints];
+	float outZ[ChunkPoints];
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		for (UINT c0 = 0; c0 < n; c0 += ChunkPoints)
+		{
+			const UINT count = MathHelper::Min(n - c0, ChunkPoints);
+			WavesKernels::GerstnerRow(&mColumnX[c0], &mRowZ[i], 0, count,
+				terms, WaveCount(), outX, outY, outZ);
+			WavesKernels::StreamFloat3Row(base + (i * n + c0) * stride + positionOffset, stride, count,
+				outX, 1, outY, 1, outZ, 1);
+		}
+	}
+
+	WavesKernels::EndStreaming();
+}
+
+void GerstnerWaves::Evaluate(double t, const float* x, const float* z,
+	float* outX, float* outY, float* outZ, UINT count) const
+{
+	WavesKernels::GerstnerTerm terms[MaxWaves];
+	BuildTerms(t, terms);
+
+	WavesKernels::GerstnerRow(x, z, 1, count, terms, WaveCount(), outX, outY, outZ);
+}
+
+XMFLOAT3 GerstnerWaves::Evaluate(double t, float x, float z) const
+{
+	XMFLOAT3 p;
+	Evaluate(t, &x, &z, &p.x, &p.y, &p.z, 1);
+	return p;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "WavesKernels.h"
+
+#include <Windows.h>
+#include <xnamath.h>
+#include <vector>
+
+///<summary>
+/// Closed-form background water: a sum of Gerstner waves evaluated directly
+/// at any time t, for surfaces nobody interacts with and that do not need a
+/// Waves simulation.  After Init() the object only holds the grid and the
+/// wave parameters; every query is a const function of t, so any number of
+/// threads can fill disjoint tiles of the same grid, or of one vertex
+/// buffer, at once.
+///
+/// Each wave moves points along its direction as well as up, sharpening
+/// the crests:
+///
+///   P = (x + sum Q A D.x cos theta, sum A sin theta, z + sum Q A D.z cos theta)
+///   theta = k D . (x, z) - w t + phase,  k = 2 pi / wavelength,  w = sqrt(g k)
+///
+/// Steepness Q = 0 gives a plain sum of sines.  Crests loop over themselves
+/// once the sum of Q k A passes 1.
+///
+/// Time is a double in seconds, and w, the phase and w t are kept in
+/// double, so the surface stays as sharp after days of uptime as at t = 0.
+/// A float clock would not: after a day it only resolves about 8 ms, so
+/// keep the caller's clock in double too.
+///</summary>
+class GerstnerWaves
+{
+public:
+	struct Wave
+	{
+		// Direction of travel in the xz-plane; normalised by Init().
+		XMFLOAT2 Direction;
+		float Wavelength;
+		float Amplitude;
+		float Steepness;
+		float Phase;
+	};
+
+	static const UINT MaxWaves = 64;
+
+	GerstnerWaves();
+
+	// The grid is laid out as Waves::Init(m, n, dx, ...) lays out its own.
+	void Init(UINT m, UINT n, float dx, const Wave* waves, UINT waveCount);
+
+	UINT RowCount() const;
+	UINT ColumnCount() const;
+	UINT VertexCount() const;
+	UINT TriangleCount() const;
+	UINT WaveCount() const;
+
+	///<summary>
+	/// Writes the positions of grid rows [rowBegin, rowEnd) at time t into
+	/// caller memory laid out like Waves::WriteVertices(): VertexCount()
+	/// vertices of stride bytes, with vertex i * n + j at row i, column j.
+	/// Only the position is touched and the stores are non-temporal.
+	///</summary>
+	void WriteVertices(double t, UINT rowBegin, UINT rowEnd,
+		void* dest, UINT stride, UINT positionOffset) const;
+
+	// Surface points displaced from count rest positions (x[k], z[k]).
+	void Evaluate(double t, const float* x, const float* z,
+		float* outX, float* outY, float* outZ, UINT count) const;
+
+	// Surface point displaced from the rest position (x, z).
+	XMFLOAT3 Evaluate(double t, float x, float z) const;
+
+private:
+	// Per-wave kernel terms at time t, into terms[WaveCount()].
+	void BuildTerms(double t, WavesKernels::GerstnerTerm* terms) const;
+
+private:
+	UINT mNumRows;
+	UINT mNumCols;
+
+	std::vector<float> mColumnX;
+	std::vector<float> mRowZ;
+
+	// Per wave: wave vector, angular frequency, phase, and the amplitudes
+	// of the vertical and horizontal motion.  Frequency and phase are double
+	// because w t is formed from them.
+	std::vector<float> mKx;
+	std::vector<float> mKz;
+	std::vector<double> mOmega;
+	std::vector<double> mPhase;
+	std::vector<float> mAmplitude;
+	std::vector<float> mDisplaceX;
+	std::vector<float> mDisplaceZ;
+};
@@ -0,0 +1,361 @@
+// Winsock 2 has to come before Windows.h pulls in the old winsock.h.
+#include <winsock2.h>
+#include <ws2tcpip.h>
+
+#include "HaloTransport.h"
+
+#include <cassert>
+#include <cstdio>
+
+#pragma comment(lib, "Ws2_32.lib")
+
+namespace
+{
+	ULONG LoadAcquire(volatile ULONG* p)
+	{
+		const ULONG v = *p;
+		MemoryBarrier();
+		return v;
+	}
+
+	void StoreRelease(volatile ULONG* p, ULONG v)
+	{
+		MemoryBarrier();
+		*p = v;
+	}
+
+	// Spin briefly for a neighbour that is a few microseconds behind, then
+	// give the core away.  Returns false once the wait that began at start
+	// has outlasted timeoutMs; the clock is only read after the spinning.
+	bool Backoff(UINT& spins, ULONGLONG start, DWORD timeoutMs)
+	{
+		if (++spins < 1024)
+		{
+			YieldProcessor();
+			return true;
+		}
+
+		SwitchToThread();
+		return GetTickCount64() - start < timeoutMs;
+	}
+
+	// Both directions of a neighbour link can be sending at once.  A blocked
+	// send or receive fails after timeoutMs instead of waiting for a
+	// neighbour that may never answer.
+	void ConfigureSocket(SOCKET s, UINT maxCount, DWORD timeoutMs)
+	{
+		BOOL noDelay = TRUE;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+
+		int bufferBytes = (int)(4 * maxCount * sizeof(float));
+		if (bufferBytes < 64 * 1024)
+		{
+			bufferBytes = 64 * 1024;
+		}
+		setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<const char*>(&bufferBytes), sizeof(bufferBytes));
+		setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<const char*>(&bufferBytes), sizeof(bufferBytes));
+
+		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeoutMs), sizeof(timeoutMs));
+	}
+}
+
+//
+// SharedMemoryTransport
+//
+
+SharedMemoryTransport::SharedMemoryTransport()
+	: mMapping(NULL)
+	, mView(NULL)
+	, mRank(0)
+	, mNumRanks(0)
+	, mMaxCount(0)
+	, mLinkBytes(0)
+	, mTimeoutMs(DefaultTimeoutMs)
+{
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+	Release();
+}
+
+bool SharedMemoryTransport::Init(const char* name, UINT rank, UINT numRanks, UINT maxCount,
+	DWORD timeoutMs)
+{
+	Release();
+
+	mRank = rank;
+	mNumRanks = numRanks;
+	mMaxCount = maxCount;
+	mTimeoutMs = timeoutMs;
+
+	// Each rank has an inbound link from the rank above and one from below.
+	mLinkBytes = sizeof(LinkHeader) + SlotsPerLink * maxCount * sizeof(float);
+	mLinkBytes = (mLinkBytes + 63) / 64 * 64;
+	const UINT64 totalBytes = (UINT64)2 * numRanks * mLinkBytes;
+
+	// Whichever rank gets here first creates the mapping, zero-filled, and
+	// the rest open it, so the ring counters all start at zero.
+	mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(totalBytes >> 32), (DWORD)totalBytes, name);
+	if (mMapping == NULL)
+	{
+		return false;
+	}
+
+	mView = static_cast<BYTE*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+	if (mView == NULL)
+	{
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+void SharedMemoryTransport::Release()
+{
+	if (mView != NULL)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+	if (mMapping != NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+}
+
+BYTE* SharedMemoryTransport::Link(UINT from, UINT to) const
+{
+	return mView + (2 * to + (from < to ? 0 : 1)) * mLinkBytes;
+}
+
+bool SharedMemoryTransport::Send(UINT to, const float* data, UINT count)
+{
+	assert(count <= mMaxCount);
+
+	BYTE* link = Link(mRank, to);
+	LinkHeader* header = reinterpret_cast<LinkHeader*>(link);
+	float* slots = reinterpret_cast<float*>(link + sizeof(LinkHeader));
+
+	// Only this rank writes Head, so a plain read is current.
+	const ULONG head = header->Head;
+	const ULONGLONG start = GetTickCount64();
+	UINT spins = 0;
+	while (head - LoadAcquire(&header->Tail) >= SlotsPerLink)
+	{
+		if (!Backoff(spins, start, mTimeoutMs))
+		{
+			return false;
+		}
+	}
+
+	CopyMemory(slots + (head % SlotsPerLink) * mMaxCount, data, count * sizeof(float));
+	StoreRelease(&header->Head, head + 1);
+	return true;
+}
+
+bool SharedMemoryTransport::Receive(UINT from, float* data, UINT count)
+{
+	assert(count <= mMaxCount);
+
+	BYTE* link = Link(from, mRank);
+	LinkHeader* header = reinterpret_cast<LinkHeader*>(link);
+	const float* slots = reinterpret_cast<const float*>(link + sizeof(LinkHeader));
+
+	const ULONG tail = header->Tail;
+	const ULONGLONG start = GetTickCount64();
+	UINT spins = 0;
+	while (LoadAcquire(&header->Head) == tail)
+	{
+		if (!Backoff(spins, start, mTimeoutMs))
+		{
+			return false;
+		}
+	}
+
+	CopyMemory(data, slots + (tail % SlotsPerLink) * mMaxCount, count * sizeof(float));
+	StoreRelease(&header->Tail, tail + 1);
+	return true;
+}
+
+//
+// SocketTransport
+//
+
+SocketTransport::SocketTransport()
+	: mRank(0)
+	, mUp(INVALID_SOCKET)
+	, mDown(INVALID_SOCKET)
+	, mbStarted(false)
+{
+}
+
+SocketTransport::~SocketTransport()
+{
+	Release();
+}
+
+bool SocketTransport::Init(const std::vector<std::string>& hosts, USHORT basePort, UINT rank, UINT maxCount,
+	DWORD timeoutMs)
+{
+	Release();
+
+	WSADATA wsaData;
+	if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0)
+	{
+		return false;
+	}
+	mbStarted = true;
+	mRank = rank;
+
+	// Listen before connecting anywhere: the rank above connects to us while
+	// we may still be waiting on the rank below.
+	SOCKET listener = INVALID_SOCKET;
+	if (rank > 0)
+	{
+		listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+		sockaddr_in addr;
+		ZeroMemory(&addr, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons((USHORT)(basePort + rank));
+
+		if (listener == INVALID_SOCKET ||
+			bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == SOCKET_ERROR ||
+			listen(listener, 1) == SOCKET_ERROR)
+		{
+			closesocket(listener);
+			Release();
+			return false;
+		}
+	}
+
+	if (rank + 1 < hosts.size())
+	{
+		char port[16];
+		sprintf_s(port, "%u", (UINT)(basePort + rank + 1));
+
+		addrinfo hints;
+		ZeroMemory(&hints, sizeof(hints));
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		hints.ai_protocol = IPPROTO_TCP;
+
+		addrinfo* result = NULL;
+		if (getaddrinfo(hosts[rank + 1].c_str(), port, &hints, &result) != 0)
+		{
+			closesocket(listener);
+			Release();
+			return false;
+		}
+
+		// The neighbour may not be listening yet; keep trying for a while.
+		for (UINT attempt = 0; attempt < 600 && mDown == INVALID_SOCKET; ++attempt)
+		{
+			SOCKET s = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+			if (s != INVALID_SOCKET && connect(s, result->ai_addr, (int)result->ai_addrlen) == 0)
+			{
+				mDown = s;
+				break;
+			}
+			closesocket(s);
+			Sleep(50);
+		}
+		freeaddrinfo(result);
+
+		if (mDown == INVALID_SOCKET)
+		{
+			closesocket(listener);
+			Release();
+			return false;
+		}
+		ConfigureSocket(mDown, maxCount, timeoutMs);
+	}
+
+	if (listener != INVALID_SOCKET)
+	{
+		mUp = accept(listener, NULL, NULL);
+		closesocket(listener);
+		if (mUp == INVALID_SOCKET)
+		{
+			Release();
+			return false;
+		}
+		ConfigureSocket(mUp, maxCount, timeoutMs);
+	}
+
+	return true;
+}
+
+void SocketTransport::Release()
+{
+	if (mUp != INVALID_SOCKET)
+	{
+		closesocket(mUp);
+		mUp = INVALID_SOCKET;
+	}
+	if (mDown != INVALID_SOCKET)
+	{
+		closesocket(mDown);
+		mDown = INVALID_SOCKET;
+	}
+	if (mbStarted)
+	{
+		WSACleanup();
+		mbStarted = false;
+	}
+}
+
+UINT_PTR SocketTransport::Neighbour(UINT rank) const
+{
+	assert(rank + 1 == mRank || rank == mRank + 1);
+	return rank < mRank ? mUp : mDown;
+}
+
+bool SocketTransport::Send(UINT to, const float* data, UINT count)
+{
+	const SOCKET s = Neighbour(to);
+	const char* bytes = reinterpret_cast<const char*>(data);
+	int remaining = (int)(count * sizeof(float));
+
+	while (remaining > 0)
+	{
+		// Fails on a closed or reset connection and on SO_SNDTIMEO.
+		const int sent = send(s, bytes, remaining, 0);
+		if (sent <= 0)
+		{
+			return false;
+		}
+		bytes += sent;
+		remaining -= sent;
+	}
+
+	return true;
+}
+
+bool SocketTransport::Receive(UINT from, float* data, UINT count)
+{
+	const SOCKET s = Neighbour(from);
+	char* bytes = reinterpret_cast<char*>(data);
+	int remaining = (int)(count * sizeof(float));
+
+	while (remaining > 0)
+	{
+		// 0 is the neighbour closing the connection, e.g. by exiting; an
+		// error includes SO_RCVTIMEO expiring.
+		const int received = recv(s, bytes, remaining, 0);
+		if (received <= 0)
+		{
+			return false;
+		}
+		bytes += received;
+		remaining -= received;
+	}
+
+	return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <Windows.h>
+#include <string>
+#include <vector>
+
+///<summary>
+/// Moves halo rows between the ranks of a WavesDomain.  Ranks only talk to
+/// the rank directly above and below them, and messages between one pair of
+/// ranks arrive in the order they were sent.
+///</summary>
+class HaloTransport
+{
+public:
+	// How long Send() and Receive() wait for a neighbour by default.  Long
+	// enough for ranks that are still starting up.
+	static const DWORD DefaultTimeoutMs = 30000;
+
+	virtual ~HaloTransport() {}
+
+	// Sends count floats to rank 'to'; may block while the link is full.
+	// Returns false if the link is broken or stays full past the timeout,
+	// e.g. because the neighbour died.
+	virtual bool Send(UINT to, const float* data, UINT count) = 0;
+
+	// Blocks until the next message from rank 'from' arrives.  Returns
+	// false, with data only partly written, if the link is broken or
+	// nothing arrives within the timeout.
+	virtual bool Receive(UINT from, float* data, UINT count) = 0;
+};
+
+///<summary>
+/// Ranks are processes on one machine that open the same named file mapping.
+/// Every directed neighbour link is a single-producer ring of message slots
+/// in that mapping, so a message is one copy in and one copy out with no
+/// system call on the fast path.
+///</summary>
+class SharedMemoryTransport : public HaloTransport
+{
+public:
+	SharedMemoryTransport();
+	virtual ~SharedMemoryTransport();
+
+	// Every rank passes the same name, numRanks and maxCount (the longest
+	// message in floats).  Returns false if the mapping cannot be created.
+	// A peer that stops moving its end of a link for timeoutMs is taken to
+	// be dead.
+	bool Init(const char* name, UINT rank, UINT numRanks, UINT maxCount,
+		DWORD timeoutMs = DefaultTimeoutMs);
+	void Release();
+
+	virtual bool Send(UINT to, const float* data, UINT count) override;
+	virtual bool Receive(UINT from, float* data, UINT count) override;
+
+private:
+	// Message counters of one link, on separate cache lines.
+	struct LinkHeader
+	{
+		volatile ULONG Head;
+		BYTE HeadPad[64 - sizeof(ULONG)];
+		volatile ULONG Tail;
+		BYTE TailPad[64 - sizeof(ULONG)];
+	};
+
+	BYTE* Link(UINT from, UINT to) const;
+
+	SharedMemoryTransport(const SharedMemoryTransport&);
+	SharedMemoryTransport& operator=(const SharedMemoryTransport&);
+
+private:
+	static const UINT SlotsPerLink = 4;
+
+	HANDLE mMapping;
+	BYTE* mView;
+	UINT mRank;
+	UINT mNumRanks;
+	UINT mMaxCount;
+	UINT mLinkBytes;
+	DWORD mTimeoutMs;
+};
+
+///<summary>
+/// Ranks connected over TCP, one connection per neighbour pair, so they can
+/// run on separate nodes; with every host at 127.0.0.1 it runs over loopback
+/// on one machine.  Rank r listens on basePort + r and connects to rank r + 1.
+///</summary>
+class SocketTransport : public HaloTransport
+{
+public:
+	SocketTransport();
+	virtual ~SocketTransport();
+
+	// hosts[r] is the address of rank r.  Blocks until both neighbours are
+	// connected.  maxCount sizes the socket buffers so two ranks sending to
+	// each other at once cannot both stall.  timeoutMs bounds each send and
+	// receive on the connected sockets.
+	bool Init(const std::vector<std::string>& hosts, USHORT basePort, UINT rank, UINT maxCount,
+		DWORD timeoutMs = DefaultTimeoutMs);
+	void Release();
+
+	virtual bool Send(UINT to, const float* data, UINT count) override;
+	virtual bool Receive(UINT from, float* data, UINT count) override;
+
+private:
+	// SOCKET handles, kept as UINT_PTR so this header does not need Winsock.
+	UINT_PTR Neighbour(UINT rank) const;
+
+	SocketTransport(const SocketTransport&);
+	SocketTransport& operator=(const SocketTransport&);
+
+private:
+	UINT mRank;
+	UINT_PTR mUp;
+	UINT_PTR mDown;
+	bool mbStarted;
+};
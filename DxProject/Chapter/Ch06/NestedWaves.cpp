@@ -0,0 +1,427 @@
+#include "NestedWaves.h"
+#include "../../Common/MathHelper.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+	// Level points this close to the edge are left out of the restriction:
+	// the boundary ring is the parent's own data, and the next few points
+	// are still settling from its interpolation.
+	const UINT RestrictMargin = 4;
+
+	// A level is moved once the focus is more than 1/RecenterSlack of its
+	// width from the centre, so a slowly moving focus does not move it every
+	// step.
+	const UINT RecenterSlack = 8;
+
+	int NearestEven(float x)
+	{
+		return 2 * (int)floorf(0.5f * x + 0.5f);
+	}
+}
+
+NestedWaves::NestedWaves()
+	: mLevelCount(0), mNumRows(0), mNumCols(0)
+	, mSpatialStep(0.f)
+	, mTick(0)
+	, mFocusX(0.f), mFocusZ(0.f)
+	, mOriginX(0.f), mOriginZ(0.f)
+{
+}
+
+void NestedWaves::Init(UINT levelCount, UINT m, UINT n, float dx, float dt, float speed, float damping,
+	Waves::Boundary outerBoundary)
+{
+	assert(levelCount >= 1 && levelCount <= MaxLevels);
+	assert(m >= 4 * RestrictMargin && n >= 4 * RestrictMargin);
+
+	mLevelCount = levelCount;
+	mNumRows = m;
+	mNumCols = n;
+	mSpatialStep = dx;
+	mClock.Reset(dt);
+	mTick = 0;
+
+	const UINT coarsest = levelCount - 1;
+	for (UINT l = 0; l < levelCount; ++l)
+	{
+		mLevels[l].Init(m, n, Spacing(l), dt * (1 << l), speed, damping,
+			Waves::STORAGE_SOA, 1.f / 1024.f, Waves::INTEGRATOR_EXPLICIT,
+			l == coarsest ? outerBoundary : Waves::BOUNDARY_FIXED);
+	}
+
+	mOriginX = -0.5f * (n - 1) * Spacing(coarsest);
+	mOriginZ = 0.5f * (m - 1) * Spacing(coarsest);
+
+	// Each level starts in the middle of its parent.
+	mLevelRow[coarsest] = 0;
+	mLevelCol[coarsest] = 0;
+	for (UINT l = coarsest; l-- > 0; )
+	{
+		mLevelRow[l] = 2 * mLevelRow[l + 1] + (int)((m - 1) / 2 & ~1u);
+		mLevelCol[l] = 2 * mLevelCol[l + 1] + (int)((n - 1) / 2 & ~1u);
+	}
+	mFocusX = 0.f;
+	mFocusZ = 0.f;
+
+	mParentScratch.resize(2 * (m / 2 + 2) * (n / 2 + 2));
+	mLevelScratch.resize(m * n);
+	mMoveScratch.resize(m * n);
+}
+
+UINT NestedWaves::LevelCount() const
+{
+	return mLevelCount;
+}
+
+const Waves& NestedWaves::Level(UINT l) const
+{
+	assert(l < mLevelCount);
+	return mLevels[l];
+}
+
+float NestedWaves::Spacing(UINT l) const
+{
+	return mSpatialStep * (1 << l);
+}
+
+XMFLOAT3 NestedWaves::LevelOffset(UINT l) const
+{
+	const float spacing = Spacing(l);
+	return XMFLOAT3(
+		mOriginX + (mLevelCol[l] + (mNumCols - 1) * 0.5f) * spacing,
+		0.f,
+		mOriginZ - (mLevelRow[l] + (mNumRows - 1) * 0.5f) * spacing);
+}
+
+void NestedWaves::CoveredCells(UINT l, UINT& rowBegin, UINT& rowEnd, UINT& colBegin, UINT& colEnd) const
+{
+	if (l == 0)
+	{
+		rowBegin = rowEnd = colBegin = colEnd = 0;
+		return;
+	}
+
+	// Cells of level l whose four corners all lie inside level l - 1.
+	rowBegin = mLevelRow[l - 1] / 2 - mLevelRow[l];
+	colBegin = mLevelCol[l - 1] / 2 - mLevelCol[l];
+	rowEnd = rowBegin + (mNumRows - 1) / 2;
+	colEnd = colBegin + (mNumCols - 1) / 2;
+}
+
+float NestedWaves::Height(float x, float z) const
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+
+	for (UINT l = 0; l < mLevelCount; ++l)
+	{
+		const float u = (x - mOriginX) / Spacing(l) - mLevelCol[l];
+		const float v = (mOriginZ - z) / Spacing(l) - mLevelRow[l];
+		if (u < 0.f || v < 0.f || u > n - 1 || v > m - 1)
+		{
+			continue;
+		}
+
+		const UINT i = MathHelper::Min((UINT)v, m - 2);
+		const UINT j = MathHelper::Min((UINT)u, n - 2);
+		const float s = u - j;
+		const float t = v - i;
+
+		const Waves& level = mLevels[l];
+		const float h00 = level[i * n + j].y;
+		const float h01 = level[i * n + j + 1].y;
+		const float h10 = level[(i + 1) * n + j].y;
+		const float h11 = level[(i + 1) * n + j + 1].y;
+		return (1.f - t) * (h00 + s * (h01 - h00)) + t * (h10 + s * (h11 - h10));
+	}
+
+	return 0.f;
+}
+
+UINT NestedWaves::Update(float dt)
+{
+	const UINT numSteps = mClock.Advance(dt);
+	if (numSteps > 0)
+	{
+		UpdateSteps(numSteps);
+	}
+
+	return numSteps;
+}
+
+void NestedWaves::SetMaxStepsPerUpdate(UINT maxSteps)
+{
+	mClock.SetMaxStepsPerUpdate(maxSteps);
+}
+
+float NestedWaves::DroppedTime() const
+{
+	return mClock.DroppedTime();
+}
+
+void NestedWaves::UpdateSteps(UINT numSteps)
+{
+	for (UINT s = 0; s < numSteps; ++s)
+	{
+		Tick();
+	}
+}
+
+void NestedWaves::Tick()
+{
+	// Every level is at the same time at the start of a coarsest step, so
+	// that is when levels can move.
+	if (mTick == 0)
+	{
+		Recenter();
+	}
+
+	// Level l steps on every 2^l-th tick, after its parent, with its
+	// boundary taken at the start or the middle of the parent's step.
+	const UINT coarsest = mLevelCount - 1;
+	for (UINT l = coarsest + 1; l-- > 0; )
+	{
+		if ((mTick & ((1u << l) - 1)) != 0)
+		{
+			continue;
+		}
+		if (l < coarsest)
+		{
+			ProlongHalo(l, ((mTick >> l) & 1) != 0 ? 0.5f : 0.f);
+		}
+		mLevels[l].UpdateSteps(1);
+	}
+
+	// A level that has just finished its second step has caught up with its
+	// parent; finer levels go first so their detail reaches the top.
+	for (UINT l = 0; l < coarsest; ++l)
+	{
+		if (((mTick + 1) & ((2u << l) - 1)) == 0)
+		{
+			Restrict(l);
+		}
+	}
+
+	mTick = (mTick + 1) & ((1u << coarsest) - 1);
+}
+
+void NestedWaves::Prolong(UINT l, float t, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+	float* dest, UINT pitch)
+{
+	const UINT p = l + 1;
+
+	// Point (i, j) of level l is point (r0 + i / 2, c0 + j / 2) of the parent.
+	const UINT r0 = mLevelRow[l] / 2 - mLevelRow[p];
+	const UINT c0 = mLevelCol[l] / 2 - mLevelCol[p];
+
+	const UINT parentRowBegin = r0 + rowBegin / 2;
+	const UINT parentRowEnd = r0 + rowEnd / 2 + 1;
+	const UINT parentColBegin = c0 + colBegin / 2;
+	const UINT parentColEnd = c0 + colEnd / 2 + 1;
+	const UINT w = parentColEnd - parentColBegin;
+
+	// Parent heights at fraction t of its last step.
+	float* h = &mParentScratch[0];
+	float* next = h + (parentRowEnd - parentRowBegin) * w;
+	mLevels[p].ReadRegion(Waves::LEVEL_PREVIOUS, parentRowBegin, parentRowEnd, parentColBegin, parentColEnd, h, w);
+	mLevels[p].ReadRegion(Waves::LEVEL_CURRENT, parentRowBegin, parentRowEnd, parentColBegin, parentColEnd, next, w);
+	for (UINT k = 0; k < (parentRowEnd - parentRowBegin) * w; ++k)
+	{
+		h[k] += t * (next[k] - h[k]);
+	}
+
+	// Bilinear: points on parent points copy them, the rest average two or
+	// four.  Averaging a value with itself is exact, so one formula covers
+	// every case.
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const float* row0 = h + (i / 2 - rowBegin / 2) * w;
+		const float* row1 = (i & 1) != 0 ? row0 + w : row0;
+		float* out = dest + (i - rowBegin) * pitch;
+
+		for (UINT j = colBegin; j < colEnd; ++j)
+		{
+			const UINT q = j / 2 - colBegin / 2;
+			const UINT q1 = (j & 1) != 0 ? q + 1 : q;
+			out[j - colBegin] = 0.25f * ((row0[q] + row0[q1]) + (row1[q] + row1[q1]));
+		}
+	}
+}
+
+void NestedWaves::ProlongHalo(UINT l, float t)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	float* edge = &mLevelScratch[0];
+	Waves& level = mLevels[l];
+
+	Prolong(l, t, 0, 1, 1, n - 1, edge, n);
+	level.WriteHalo(Waves::EDGE_TOP, edge);
+	Prolong(l, t, m - 1, m, 1, n - 1, edge, n);
+	level.WriteHalo(Waves::EDGE_BOTTOM, edge);
+	Prolong(l, t, 1, m - 1, 0, 1, edge, 1);
+	level.WriteHalo(Waves::EDGE_LEFT, edge);
+	Prolong(l, t, 1, m - 1, n - 1, n, edge, 1);
+	level.WriteHalo(Waves::EDGE_RIGHT, edge);
+}
+
+void NestedWaves::Restrict(UINT l)
+{
+	const UINT p = l + 1;
+	const UINT r0 = mLevelRow[l] / 2 - mLevelRow[p];
+	const UINT c0 = mLevelCol[l] / 2 - mLevelCol[p];
+
+	// Parent points (r0 + a, c0 + b) for a in [rowBegin, rowEnd) and b in
+	// [colBegin, colEnd) sit on level points (2a, 2b) clear of the margin.
+	const UINT rowBegin = (RestrictMargin + 1) / 2;
+	const UINT rowEnd = (mNumRows - 1 - RestrictMargin) / 2 + 1;
+	const UINT colBegin = (RestrictMargin + 1) / 2;
+	const UINT colEnd = (mNumCols - 1 - RestrictMargin) / 2 + 1;
+
+	// Level points around them, one more on every side.
+	const UINT w = 2 * (colEnd - colBegin) + 1;
+	float* fine = &mLevelScratch[0];
+	mLevels[l].ReadRegion(Waves::LEVEL_CURRENT, 2 * rowBegin - 1, 2 * rowEnd, 2 * colBegin - 1, 2 * colEnd, fine, w);
+
+	// Full weighting, 1/16 [1 2 1; 2 4 2; 1 2 1], so detail the parent cannot
+	// hold is averaged away rather than aliased.
+	const UINT coarseWidth = colEnd - colBegin;
+	float* coarse = &mParentScratch[0];
+	for (UINT a = 0; a < rowEnd - rowBegin; ++a)
+	{
+		const float* up = fine + 2 * a * w;
+		const float* mid = up + w;
+		const float* down = mid + w;
+		for (UINT b = 0; b < coarseWidth; ++b)
+		{
+			const UINT k = 2 * b + 1;
+			const float corners = (up[k - 1] + up[k + 1]) + (down[k - 1] + down[k + 1]);
+			const float sides = (up[k] + down[k]) + (mid[k - 1] + mid[k + 1]);
+			coarse[a * coarseWidth + b] = 0.25f * mid[k] + 0.125f * sides + 0.0625f * corners;
+		}
+	}
+
+	mLevels[p].WriteRegion(Waves::LEVEL_CURRENT, r0 + rowBegin, r0 + rowEnd, c0 + colBegin, c0 + colEnd,
+		coarse, coarseWidth);
+}
+
+void NestedWaves::SetFocus(float x, float z)
+{
+	mFocusX = x;
+	mFocusZ = z;
+}
+
+void NestedWaves::Recenter()
+{
+	const int m = (int)mNumRows;
+	const int n = (int)mNumCols;
+
+	// Coarse to fine, so each level is placed inside its parent's new spot.
+	for (UINT l = mLevelCount - 1; l-- > 0; )
+	{
+		const UINT p = l + 1;
+		const float spacing = Spacing(l);
+
+		// A level spans half its parent; keep it inside.
+		const int rowLow = 2 * mLevelRow[p];
+		const int rowHigh = rowLow + ((m - 1) & ~1);
+		const int colLow = 2 * mLevelCol[p];
+		const int colHigh = colLow + ((n - 1) & ~1);
+
+		const int row = MathHelper::Clamp(NearestEven((mOriginZ - mFocusZ) / spacing - (m - 1) * 0.5f), rowLow, rowHigh);
+		const int col = MathHelper::Clamp(NearestEven((mFocusX - mOriginX) / spacing - (n - 1) * 0.5f), colLow, colHigh);
+
+		const bool outside = mLevelRow[l] < rowLow || mLevelRow[l] > rowHigh ||
+			mLevelCol[l] < colLow || mLevelCol[l] > colHigh;
+		const bool drifted = abs(row - mLevelRow[l]) > m / (int)RecenterSlack ||
+			abs(col - mLevelCol[l]) > n / (int)RecenterSlack;
+		if (outside || drifted)
+		{
+			MoveLevel(l, row, col);
+		}
+	}
+}
+
+void NestedWaves::MoveLevel(UINT l, int row, int col)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	const int shiftRow = row - mLevelRow[l];
+	const int shiftCol = col - mLevelCol[l];
+
+	mLevelRow[l] = row;
+	mLevelCol[l] = col;
+
+	// Fill the new spot from the parent, then copy over whatever the level
+	// already had there.  The parent's previous heights are one parent step
+	// old; the level's are half that.
+	for (UINT k = 0; k < 2; ++k)
+	{
+		const Waves::TimeLevel timeLevel = k == 0 ? Waves::LEVEL_PREVIOUS : Waves::LEVEL_CURRENT;
+		float* old = &mMoveScratch[0];
+		float* moved = &mLevelScratch[0];
+
+		mLevels[l].ReadRegion(timeLevel, 0, m, 0, n, old, n);
+		Prolong(l, k == 0 ? 0.5f : 1.f, 0, m, 0, n, moved, n);
+
+		for (UINT i = 0; i < m; ++i)
+		{
+			const int oldRow = (int)i + shiftRow;
+			if (oldRow < 0 || oldRow >= (int)m)
+			{
+				continue;
+			}
+			for (UINT j = 0; j < n; ++j)
+			{
+				const int oldCol = (int)j + shiftCol;
+				if (oldCol >= 0 && oldCol < (int)n)
+				{
+					moved[i * n + j] = old[oldRow * n + oldCol];
+				}
+			}
+		}
+
+		mLevels[l].WriteRegion(timeLevel, 0, m, 0, n, moved, n);
+	}
+}
+
+void NestedWaves::Disturb(float x, float z, float magnitude, float radius)
+{
+	const UINT coarsest = mLevelCount - 1;
+
+	for (UINT l = 0; l <= coarsest; ++l)
+	{
+		// Impulses near a finer level's edge would only be overwritten by the
+		// parent, so they go to the parent instead.
+		const float u = (x - mOriginX) / Spacing(l) - mLevelCol[l];
+		const float v = (mOriginZ - z) / Spacing(l) - mLevelRow[l];
+		const float margin = RestrictMargin + radius / Spacing(l);
+		const bool inside = u >= margin && v >= margin &&
+			u <= mNumCols - 1 - margin && v <= mNumRows - 1 - margin;
+		if (!inside && l < coarsest)
+		{
+			continue;
+		}
+
+		const XMFLOAT3 offset = LevelOffset(l);
+		Waves::WorldImpulse impulse;
+		impulse.X = x - offset.x;
+		impulse.Z = z - offset.z;
+		impulse.Magnitude = magnitude;
+		impulse.Radius = radius;
+		mLevels[l].DisturbBatch(&impulse, 1);
+		return;
+	}
+}
+
+void NestedWaves::SetThreadCount(UINT numThreads)
+{
+	for (UINT l = 0; l < mLevelCount; ++l)
+	{
+		mLevels[l].SetThreadCount(numThreads);
+	}
+}
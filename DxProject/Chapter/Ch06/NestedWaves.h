@@ -0,0 +1,131 @@
+#pragma once
+
+#include "Waves.h"
+
+#include <vector>
+
+///<summary>
+/// Level-of-detail water: a stack of Waves grids of the same size nested
+/// around a focus point, usually the camera or the player.  Level 0 is the
+/// finest; every level above it has twice the cell size and twice the time
+/// step, so it covers four times the area at the same cost per step and the
+/// same Courant number, and steps half as often.
+///
+/// Each level is stepped as a whole, coarse to fine (Berger-Oliger):
+///   - before a step, a level's boundary ring is prolonged from its parent,
+///     bilinear in space and linear in time between the parent's two time
+///     levels, so waves arrive from the far field;
+///   - after its second step, once it has caught up with the parent, its
+///     interior is restricted back onto the parent (full weighting), so
+///     waves leave the fine region through the coarse grid.
+/// When the focus strays far enough from the centre of a level, the level
+/// is moved by whole parent cells; cells that come into view are filled
+/// from the parent and the rest keep their fine detail.
+///</summary>
+class NestedWaves
+{
+public:
+	static const UINT MaxLevels = 8;
+
+	NestedWaves();
+
+	///<summary>
+	/// levelCount grids of m x n points.  Level 0 has cell size dx and time
+	/// step dt; the coarsest, level levelCount - 1, spans the whole domain
+	/// (m - 1) * dx * 2^(levelCount - 1) across, centred on the origin, with
+	/// outerBoundary on its edges (BOUNDARY_ABSORBING lets waves leave the
+	/// domain).  All levels use STORAGE_SOA and INTEGRATOR_EXPLICIT.
+	///</summary>
+	void Init(UINT levelCount, UINT m, UINT n, float dx, float dt, float speed, float damping,
+		Waves::Boundary outerBoundary = Waves::BOUNDARY_FIXED);
+
+	UINT LevelCount() const;
+
+	// Level grids keep their own local coordinates; add LevelOffset() to
+	// place them in the domain's frame.
+	const Waves& Level(UINT l) const;
+	XMFLOAT3 LevelOffset(UINT l) const;
+
+	// Cells [rowBegin, rowEnd) x [colBegin, colEnd) of level l that level
+	// l - 1 draws in more detail, so a renderer can leave them out.  Empty
+	// for level 0.
+	void CoveredCells(UINT l, UINT& rowBegin, UINT& rowEnd, UINT& colBegin, UINT& colEnd) const;
+
+	// Height at (x, z) in the domain's frame, bilinear in the finest level
+	// that covers it; 0 outside the domain.
+	float Height(float x, float z) const;
+
+	// Fixed-step clock in level 0 steps, with a catch-up cap, as
+	// Waves::Update().
+	UINT Update(float dt);
+	void SetMaxStepsPerUpdate(UINT maxSteps);
+	float DroppedTime() const;
+
+	// Runs numSteps level 0 steps; level l steps once every 2^l of them.
+	void UpdateSteps(UINT numSteps);
+
+	// Impulse at (x, z) in the domain's frame, applied to the finest level
+	// whose interior holds it; Radius is in world units as for
+	// Waves::WorldImpulse.
+	void Disturb(float x, float z, float magnitude, float radius = 0.f);
+
+	// Levels follow (x, z) in the domain's frame; they are moved at the
+	// start of a coarsest-level step.
+	void SetFocus(float x, float z);
+
+	// Every level splits its steps across its own pool of numThreads
+	// threads; levels step one after another.
+	void SetThreadCount(UINT numThreads);
+
+private:
+	// One level 0 step and whatever coarser steps, prolongations and
+	// restrictions fall due with it.
+	void Tick();
+
+	// Moves levels that have drifted too far from the focus.
+	void Recenter();
+	void MoveLevel(UINT l, int row, int col);
+
+	// Parent of level l sampled at the level l points [rowBegin, rowEnd) x
+	// [colBegin, colEnd), at fraction t of the parent's last step.
+	void Prolong(UINT l, float t, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+		float* dest, UINT pitch);
+	void ProlongHalo(UINT l, float t);
+	void Restrict(UINT l);
+
+	float Spacing(UINT l) const;
+
+	NestedWaves(const NestedWaves&);
+	NestedWaves& operator=(const NestedWaves&);
+
+private:
+	UINT mLevelCount;
+	UINT mNumRows;
+	UINT mNumCols;
+	float mSpatialStep;
+
+	FixedStepClock mClock;
+
+	// Level 0 steps into the current coarsest-level step.
+	UINT mTick;
+
+	Waves mLevels[MaxLevels];
+
+	// Point (0, 0) of level l is point (mLevelRow[l], mLevelCol[l]) of an
+	// infinite grid of its spacing whose point (0, 0) is that of the coarsest
+	// level.  Always even below the coarsest level, so level points land on
+	// parent points.
+	int mLevelRow[MaxLevels];
+	int mLevelCol[MaxLevels];
+
+	float mFocusX;
+	float mFocusZ;
+
+	// Corner of the coarsest level in the domain's frame.
+	float mOriginX;
+	float mOriginZ;
+
+	std::vector<float> mParentScratch;
+	std::vector<float> mLevelScratch;
+	std::vector<float> mMoveScratch;
+};
@@ -0,0 +1,306 @@
+#include "Ocean.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/ThreadPool.h"
+
+#include <cassert>
+#include <cmath>
+
+Ocean::Ocean()
+	: mTilesDown(0), mTilesAcross(0), mTileSize(0)
+	, mSpatialStep(0.f)
+	, mTiles(NULL)
+	, mSteppedTiles(0)
+	, mbActivityTracking(false)
+	, mFocusX(0.f), mFocusZ(0.f), mFocusRadius(0.f)
+	, mThreadPool(NULL)
+{
+}
+
+Ocean::~Ocean()
+{
+	Release();
+	delete mThreadPool;
+}
+
+void Ocean::Release()
+{
+	delete[] mTiles;
+	mTiles = NULL;
+}
+
+void Ocean::Init(UINT tilesDown, UINT tilesAcross, UINT tileSize,
+	float dx, float dt, float speed, float damping, Waves::StorageMode storage)
+{
+	Release();
+
+	mTilesDown = tilesDown;
+	mTilesAcross = tilesAcross;
+	mTileSize = tileSize;
+	mSpatialStep = dx;
+	mClock.Reset(dt);
+
+	const UINT numTiles = tilesDown * tilesAcross;
+	mTiles = new Waves[numTiles];
+	for (UINT t = 0; t < numTiles; ++t)
+	{
+		mTiles[t].Init(tileSize + 2, tileSize + 2, dx, dt, speed, damping, storage);
+		mTiles[t].SetActivityTracking(mbActivityTracking);
+	}
+
+	mEdgeScratch.resize(numTiles * tileSize);
+	mStepList.reserve(numTiles);
+	mSteppedTiles = 0;
+}
+
+UINT Ocean::TileRowCount() const
+{
+	return mTilesDown;
+}
+
+UINT Ocean::TileColumnCount() const
+{
+	return mTilesAcross;
+}
+
+UINT Ocean::TileSize() const
+{
+	return mTileSize;
+}
+
+UINT Ocean::RowCount() const
+{
+	return mTilesDown * mTileSize;
+}
+
+UINT Ocean::ColumnCount() const
+{
+	return mTilesAcross * mTileSize;
+}
+
+const Waves& Ocean::Tile(UINT ty, UINT tx) const
+{
+	assert(ty < mTilesDown && tx < mTilesAcross);
+	return mTiles[ty * mTilesAcross + tx];
+}
+
+XMFLOAT3 Ocean::TileOffset(UINT ty, UINT tx) const
+{
+	// Ocean cell (i, j) sits at x = -halfWidth + j * dx, z = halfDepth - i * dx
+	// and is cell (i - ty * T + 1, j - tx * T + 1) of its tile.
+	const float dx = mSpatialStep;
+	const float halfWidth = (ColumnCount() - 1) * dx * 0.5f;
+	const float halfDepth = (RowCount() - 1) * dx * 0.5f;
+	const float tileCenter = (mTileSize - 1) * dx * 0.5f;
+
+	return XMFLOAT3(
+		-halfWidth + tx * mTileSize * dx + tileCenter,
+		0.f,
+		halfDepth - ty * mTileSize * dx - tileCenter);
+}
+
+float Ocean::Height(UINT i, UINT j) const
+{
+	const UINT T = mTileSize;
+	const Waves& tile = Tile(i / T, j / T);
+	return tile[(i % T + 1) * (T + 2) + (j % T + 1)].y;
+}
+
+UINT Ocean::Update(float dt)
+{
+	const UINT numSteps = mClock.Advance(dt);
+	if (numSteps > 0)
+	{
+		UpdateSteps(numSteps);
+	}
+
+	return numSteps;
+}
+
+void Ocean::SetMaxStepsPerUpdate(UINT maxSteps)
+{
+	mClock.SetMaxStepsPerUpdate(maxSteps);
+}
+
+float Ocean::DroppedTime() const
+{
+	return mClock.DroppedTime();
+}
+
+void Ocean::UpdateSteps(UINT numSteps)
+{
+	// The halo is one cell deep, so tiles can only run one step between
+	// exchanges.
+	for (UINT s = 0; s < numSteps; ++s)
+	{
+		Step();
+	}
+}
+
+void Ocean::SetThreadCount(UINT numThreads)
+{
+	if (numThreads <= 1)
+	{
+		delete mThreadPool;
+		mThreadPool = NULL;
+		return;
+	}
+
+	if (mThreadPool == NULL)
+	{
+		mThreadPool = new ThreadPool();
+	}
+	if (mThreadPool->ThreadCount() != numThreads)
+	{
+		mThreadPool->Start(numThreads);
+	}
+}
+
+void Ocean::SetFocus(float x, float z, float radius)
+{
+	mFocusX = x;
+	mFocusZ = z;
+	mFocusRadius = radius;
+}
+
+void Ocean::SetActivityTracking(bool enabled)
+{
+	mbActivityTracking = enabled;
+	for (UINT t = 0; t < mTilesDown * mTilesAcross; ++t)
+	{
+		mTiles[t].SetActivityTracking(enabled);
+	}
+}
+
+UINT Ocean::SteppedTileCount() const
+{
+	return mSteppedTiles;
+}
+
+bool Ocean::InFocus(UINT ty, UINT tx) const
+{
+	if (mFocusRadius <= 0.f)
+	{
+		return true;
+	}
+
+	// Distance from the focus to the nearest point of the tile.
+	const XMFLOAT3 center = TileOffset(ty, tx);
+	const float halfSize = (mTileSize - 1) * mSpatialStep * 0.5f;
+	const float ex = MathHelper::Max(fabsf(mFocusX - center.x) - halfSize, 0.f);
+	const float ez = MathHelper::Max(fabsf(mFocusZ - center.z) - halfSize, 0.f);
+	return ex * ex + ez * ez <= mFocusRadius * mFocusRadius;
+}
+
+void Ocean::Step()
+{
+	mStepList.clear();
+	for (UINT ty = 0; ty < mTilesDown; ++ty)
+	{
+		for (UINT tx = 0; tx < mTilesAcross; ++tx)
+		{
+			if (InFocus(ty, tx))
+			{
+				mStepList.push_back(ty * mTilesAcross + tx);
+			}
+		}
+	}
+
+	// Exchanges only write a tile's own halo and only read its neighbours'
+	// interiors, and nothing steps until they are all done.
+	auto exchange = [this](UINT k) { ExchangeHalos(mStepList[k]); };
+	if (mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor((UINT)mStepList.size(), exchange);
+	}
+	else
+	{
+		for (UINT k = 0; k < mStepList.size(); ++k)
+		{
+			exchange(k);
+		}
+	}
+
+	// A tile whose interior is asleep is exactly zero, and the exchange woke
+	// it if anything is coming in, so skipping it changes nothing.
+	if (mbActivityTracking)
+	{
+		UINT kept = 0;
+		for (UINT k = 0; k < mStepList.size(); ++k)
+		{
+			if (mTiles[mStepList[k]].ActiveTileCount() > 0)
+			{
+				mStepList[kept++] = mStepList[k];
+			}
+		}
+		mStepList.resize(kept);
+	}
+
+	auto step = [this](UINT k) { mTiles[mStepList[k]].UpdateSteps(1); };
+	if (mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor((UINT)mStepList.size(), step);
+	}
+	else
+	{
+		for (UINT k = 0; k < mStepList.size(); ++k)
+		{
+			step(k);
+		}
+	}
+
+	mSteppedTiles = (UINT)mStepList.size();
+}
+
+void Ocean::ExchangeHalos(UINT t)
+{
+	const UINT ty = t / mTilesAcross;
+	const UINT tx = t - ty * mTilesAcross;
+	float* edge = &mEdgeScratch[t * mTileSize];
+	Waves& tile = mTiles[t];
+
+	// The outer edge of the ocean keeps its zero boundary.
+	if (ty > 0)
+	{
+		mTiles[t - mTilesAcross].ReadEdge(Waves::EDGE_BOTTOM, edge);
+		tile.WriteHalo(Waves::EDGE_TOP, edge);
+	}
+	if (ty + 1 < mTilesDown)
+	{
+		mTiles[t + mTilesAcross].ReadEdge(Waves::EDGE_TOP, edge);
+		tile.WriteHalo(Waves::EDGE_BOTTOM, edge);
+	}
+	if (tx > 0)
+	{
+		mTiles[t - 1].ReadEdge(Waves::EDGE_RIGHT, edge);
+		tile.WriteHalo(Waves::EDGE_LEFT, edge);
+	}
+	if (tx + 1 < mTilesAcross)
+	{
+		mTiles[t + 1].ReadEdge(Waves::EDGE_LEFT, edge);
+		tile.WriteHalo(Waves::EDGE_RIGHT, edge);
+	}
+}
+
+void Ocean::Disturb(UINT i, UINT j, float magnitude)
+{
+	// Don't disturb the ocean's boundary.
+	assert(i > 1 && i < RowCount() - 2);
+	assert(j > 1 && j < ColumnCount() - 2);
+
+	const UINT T = mTileSize;
+
+	// Hand the splat to every tile it touches in tile-local cells; each tile
+	// clips it to its own interior, so every cell is written exactly once.
+	for (UINT ty = (i - 1) / T; ty <= (i + 1) / T; ++ty)
+	{
+		for (UINT tx = (j - 1) / T; tx <= (j + 1) / T; ++tx)
+		{
+			Waves::Impulse impulse;
+			impulse.Row = i + 1 - ty * T;
+			impulse.Col = j + 1 - tx * T;
+			impulse.Magnitude = magnitude;
+			impulse.Radius = 0.f;
+			mTiles[ty * mTilesAcross + tx].DisturbBatch(&impulse, 1);
+		}
+	}
+}
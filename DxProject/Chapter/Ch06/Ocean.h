@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Waves.h"
+
+#include <vector>
+
+///<summary>
+/// A large water surface built from a grid of Waves tiles.
+///
+/// Each tile simulates TileSize x TileSize cells of the ocean inside a
+/// (TileSize + 2)^2 Waves grid whose boundary ring is a one-cell halo.
+/// Before every step the halos are refreshed from the neighbouring tiles'
+/// edge cells, so waves cross tile borders exactly as they would on one
+/// big grid; only the outer edge of the ocean keeps the zero boundary.
+/// Tiles are stepped in parallel, and tiles outside the focus radius or
+/// (with activity tracking) completely still are skipped.
+///</summary>
+class Ocean
+{
+public:
+	Ocean();
+	~Ocean();
+
+	void Init(UINT tilesDown, UINT tilesAcross, UINT tileSize,
+		float dx, float dt, float speed, float damping,
+		Waves::StorageMode storage = Waves::STORAGE_SOA);
+
+	UINT TileRowCount() const;
+	UINT TileColumnCount() const;
+	UINT TileSize() const;
+
+	// Cells across the whole ocean, excluding halos.
+	UINT RowCount() const;
+	UINT ColumnCount() const;
+
+	// Tile grids keep their own local coordinates; add TileOffset() to
+	// place them in the ocean's frame.  Their boundary ring duplicates the
+	// neighbours' edge cells.
+	const Waves& Tile(UINT ty, UINT tx) const;
+	XMFLOAT3 TileOffset(UINT ty, UINT tx) const;
+
+	// Height of ocean cell (i, j).
+	float Height(UINT i, UINT j) const;
+
+	// Fixed-step clock with a catch-up cap, as Waves::Update(); the tiles'
+	// own clocks are not used.
+	UINT Update(float dt);
+	void SetMaxStepsPerUpdate(UINT maxSteps);
+	float DroppedTime() const;
+
+	// Runs numSteps steps, exchanging halos before each one.
+	void UpdateSteps(UINT numSteps);
+
+	// Same 5-point splat as Waves::Disturb(), in ocean cells; it may
+	// straddle tile borders.
+	void Disturb(UINT i, UINT j, float magnitude);
+
+	// Tiles are stepped on a pool of numThreads threads; 0 or 1 is serial.
+	void SetThreadCount(UINT numThreads);
+
+	///<summary>
+	/// Only tiles within radius of (x, z) in the ocean's frame are stepped;
+	/// the rest hold still and act as a fixed boundary for their neighbours.
+	/// A radius of 0 or less steps every tile.
+	///</summary>
+	void SetFocus(float x, float z, float radius);
+
+	// Enables Waves activity tracking in every tile; a tile with nothing
+	// awake and nothing arriving through its halo is not stepped at all.
+	void SetActivityTracking(bool enabled);
+
+	// Tiles stepped by the most recent step.
+	UINT SteppedTileCount() const;
+
+private:
+	void Release();
+	void Step();
+	void ExchangeHalos(UINT t);
+	bool InFocus(UINT ty, UINT tx) const;
+
+	Ocean(const Ocean&);
+	Ocean& operator=(const Ocean&);
+
+private:
+	UINT mTilesDown;
+	UINT mTilesAcross;
+	UINT mTileSize;
+	float mSpatialStep;
+
+	FixedStepClock mClock;
+
+	// mTilesDown * mTilesAcross tiles in row-major order.
+	Waves* mTiles;
+
+	// One edge's worth of heights per tile for the exchange.
+	std::vector<float> mEdgeScratch;
+
+	// Tiles to step this step, and their count.
+	std::vector<UINT> mStepList;
+	UINT mSteppedTiles;
+
+	bool mbActivityTracking;
+	float mFocusX;
+	float mFocusZ;
+	float mFocusRadius;
+
+	ThreadPool* mThreadPool;
+};
@@ -222,28 +222,20 @@ void ShapesApp::OnMouseMove(WPARAM InBtnState, const int X, const int Y)
 
 void ShapesApp::BuildGeometryBuffers()
 {
-	GeometryGenerator::MeshData Box;
-	GeometryGenerator::MeshData Grid;
-	GeometryGenerator::MeshData Sphere;
-	GeometryGenerator::MeshData Cylinder;
-
-	GeometryGenerator::CreateBox(1.f, 1.f, 1.f, Box);
-	GeometryGenerator::CreateGrid(20.f, 30.f, 60, 40, Grid);
-	GeometryGenerator::CreateSphere(0.5f, 20, 20, Sphere);
-	//GeometryGenerator::CreateGeosphere(0.5f, 2, Sphere);
-	GeometryGenerator::CreateCylinder(0.5f, 0.3f, 3.f, 20, 20, Cylinder);
+	// Size every mesh up front so all of them are generated straight into one
+	// vertex array and one index array, with no per-mesh buffers to copy from.
+	UINT BoxVertexCount, GridVertexCount, SphereVertexCount, CylinderVertexCount;
+	GeometryGenerator::BoxCounts(BoxVertexCount, mBoxIndexCount);
+	GeometryGenerator::GridCounts(60, 40, GridVertexCount, mGridIndexCount);
+	GeometryGenerator::SphereCounts(20, 20, SphereVertexCount, mSphereIndexCount);
+	//GeometryGenerator::GeosphereCounts(2, SphereVertexCount, mSphereIndexCount);
+	GeometryGenerator::CylinderCounts(20, 20, CylinderVertexCount, mCylinderIndexCount);
 
 	// Cache the vertex offsets to each object in the concatenated vertex buffer.
 	mBoxVertexOffset = 0;
-	mGridVertexOffset = Box.Vertices.size();
-	mSphereVertexOffset = mGridVertexOffset + Grid.Vertices.size();
-	mCylinderVertexOffset = mSphereVertexOffset + Sphere.Vertices.size();
-
-	// Cache the index count of each object.
-	mBoxIndexCount = Box.Indices.size();
-	mGridIndexCount = Grid.Indices.size();
-	mSphereIndexCount = Sphere.Indices.size();
-	mCylinderIndexCount = Cylinder.Indices.size();
+	mGridVertexOffset = BoxVertexCount;
+	mSphereVertexOffset = mGridVertexOffset + GridVertexCount;
+	mCylinderVertexOffset = mSphereVertexOffset + SphereVertexCount;
 
 	// Cache the starting index for each object in the concatenated index buffer.
 	mBoxIndexOffset = 0;
@@ -251,52 +243,36 @@ void ShapesApp::BuildGeometryBuffers()
 	mSphereIndexOffset = mGridIndexOffset + mGridIndexCount;
 	mCylinderIndexOffset = mSphereIndexOffset + mSphereIndexCount;
 
-	const UINT TotalVertexCount = 
-		Box.Vertices.size() +
-		Grid.Vertices.size() +
-		Sphere.Vertices.size() + 
-		Cylinder.Vertices.size();
-
-	const UINT TotalIndexCount = 
-		mBoxIndexCount + mGridIndexCount + mSphereIndexCount + mCylinderIndexCount;
+	const UINT TotalVertexCount = mCylinderVertexOffset + CylinderVertexCount;
+	const UINT TotalIndexCount = mCylinderIndexOffset + mCylinderIndexCount;
 
 	/*
 		하나의 Vertex Buffer, Index Buffer에 각 도형의 정보를 합쳐서 저장.
 		렌더링 할 때는 버퍼 전체가 아닌 일부분만 사용해 렌더링.
 	*/
 
+	// Indices stay relative to each mesh; DrawIndexed adds the vertex offset.
+	std::vector<GeometryGenerator::Vertex> Meshes(TotalVertexCount);
+	std::vector<UINT> Indices(TotalIndexCount);
+
+	GeometryGenerator::FillBox(1.f, 1.f, 1.f, &Meshes[mBoxVertexOffset], &Indices[mBoxIndexOffset]);
+	GeometryGenerator::FillGrid(20.f, 30.f, 60, 40, &Meshes[mGridVertexOffset], &Indices[mGridIndexOffset]);
+	GeometryGenerator::FillSphere(0.5f, 20, 20, &Meshes[mSphereVertexOffset], &Indices[mSphereIndexOffset]);
+	//GeometryGenerator::FillGeosphere(0.5f, 2, &Meshes[mSphereVertexOffset], &Indices[mSphereIndexOffset]);
+	GeometryGenerator::FillCylinder(0.5f, 0.3f, 3.f, 20, 20, &Meshes[mCylinderVertexOffset], &Indices[mCylinderIndexOffset]);
+
 	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
+	// Extract the vertex elements we are interested in.
 	//
 
 	std::vector<Vertex> Vertices(TotalVertexCount);
 
 	XMFLOAT4 Black(0.f, 0.f, 0.f, 1.f);
 
-	UINT k = 0;
-	for (size_t i = 0; i < Box.Vertices.size(); ++i, ++k)
-	{
-		Vertices[k].Pos = Box.Vertices[i].Position;
-		Vertices[k].Color = Black;
-	}
-
-	for (size_t i = 0; i < Grid.Vertices.size(); ++i, ++k)
-	{
-		Vertices[k].Pos = Grid.Vertices[i].Position;
-		Vertices[k].Color = Black;
-	}
-
-	for (size_t i = 0; i < Sphere.Vertices.size(); ++i, ++k)
-	{
-		Vertices[k].Pos = Sphere.Vertices[i].Position;
-		Vertices[k].Color = Black;
-	}
-
-	for (size_t i = 0; i < Cylinder.Vertices.size(); ++i, ++k)
+	for (UINT i = 0; i < TotalVertexCount; ++i)
 	{
-		Vertices[k].Pos = Cylinder.Vertices[i].Position;
-		Vertices[k].Color = Black;
+		Vertices[i].Pos = Meshes[i].Position;
+		Vertices[i].Color = Black;
 	}
 
 	D3D11_BUFFER_DESC VBDesc;
@@ -309,16 +285,6 @@ void ShapesApp::BuildGeometryBuffers()
 	VInitData.pSysMem = &Vertices[0];
 	HR(mD3DDevice->CreateBuffer(&VBDesc, &VInitData, &mVB));
 
-	//
-	// Pack the indices of all the meshes into one index buffer.
-	//
-
-	std::vector<UINT> Indices;
-	Indices.insert(Indices.end(), Box.Indices.begin(), Box.Indices.end());
-	Indices.insert(Indices.end(), Grid.Indices.begin(), Grid.Indices.end());
-	Indices.insert(Indices.end(), Sphere.Indices.begin(), Sphere.Indices.end());
-	Indices.insert(Indices.end(), Cylinder.Indices.begin(), Cylinder.Indices.end());
-
 	D3D11_BUFFER_DESC IBDesc;
 	IBDesc.Usage = D3D11_USAGE_IMMUTABLE;
 	IBDesc.ByteWidth = sizeof(UINT) * TotalIndexCount;
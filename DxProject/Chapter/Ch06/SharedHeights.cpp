@@ -0,0 +1,331 @@
+#include "SharedHeights.h"
+
+#include <cassert>
+
+namespace
+{
+	const UINT SharedHeightsMagic = 0x48535657; // "WVSH"
+	const UINT SharedHeightsVersion = 1;
+
+	// Rows start on cache lines, as in the SoA solver.
+	const UINT FloatsPerLine = 64 / sizeof(float);
+
+	// Reader spins and yields before giving up on a consistent copy.
+	const UINT MaxReadSpins = 4096;
+
+	// The grid on the first cache line, written once before Magic; the
+	// sequence and the step it guards on the second, so readers polling it do
+	// not share a line with anything else the publisher writes.
+	struct SharedHeightsHeader
+	{
+		UINT Magic;
+		UINT Version;
+		UINT Rows;
+		UINT Cols;
+		UINT RowPitch;
+		float SpatialStep;
+		float TimeStep;
+		BYTE GridPad[64 - 7 * sizeof(UINT)];
+
+		// Odd while the publisher is writing; twice the publish count.
+		volatile LONG64 Sequence;
+		volatile UINT64 Step;
+		BYTE SequencePad[64 - 2 * sizeof(UINT64)];
+	};
+	static_assert(sizeof(SharedHeightsHeader) == 128, "shared heights header layout changed");
+
+	UINT RowPitchOf(UINT n)
+	{
+		return (n + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+	}
+
+	LONG64 LoadAcquire(const volatile LONG64* p)
+	{
+		const LONG64 v = *p;
+		MemoryBarrier();
+		return v;
+	}
+
+	void StoreRelease(volatile LONG64* p, LONG64 v)
+	{
+		MemoryBarrier();
+		*p = v;
+	}
+
+	// Spin briefly while the publisher finishes a write, then give the core
+	// away.
+	void Backoff(UINT spins)
+	{
+		if (spins < 1024)
+		{
+			YieldProcessor();
+		}
+		else
+		{
+			SwitchToThread();
+		}
+	}
+}
+
+//
+// SharedHeightsPublisher
+//
+
+SharedHeightsPublisher::SharedHeightsPublisher()
+	: mMapping(NULL)
+	, mView(NULL)
+	, mNumRows(0)
+	, mNumCols(0)
+{
+}
+
+SharedHeightsPublisher::~SharedHeightsPublisher()
+{
+	Release();
+}
+
+bool SharedHeightsPublisher::Init(const char* name, const Waves& waves)
+{
+	Release();
+
+	mNumRows = waves.RowCount();
+	mNumCols = waves.ColumnCount();
+	const UINT pitch = RowPitchOf(mNumCols);
+	const UINT64 totalBytes = sizeof(SharedHeightsHeader) + (UINT64)mNumRows * pitch * sizeof(float);
+
+	// A reader still holding the last run's mapping keeps it alive; reuse it
+	// if it is big enough, so that reader sees this run too.
+	mMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)(totalBytes >> 32), (DWORD)totalBytes, name);
+	if (mMapping == NULL)
+	{
+		return false;
+	}
+
+	mView = static_cast<BYTE*>(MapViewOfFile(mMapping, FILE_MAP_ALL_ACCESS, 0, 0, (SIZE_T)totalBytes));
+	if (mView == NULL)
+	{
+		Release();
+		return false;
+	}
+
+	// Readers of the reused mapping copy rows at the size they opened it
+	// with; refuse to change it under them.
+	SharedHeightsHeader* header = reinterpret_cast<SharedHeightsHeader*>(mView);
+	if (header->Magic == SharedHeightsMagic &&
+		(header->Version != SharedHeightsVersion || header->Rows != mNumRows ||
+		 header->Cols != mNumCols || header->RowPitch != pitch))
+	{
+		Release();
+		return false;
+	}
+
+	header->Magic = 0;
+	MemoryBarrier();
+
+	header->Version = SharedHeightsVersion;
+	header->Rows = mNumRows;
+	header->Cols = mNumCols;
+	header->RowPitch = pitch;
+	header->SpatialStep = waves.SpatialStep();
+	header->TimeStep = waves.TimeStep();
+
+	// A publisher that died mid-write left the sequence odd.
+	const LONG64 sequence = header->Sequence;
+	header->Sequence = sequence + (sequence & 1);
+
+	MemoryBarrier();
+	header->Magic = SharedHeightsMagic;
+
+	return true;
+}
+
+void SharedHeightsPublisher::Release()
+{
+	if (mView != NULL)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+	if (mMapping != NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+}
+
+void SharedHeightsPublisher::Publish(const Waves& waves, UINT64 step)
+{
+	assert(waves.RowCount() == mNumRows && waves.ColumnCount() == mNumCols);
+	if (mView == NULL)
+	{
+		return;
+	}
+
+	SharedHeightsHeader* header = reinterpret_cast<SharedHeightsHeader*>(mView);
+	float* heights = reinterpret_cast<float*>(mView + sizeof(SharedHeightsHeader));
+
+	// Only the publisher writes the sequence, so a plain read is current.
+	const LONG64 sequence = header->Sequence;
+	StoreRelease(&header->Sequence, sequence + 1);
+	MemoryBarrier();
+
+	header->Step = step;
+	waves.ReadHeights(heights, header->RowPitch);
+
+	StoreRelease(&header->Sequence, sequence + 2);
+}
+
+//
+// SharedHeightsReader
+//
+
+SharedHeightsReader::SharedHeightsReader()
+	: mMapping(NULL)
+	, mView(NULL)
+	, mNumRows(0)
+	, mNumCols(0)
+	, mRowPitch(0)
+	, mSpatialStep(0.f)
+	, mTimeStep(0.f)
+{
+}
+
+SharedHeightsReader::~SharedHeightsReader()
+{
+	Release();
+}
+
+bool SharedHeightsReader::Open(const char* name)
+{
+	Release();
+
+	mMapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+	if (mMapping == NULL)
+	{
+		return false;
+	}
+
+	mView = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+	if (mView == NULL)
+	{
+		Release();
+		return false;
+	}
+
+	// Everything else in the header is written before Magic.
+	const SharedHeightsHeader* header = reinterpret_cast<const SharedHeightsHeader*>(mView);
+	const bool valid = header->Magic == SharedHeightsMagic;
+	MemoryBarrier();
+	if (!valid || header->Version != SharedHeightsVersion)
+	{
+		Release();
+		return false;
+	}
+
+	// Read() copies with these, not the live header, so a publisher that
+	// later rewrites the header cannot make it overrun the caller's buffer.
+	mNumRows = header->Rows;
+	mNumCols = header->Cols;
+	mRowPitch = header->RowPitch;
+	mSpatialStep = header->SpatialStep;
+	mTimeStep = header->TimeStep;
+
+	return true;
+}
+
+void SharedHeightsReader::Release()
+{
+	if (mView != NULL)
+	{
+		UnmapViewOfFile(mView);
+		mView = NULL;
+	}
+	if (mMapping != NULL)
+	{
+		CloseHandle(mMapping);
+		mMapping = NULL;
+	}
+}
+
+UINT SharedHeightsReader::RowCount() const
+{
+	return mNumRows;
+}
+
+UINT SharedHeightsReader::ColumnCount() const
+{
+	return mNumCols;
+}
+
+UINT SharedHeightsReader::RowPitch() const
+{
+	return mRowPitch;
+}
+
+float SharedHeightsReader::SpatialStep() const
+{
+	return mSpatialStep;
+}
+
+float SharedHeightsReader::TimeStep() const
+{
+	return mTimeStep;
+}
+
+UINT64 SharedHeightsReader::PublishCount() const
+{
+	const SharedHeightsHeader* header = reinterpret_cast<const SharedHeightsHeader*>(mView);
+	return (UINT64)LoadAcquire(&header->Sequence) / 2;
+}
+
+bool SharedHeightsReader::Read(float* dest, UINT destPitch, UINT64* step) const
+{
+	const SharedHeightsHeader* header = reinterpret_cast<const SharedHeightsHeader*>(mView);
+	const float* heights = reinterpret_cast<const float*>(mView + sizeof(SharedHeightsHeader));
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	const UINT pitch = mRowPitch;
+
+	for (UINT spins = 0; spins < MaxReadSpins; ++spins)
+	{
+		const LONG64 begin = LoadAcquire(&header->Sequence);
+		if (begin == 0)
+		{
+			return false;
+		}
+		if ((begin & 1) != 0)
+		{
+			Backoff(spins);
+			continue;
+		}
+
+		// A publisher restarted on this mapping with another grid; Open()
+		// again to pick up the new size.
+		if (header->Magic != SharedHeightsMagic || header->Rows != m ||
+			header->Cols != n || header->RowPitch != pitch)
+		{
+			return false;
+		}
+
+		const UINT64 publishedStep = header->Step;
+		for (UINT i = 0; i < m; ++i)
+		{
+			CopyMemory(dest + i * destPitch, heights + i * pitch, n * sizeof(float));
+		}
+
+		// The copy is only good if no write started while we made it.
+		MemoryBarrier();
+		if (header->Sequence == begin)
+		{
+			if (step != NULL)
+			{
+				*step = publishedStep;
+			}
+			return true;
+		}
+		Backoff(spins);
+	}
+
+	return false;
+}
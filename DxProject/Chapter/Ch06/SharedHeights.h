@@ -0,0 +1,98 @@
+#pragma once
+
+#include "Waves.h"
+
+///<summary>
+/// Exports the live height field of a Waves grid to other processes on the
+/// same machine, e.g. tooling or analytics, through a named file mapping:
+///
+///   header  grid size and spacing, then a sequence counter and step number
+///   rows    RowCount() rows of heights, RowPitch() floats apart
+///
+/// The mapping is a seqlock.  The publisher makes the sequence odd, writes
+/// the heights straight into the mapping and makes it even again; it never
+/// waits for readers or takes a lock.  A reader copies the rows and keeps the
+/// copy only if the sequence was the same even value before and after, so a
+/// slow or crashed reader cannot stall the simulation.
+///
+/// Tools link SharedHeightsReader alone:
+///
+///   SharedHeightsReader reader;
+///   if (reader.Open("Local\\WavesHeights"))
+///   {
+///       std::vector<float> h(reader.RowCount() * reader.ColumnCount());
+///       UINT64 step;
+///       if (reader.Read(&h[0], reader.ColumnCount(), &step)) { ... }
+///   }
+///</summary>
+class SharedHeightsPublisher
+{
+public:
+	SharedHeightsPublisher();
+	~SharedHeightsPublisher();
+
+	// Creates (or reuses) the mapping called name, sized for waves' grid.
+	// Returns false if it cannot be created, or an existing one is too small
+	// or still describes a different grid.
+	bool Init(const char* name, const Waves& waves);
+	void Release();
+
+	// Writes the current heights of waves, the grid Init() was given, and
+	// the step they belong to.  Call from the simulation thread between steps.
+	void Publish(const Waves& waves, UINT64 step);
+
+private:
+	SharedHeightsPublisher(const SharedHeightsPublisher&);
+	SharedHeightsPublisher& operator=(const SharedHeightsPublisher&);
+
+private:
+	HANDLE mMapping;
+	BYTE* mView;
+	UINT mNumRows;
+	UINT mNumCols;
+};
+
+class SharedHeightsReader
+{
+public:
+	SharedHeightsReader();
+	~SharedHeightsReader();
+
+	// Maps an existing export read-only and notes its grid, which the
+	// accessors below return from then on.  Returns false if there is none
+	// under this name or it is not a height export of this version.
+	bool Open(const char* name);
+	void Release();
+
+	UINT RowCount() const;
+	UINT ColumnCount() const;
+	UINT RowPitch() const;
+	float SpatialStep() const;
+	float TimeStep() const;
+
+	// Number of Publish() calls so far, without copying anything; poll it
+	// to see whether a Read() would return new heights.
+	UINT64 PublishCount() const;
+
+	///<summary>
+	/// Copies the newest complete heights as rows of destPitch floats and,
+	/// if step is not NULL, the step they belong to.  Retries while the
+	/// publisher is mid-write.  Returns false if nothing has been published
+	/// yet, the export no longer has the grid Open() saw, or no consistent
+	/// copy could be taken within a bounded wait.
+	///</summary>
+	bool Read(float* dest, UINT destPitch, UINT64* step = NULL) const;
+
+private:
+	SharedHeightsReader(const SharedHeightsReader&);
+	SharedHeightsReader& operator=(const SharedHeightsReader&);
+
+private:
+	HANDLE mMapping;
+	const BYTE* mView;
+	UINT mNumRows;
+	UINT mNumCols;
+	UINT mRowPitch;
+	float mSpatialStep;
+	float mTimeStep;
+};
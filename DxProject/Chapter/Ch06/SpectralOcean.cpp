@@ -0,0 +1,387 @@
+#include "SpectralOcean.h"
+#include "WavesKernels.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/ThreadPool.h"
+
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+	const float Gravity = 9.81f;
+
+	// Rows per task and tasks per thread, as for the Waves row bands.
+	const UINT MinRowsPerBand = 8;
+	const UINT BandsPerThread = 4;
+
+	// Columns transformed side by side by one task of the column pass.
+	const UINT ColumnBlock = 16;
+
+	// Pitches are whole 64-byte lines.
+	const UINT FloatsPerLine = 16;
+	const UINT LineBytes = FloatsPerLine * sizeof(float);
+
+	UINT RoundToLine(UINT count)
+	{
+		return (count + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+	}
+
+	float* AllocFloats(UINT count)
+	{
+		float* p = static_cast<float*>(_aligned_malloc(count * sizeof(float), LineBytes));
+		ZeroMemory(p, count * sizeof(float));
+		return p;
+	}
+
+	// Integer hash (the murmur3 finaliser): every bin draws its random
+	// numbers from its own coordinates, so h0(-k) is found without walking
+	// a generator over the whole grid.
+	UINT Hash(UINT x)
+	{
+		x ^= x >> 16;
+		x *= 0x85ebca6bu;
+		x ^= x >> 13;
+		x *= 0xc2b2ae35u;
+		x ^= x >> 16;
+		return x;
+	}
+
+	// A pair of independent unit Gaussians for bin (row, col) (Box-Muller).
+	void GaussianPair(UINT seed, UINT row, UINT col, float& g0, float& g1)
+	{
+		const UINT a = Hash(seed ^ Hash(row * 0x9e3779b9u ^ Hash(col)));
+		const UINT b = Hash(a ^ 0x68bc21ebu);
+
+		// u0 in (0, 1] so the log is finite.
+		const double u0 = ((a >> 8) + 1.0) / 16777216.0;
+		const double u1 = (b >> 8) / 16777216.0;
+		const double r = sqrt(-2.0 * log(u0));
+		const double angle = 2.0 * 3.14159265358979323846 * u1;
+		g0 = (float)(r * cos(angle));
+		g1 = (float)(r * sin(angle));
+	}
+
+	// Signed wave number of FFT index idx.
+	int WaveIndex(UINT idx, UINT n)
+	{
+		return idx < n / 2 ? (int)idx : (int)idx - (int)n;
+	}
+}
+
+SpectralOcean::SpectralOcean()
+	: mSize(0)
+	, mPatchSize(0.f)
+	, mRepeatTime(0.f)
+	, mTime(0.0)
+	, mSpectrumPitch(0)
+	, mH0Re(NULL), mH0Im(NULL)
+	, mMirrorRe(NULL), mMirrorIm(NULL)
+	, mOmega(NULL)
+	, mSpectrumRe(NULL), mSpectrumIm(NULL)
+	, mHeightPitch(0)
+	, mHeights(NULL)
+	, mScratchFloats(0)
+	, mThreadPool(NULL)
+{
+}
+
+SpectralOcean::~SpectralOcean()
+{
+	Release();
+	delete mThreadPool;
+}
+
+void SpectralOcean::Release()
+{
+	_aligned_free(mH0Re);
+	_aligned_free(mH0Im);
+	_aligned_free(mMirrorRe);
+	_aligned_free(mMirrorIm);
+	_aligned_free(mOmega);
+	_aligned_free(mSpectrumRe);
+	_aligned_free(mSpectrumIm);
+	_aligned_free(mHeights);
+
+	mH0Re = mH0Im = NULL;
+	mMirrorRe = mMirrorIm = NULL;
+	mOmega = NULL;
+	mSpectrumRe = mSpectrumIm = NULL;
+	mHeights = NULL;
+}
+
+void SpectralOcean::Init(UINT n, float patchSize, XMFLOAT2 wind, float amplitude,
+	float repeatTime, UINT seed)
+{
+	assert(n >= 4 && (n & (n - 1)) == 0);
+	assert(patchSize > 0.f && repeatTime > 0.f);
+
+	Release();
+
+	mSize = n;
+	mPatchSize = patchSize;
+	mRepeatTime = repeatTime;
+	mTime = 0.0;
+
+	mFft.Init(n);
+
+	const UINT half = n / 2;
+	mSpectrumPitch = RoundToLine(half + 1);
+	mHeightPitch = RoundToLine(n);
+
+	const UINT spectrumFloats = n * mSpectrumPitch;
+	mH0Re = AllocFloats(spectrumFloats);
+	mH0Im = AllocFloats(spectrumFloats);
+	mMirrorRe = AllocFloats(spectrumFloats);
+	mMirrorIm = AllocFloats(spectrumFloats);
+	mOmega = AllocFloats(spectrumFloats);
+	mSpectrumRe = AllocFloats(spectrumFloats);
+	mSpectrumIm = AllocFloats(spectrumFloats);
+	mHeights = AllocFloats(n * mHeightPitch);
+
+	// Phase, sin and cos of one spectrum row, then the real transform.
+	mScratchFloats = 3 * mSpectrumPitch + RoundToLine(n);
+
+	// Grid positions; the last row and column sit one patch from the first.
+	const float dx = patchSize / n;
+	mColumnX.resize(n + 1);
+	mRowZ.resize(n + 1);
+	for (UINT k = 0; k <= n; ++k)
+	{
+		mColumnX[k] = -0.5f * patchSize + k * dx;
+		mRowZ[k] = 0.5f * patchSize - k * dx;
+	}
+
+	// Phillips spectrum
+	//   P(k) = A exp(-1 / (kL)^2) / k^4 (k^ . w^)^2 exp(-(kl)^2)
+	// with L = V^2 / g the largest wave the wind raises and l = L / 1000
+	// damping ripples too short for the grid.
+	const float windSpeed = sqrtf(wind.x * wind.x + wind.y * wind.y);
+	const float windX = windSpeed > 0.f ? wind.x / windSpeed : 1.f;
+	const float windZ = windSpeed > 0.f ? wind.y / windSpeed : 0.f;
+	const float largest = windSpeed * windSpeed / Gravity;
+	const float smallest = largest / 1000.f;
+	const float dk = 2.f * MathHelper::Pi / patchSize;
+	const float baseOmega = 2.f * MathHelper::Pi / repeatTime;
+
+	// h0 of FFT bin (row, col), rows along kz and columns along kx.  Rows
+	// run towards -z, so kz is negated.
+	auto h0 = [=](UINT row, UINT col, float& re, float& im)
+	{
+		const float kx = dk * WaveIndex(col, n);
+		const float kz = -dk * WaveIndex(row, n);
+		const float k2 = kx * kx + kz * kz;
+
+		float g0, g1;
+		GaussianPair(seed, row, col, g0, g1);
+
+		float phillips = 0.f;
+		if (k2 > 0.f && largest > 0.f)
+		{
+			const float cosine = (kx * windX + kz * windZ) / sqrtf(k2);
+			phillips = amplitude * expf(-1.f / (k2 * largest * largest)) / (k2 * k2) *
+				cosine * cosine * expf(-k2 * smallest * smallest);
+		}
+
+		const float scale = sqrtf(0.5f * phillips);
+		re = g0 * scale;
+		im = g1 * scale;
+	};
+
+	for (UINT row = 0; row < n; ++row)
+	{
+		const UINT mirrorRow = (n - row) & (n - 1);
+		for (UINT col = 0; col <= half; ++col)
+		{
+			const UINT mirrorCol = (n - col) & (n - 1);
+			const UINT idx = row * mSpectrumPitch + col;
+
+			h0(row, col, mH0Re[idx], mH0Im[idx]);
+
+			float re, im;
+			h0(mirrorRow, mirrorCol, re, im);
+			mMirrorRe[idx] = re;
+			mMirrorIm[idx] = -im;
+
+			// Deep-water dispersion, rounded down to a multiple of the base
+			// frequency so every wave repeats after repeatTime.
+			const float kx = dk * WaveIndex(col, n);
+			const float kz = dk * WaveIndex(row, n);
+			const float omega = sqrtf(Gravity * sqrtf(kx * kx + kz * kz));
+			mOmega[idx] = floorf(omega / baseOmega) * baseOmega;
+		}
+	}
+
+	Synthesize();
+}
+
+UINT SpectralOcean::RowCount() const
+{
+	return mSize + 1;
+}
+
+UINT SpectralOcean::ColumnCount() const
+{
+	return mSize + 1;
+}
+
+UINT SpectralOcean::VertexCount() const
+{
+	return (mSize + 1) * (mSize + 1);
+}
+
+UINT SpectralOcean::TriangleCount() const
+{
+	return mSize * mSize * 2;
+}
+
+float SpectralOcean::PatchSize() const
+{
+	return mPatchSize;
+}
+
+void SpectralOcean::Update(float dt)
+{
+	SetTime((float)(mTime + dt));
+}
+
+void SpectralOcean::SetTime(float t)
+{
+	// Every frequency is a whole multiple of 2 pi / mRepeatTime, so wrapping
+	// the clock changes nothing but keeps the phases small.
+	mTime = fmod((double)t, (double)mRepeatTime);
+	if (mTime < 0.0)
+	{
+		mTime += mRepeatTime;
+	}
+
+	Synthesize();
+}
+
+float SpectralOcean::Time() const
+{
+	return (float)mTime;
+}
+
+void SpectralOcean::SetThreadCount(UINT numThreads)
+{
+	if (numThreads <= 1)
+	{
+		delete mThreadPool;
+		mThreadPool = NULL;
+		return;
+	}
+
+	if (mThreadPool == NULL)
+	{
+		mThreadPool = new ThreadPool();
+	}
+	if (mThreadPool->ThreadCount() != numThreads)
+	{
+		mThreadPool->Start(numThreads);
+	}
+}
+
+void SpectralOcean::Synthesize()
+{
+	if (mSize == 0)
+	{
+		return;
+	}
+
+	const UINT n = mSize;
+	const UINT threads = mThreadPool != NULL ? mThreadPool->ThreadCount() : 1;
+	UINT numBands = MathHelper::Min(threads * BandsPerThread, MathHelper::Max(n / MinRowsPerBand, 1u));
+	if (mThreadPool == NULL)
+	{
+		numBands = 1;
+	}
+
+	if (mScratch.size() < numBands * mScratchFloats)
+	{
+		mScratch.resize(numBands * mScratchFloats);
+	}
+
+	// Three passes: the spectrum at time t row by row, the kz transform down
+	// blocks of adjacent columns, then the real kx transform of every row.
+	// Each pass only touches its own rows or columns, and each line is
+	// computed the same way whichever task runs it.
+	auto spectrum = [this, n, numBands](UINT b)
+	{
+		SpectrumRows(n * b / numBands, n * (b + 1) / numBands, &mScratch[b * mScratchFloats]);
+	};
+
+	const UINT columns = n / 2 + 1;
+	const UINT numBlocks = (columns + ColumnBlock - 1) / ColumnBlock;
+	auto transform = [this, columns](UINT b)
+	{
+		const UINT col = b * ColumnBlock;
+		mFft.TransformColumns(mSpectrumRe + col, mSpectrumIm + col, mSpectrumPitch,
+			MathHelper::Min(ColumnBlock, columns - col), 1);
+	};
+
+	auto heights = [this, n, numBands](UINT b)
+	{
+		HeightRows(n * b / numBands, n * (b + 1) / numBands, &mScratch[b * mScratchFloats]);
+	};
+
+	if (numBands == 1)
+	{
+		spectrum(0);
+		for (UINT b = 0; b < numBlocks; ++b)
+		{
+			transform(b);
+		}
+		heights(0);
+	}
+	else
+	{
+		mThreadPool->ParallelFor(numBands, spectrum);
+		mThreadPool->ParallelFor(numBlocks, transform);
+		mThreadPool->ParallelFor(numBands, heights);
+	}
+}
+
+void SpectralOcean::SpectrumRows(UINT rowBegin, UINT rowEnd, float* scratch)
+{
+	const UINT columns = mSize / 2 + 1;
+	const float t = (float)mTime;
+
+	float* phase = scratch;
+	float* s = scratch + mSpectrumPitch;
+	float* c = scratch + 2 * mSpectrumPitch;
+
+	for (UINT row = rowBegin; row < rowEnd; ++row)
+	{
+		const UINT base = row * mSpectrumPitch;
+		const float* omega = mOmega + base;
+		for (UINT col = 0; col < columns; ++col)
+		{
+			phase[col] = omega[col] * t;
+		}
+
+		WavesKernels::SinCosRow(phase, s, c, columns);
+
+		// H(k, t) = h0(k) e^(i w t) + conj(h0(-k)) e^(-i w t), which keeps
+		// H(-k, t) = conj H(k, t) and so a real field.
+		const float* h0r = mH0Re + base;
+		const float* h0i = mH0Im + base;
+		const float* mr = mMirrorRe + base;
+		const float* mi = mMirrorIm + base;
+		float* hr = mSpectrumRe + base;
+		float* hi = mSpectrumIm + base;
+		for (UINT col = 0; col < columns; ++col)
+		{
+			hr[col] = (h0r[col] * c[col] - h0i[col] * s[col]) + (mr[col] * c[col] + mi[col] * s[col]);
+			hi[col] = (h0r[col] * s[col] + h0i[col] * c[col]) + (mi[col] * c[col] - mr[col] * s[col]);
+		}
+	}
+}
+
+void SpectralOcean::HeightRows(UINT rowBegin, UINT rowEnd, float* scratch)
+{
+	for (UINT row = rowBegin; row < rowEnd; ++row)
+	{
+		mFft.InverseReal(mSpectrumRe + row * mSpectrumPitch, mSpectrumIm + row * mSpectrumPitch,
+			mHeights + row * mHeightPitch, scratch);
+	}
+}
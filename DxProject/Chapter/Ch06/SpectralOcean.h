@@ -0,0 +1,119 @@
+#pragma once
+
+#include "Fft.h"
+
+#include <Windows.h>
+#include <xnamath.h>
+#include <vector>
+
+class ThreadPool;
+
+///<summary>
+/// Statistical deep-water surface (Tessendorf): a Phillips spectrum of
+/// random wave amplitudes, each advanced analytically with the deep-water
+/// dispersion relation and summed by an inverse FFT every frame.  There is
+/// no time step to keep stable and the cost is O(N^2 log N) whatever the
+/// time, so it suits large open water; Waves stays the tool for local,
+/// interactive splashes.
+///
+/// The N x N field is periodic.  RowCount() and ColumnCount() are N + 1 so
+/// the last row and column repeat the first, and copies of the patch placed
+/// PatchSize() apart join without a seam.  The grid uses the same layout
+/// and accessors as Waves.
+///</summary>
+class SpectralOcean
+{
+public:
+	SpectralOcean();
+	~SpectralOcean();
+
+	///<summary>
+	/// n is a power of two; the patch is patchSize world units across.  wind
+	/// is the wind velocity in the xz-plane and amplitude scales the Phillips
+	/// spectrum.  Wave frequencies are rounded to multiples of 2 pi /
+	/// repeatTime so the animation loops exactly and time can wrap without
+	/// losing precision.  seed picks the random phases.
+	///</summary>
+	void Init(UINT n, float patchSize, XMFLOAT2 wind, float amplitude,
+		float repeatTime = 200.f, UINT seed = 1);
+
+	UINT RowCount() const;
+	UINT ColumnCount() const;
+	UINT VertexCount() const;
+	UINT TriangleCount() const;
+	float PatchSize() const;
+
+	// Returns the surface at the ith grid point.
+	XMFLOAT3 operator[](int i) const
+	{
+		const UINT cols = mSize + 1;
+		const UINT row = i / cols;
+		const UINT col = i - row * cols;
+		const UINT mask = mSize - 1;
+		return XMFLOAT3(mColumnX[col], mHeights[(row & mask) * mHeightPitch + (col & mask)], mRowZ[row]);
+	}
+
+	// Advances the clock by dt and rebuilds the field for the new time.
+	void Update(float dt);
+
+	// Rebuilds the field for time t.
+	void SetTime(float t);
+	float Time() const;
+
+	// Spectrum rows and transform lines are split across a persistent pool
+	// of numThreads threads (the caller included); 0 or 1 runs serially.
+	// The result is bit-identical for any thread count.
+	void SetThreadCount(UINT numThreads);
+
+private:
+	void Release();
+	void Synthesize();
+
+	// Builds spectrum rows [rowBegin, rowEnd) for the current time.
+	void SpectrumRows(UINT rowBegin, UINT rowEnd, float* scratch);
+
+	// Real transforms of height rows [rowBegin, rowEnd).
+	void HeightRows(UINT rowBegin, UINT rowEnd, float* scratch);
+
+	SpectralOcean(const SpectralOcean&);
+	SpectralOcean& operator=(const SpectralOcean&);
+
+private:
+	UINT mSize;
+	float mPatchSize;
+	float mRepeatTime;
+
+	// Kept in double and wrapped to [0, mRepeatTime).
+	double mTime;
+
+	Fft mFft;
+
+	// Half spectrum: N rows (kz) of N / 2 + 1 bins (kx), mSpectrumPitch
+	// floats apart.  h0(k) and conj(h0(-k)) at t = 0, and the frequency.
+	UINT mSpectrumPitch;
+	float* mH0Re;
+	float* mH0Im;
+	float* mMirrorRe;
+	float* mMirrorIm;
+	float* mOmega;
+
+	// The spectrum at the current time, transformed in place along kz.
+	float* mSpectrumRe;
+	float* mSpectrumIm;
+
+	// N rows of N heights, mHeightPitch floats apart.
+	UINT mHeightPitch;
+	float* mHeights;
+
+	// x of each column and z of each row of the (N + 1)^2 grid.
+	std::vector<float> mColumnX;
+	std::vector<float> mRowZ;
+
+	// Per-band scratch for the phase, sin and cos of a spectrum row and the
+	// real transform.
+	std::vector<float> mScratch;
+	UINT mScratchFloats;
+
+	// NULL when running serially.
+	ThreadPool* mThreadPool;
+};
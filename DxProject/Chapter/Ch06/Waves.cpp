@@ -1,21 +1,295 @@
 #include "Waves.h"
+#include "WavesKernels.h"
+#include "../../Common/MathHelper.h"
+#include "../../Common/ThreadPool.h"
 
 #include <algorithm>
+#include <string>
 #include <vector>
 #include <cassert>
+#include <cmath>
+#include <malloc.h>
+
+namespace
+{
+	// Rows are padded to a whole number of cache lines.
+	const UINT HeightAlignment = 64;
+	const UINT FloatsPerLine = HeightAlignment / sizeof(float);
+
+	// Bands smaller than this cost more to hand out than to compute.
+	const UINT MinRowsPerBand = 8;
+
+	// A few bands per thread so a descheduled worker does not stall the step.
+	const UINT BandsPerThread = 4;
+
+	// Both scratch arrays of a temporal blocking tile should fit in this.
+	const UINT PassTileBytes = 512 * 1024;
+	const UINT PassTileCols = 512;
+
+	// 16-bit rows: three current rows around the one being stepped plus its
+	// previous row, widened to fp32.
+	const UINT PackedWindowRows = 4;
+	const UINT PackedPerLine = HeightAlignment / sizeof(USHORT);
+
+	// Columns per task of the implicit column sweep: a few cache lines of
+	// every row, solved side by side down the grid.
+	const UINT ImplicitBlockCols = 64;
+
+	// Rows built and solved together by the implicit row sweep: two
+	// interleaved groups of four SIMD lanes.
+	const UINT ImplicitGroupRows = 8;
+
+	// SampleHeights() batches below this many points run on the calling
+	// thread; larger ones go to the caller's pool in runs of SampleBandPoints.
+	const UINT MinParallelSamples = 4096;
+	const UINT SampleBandPoints = 1024;
+
+	// Points per kernel call; gradients nobody asked for land on the stack.
+	const UINT SampleChunkPoints = 256;
+
+	// Natural log of how much the sponge attenuates a wave that crosses the
+	// rim and comes back out (ln 1000: a thousandth of the amplitude).
+	const float SpongeAttenuation = 6.9f;
+
+	float* AllocHeights(UINT count)
+	{
+		float* p = static_cast<float*>(_aligned_malloc(count * sizeof(float), HeightAlignment));
+		ZeroMemory(p, count * sizeof(float));
+		return p;
+	}
+
+	USHORT* AllocPacked(UINT count)
+	{
+		USHORT* p = static_cast<USHORT*>(_aligned_malloc(count * sizeof(USHORT), HeightAlignment));
+		ZeroMemory(p, count * sizeof(USHORT));
+		return p;
+	}
+
+	WavesKernels::PackFormat PackFormatOf(Waves::StorageMode storage)
+	{
+		return storage == Waves::STORAGE_FP16 ? WavesKernels::PACK_FP16 : WavesKernels::PACK_FIXED16;
+	}
+
+	// Checkpoint file: the header, padded to CheckpointHeaderBytes so the
+	// time levels are 64-byte aligned in the mapping, then the previous and
+	// the current level, LevelBytes each, then the land mask if there is one.
+	const DWORD CheckpointMagic = 0x4B435657; // "WVCK"
+	const UINT CheckpointVersion = 1;
+	const UINT CheckpointHeaderBytes = 128;
+
+	struct CheckpointHeader
+	{
+		DWORD Magic;
+		UINT Version;
+		UINT Rows;
+		UINT Cols;
+		UINT RowPitch;
+		UINT ElementBytes;
+		UINT LevelBytes;
+		UINT Storage;
+		UINT Integrator;
+		UINT Boundary;
+		UINT SpongeWidth;
+		UINT HasLandMask;
+		float SpatialStep;
+		float TimeStep;
+		float Speed;
+		float Damping;
+		float HeightScale;
+		float TimeAccumulator;
+		float DroppedTime;
+	};
+	static_assert(sizeof(CheckpointHeader) <= CheckpointHeaderBytes, "checkpoint header outgrew its padding");
+
+	// A whole file mapped into memory until the object goes away.
+	class MappedFile
+	{
+	public:
+		MappedFile()
+			: mFile(INVALID_HANDLE_VALUE), mMapping(NULL), mView(NULL), mBytes(0)
+		{
+		}
+
+		~MappedFile()
+		{
+			if (mView != NULL)
+			{
+				UnmapViewOfFile(mView);
+			}
+			if (mMapping != NULL)
+			{
+				CloseHandle(mMapping);
+			}
+			if (mFile != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(mFile);
+			}
+		}
+
+		bool OpenRead(const char* path)
+		{
+			mFile = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+				FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			LARGE_INTEGER size;
+			if (mFile == INVALID_HANDLE_VALUE || !GetFileSizeEx(mFile, &size) || size.QuadPart == 0)
+			{
+				return false;
+			}
+			mBytes = (UINT64)size.QuadPart;
+
+			mMapping = CreateFileMappingA(mFile, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mMapping == NULL)
+			{
+				return false;
+			}
+			mView = static_cast<BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+			return mView != NULL;
+		}
+
+		// Creates or truncates path and maps bytes bytes of it for writing.
+		bool Create(const char* path, UINT64 bytes)
+		{
+			mFile = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+				FILE_ATTRIBUTE_NORMAL, NULL);
+			if (mFile == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			mBytes = bytes;
+
+			mMapping = CreateFileMappingA(mFile, NULL, PAGE_READWRITE, (DWORD)(bytes >> 32), (DWORD)bytes, NULL);
+			if (mMapping == NULL)
+			{
+				return false;
+			}
+			mView = static_cast<BYTE*>(MapViewOfFile(mMapping, FILE_MAP_WRITE, 0, 0, 0));
+			return mView != NULL;
+		}
+
+		// Pushes the mapped bytes and the file's metadata to disk.
+		bool Flush()
+		{
+			return FlushViewOfFile(mView, 0) && FlushFileBuffers(mFile);
+		}
+
+		BYTE* View() const
+		{
+			return mView;
+		}
+
+		UINT64 Bytes() const
+		{
+			return mBytes;
+		}
+
+	private:
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+
+	private:
+		HANDLE mFile;
+		HANDLE mMapping;
+		BYTE* mView;
+		UINT64 mBytes;
+	};
+}
 
 Waves::Waves()
 	: mNumRows(0), mNumCols(0)
 	, mVertexCount(0), mTriangleCount(0)
 	, mK1(0.f), mK2(0.f), mK3(0.f)
+	, mTimeStep(0.f), mSpatialStep(0.f)
+	, mSpeed(0.f), mDamping(0.f)
+	, mStorage(STORAGE_AOS)
+	, mIntegrator(INTEGRATOR_EXPLICIT)
+	, mBoundary(BOUNDARY_FIXED)
+	, mSpongeWidth(0)
+	, mImplicitR(0.f)
+	, mImplicitHeights(NULL)
 	, mPrevSolution(NULL), mCurrSolution(NULL)
+	, mPrevHeights(NULL), mCurrHeights(NULL)
+	, mHeightStride(0), mRowPitch(0)
+	, mPrevPacked(NULL), mCurrPacked(NULL)
+	, mHeightScale(1.f)
+	, mPackScratch(NULL), mPackScratchPitch(0), mPackScratchBands(0)
+	, mColumnX(NULL), mRowZ(NULL)
+	, mThreadPool(NULL)
+	, mStepsPerPass(1)
+	, mPassPrevHeights(NULL), mPassCurrHeights(NULL)
+	, mPassScratch(NULL), mPassScratchFloats(0)
+	, mbActivityTracking(false)
+	, mSleepThreshold(1e-4f)
+	, mTilesDown(0), mTilesAcross(0)
+	, mBatchMaxReach(0)
+	, mbNormalsEnabled(false)
+	, mNormalPitch(0)
+	, mbPyramidEnabled(false)
+	, mbPyramidInStep(false)
+	, mPyramidScratch(NULL), mPyramidScratchBands(0)
 {
+	ZeroMemory(mImplicitQ, sizeof(mImplicitQ));
+	ZeroMemory(mNormals, sizeof(mNormals));
+	ZeroMemory(mTangents, sizeof(mTangents));
+	ZeroMemory(mPyramid, sizeof(mPyramid));
 }
 
 Waves::~Waves()
 {
+	Release();
+	delete mThreadPool;
+}
+
+void Waves::Release()
+{
+	if (mStorage == STORAGE_SOA)
+	{
+		_aligned_free(mPrevHeights);
+		_aligned_free(mCurrHeights);
+	}
+	mPrevHeights = NULL;
+	mCurrHeights = NULL;
+
+	_aligned_free(mImplicitHeights);
+	mImplicitHeights = NULL;
+
+	_aligned_free(mPrevPacked);
+	_aligned_free(mCurrPacked);
+	_aligned_free(mPackScratch);
+	mPrevPacked = NULL;
+	mCurrPacked = NULL;
+	mPackScratch = NULL;
+	mPackScratchBands = 0;
+
+	_aligned_free(mPassPrevHeights);
+	_aligned_free(mPassCurrHeights);
+	_aligned_free(mPassScratch);
+	mPassPrevHeights = NULL;
+	mPassCurrHeights = NULL;
+	mPassScratch = NULL;
+	mPassScratchFloats = 0;
+
+	for (UINT a = 0; a < 3; ++a)
+	{
+		_aligned_free(mNormals[a]);
+		mNormals[a] = NULL;
+	}
+	for (UINT a = 0; a < 2; ++a)
+	{
+		_aligned_free(mTangents[a]);
+		mTangents[a] = NULL;
+	}
+
+	FreePyramid();
+
 	delete[] mPrevSolution;
 	delete[] mCurrSolution;
+	mPrevSolution = NULL;
+	mCurrSolution = NULL;
+
+	delete[] mColumnX;
+	delete[] mRowZ;
+	mColumnX = NULL;
+	mRowZ = NULL;
 }
 
 UINT Waves::RowCount() const
@@ -38,102 +312,2420 @@ UINT Waves::TriangleCount() const
 	return mTriangleCount;
 }
 
-void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping)
+Waves::StorageMode Waves::Storage() const
 {
-	mNumRows = m;
-	mNumCols = n;
+	return mStorage;
+}
 
-	mVertexCount = m * n;
-	mTriangleCount = (m - 1) * (n - 1) * 2;
+Waves::Integrator Waves::TimeIntegrator() const
+{
+	return mIntegrator;
+}
 
-	mTimeStep = dt;
-	mSpatialStep = dx;
+Waves::Boundary Waves::BoundaryMode() const
+{
+	return mBoundary;
+}
 
-	const float d = damping * dt + 2.f;
-	const float e = (speed * speed) * (dt * dt) / (dx * dx);
-	mK1 = (damping * dt - 2.f) / d;
-	mK2 = (4.f - 8.f * e) / d;
-	mK3 = (2.f * e) / d;
+float Waves::TimeStep() const
+{
+	return mTimeStep;
+}
 
-	// In case Init() called again.
-	delete[] mPrevSolution;
-	delete[] mCurrSolution;
+float Waves::SpatialStep() const
+{
+	return mSpatialStep;
+}
 
-	mPrevSolution = new XMFLOAT3[m * n];
-	mCurrSolution = new XMFLOAT3[m * n];
+void Waves::SetThreadCount(UINT numThreads)
+{
+	if (numThreads <= 1)
+	{
+		delete mThreadPool;
+		mThreadPool = NULL;
+		return;
+	}
 
-	// Generate grid vertices in system memory.
+	if (mThreadPool == NULL)
+	{
+		mThreadPool = new ThreadPool();
+	}
+	if (mThreadPool->ThreadCount() != numThreads)
+	{
+		mThreadPool->Start(numThreads);
+	}
+}
 
-	const float halfWidth = (n - 1) * dx * 0.5f;
-	const float halfDepth = (m - 1) * dx * 0.5f;
-	for (UINT i = 0; i < m; ++i)
+UINT Waves::ThreadCount() const
+{
+	return mThreadPool != NULL ? mThreadPool->ThreadCount() : 1;
+}
+
+void Waves::SetNormalsEnabled(bool enabled)
+{
+	if (enabled == mbNormalsEnabled)
 	{
-		float z = halfDepth - i * dx;
-		for (UINT j = 0; j < n; ++j)
+		return;
+	}
+
+	mbNormalsEnabled = enabled;
+	if (enabled)
+	{
+		if (mNumRows > 0)
+		{
+			AllocNormals();
+		}
+	}
+	else
+	{
+		for (UINT a = 0; a < 3; ++a)
+		{
+			_aligned_free(mNormals[a]);
+			mNormals[a] = NULL;
+		}
+		for (UINT a = 0; a < 2; ++a)
 		{
-			float x = -halfWidth + j * dx;
+			_aligned_free(mTangents[a]);
+			mTangents[a] = NULL;
+		}
+	}
+}
+
+bool Waves::NormalsEnabled() const
+{
+	return mbNormalsEnabled;
+}
+
+const float* Waves::NormalField(UINT axis) const
+{
+	assert(axis < 3);
+	return mNormals[axis];
+}
+
+const float* Waves::TangentField(UINT axis) const
+{
+	assert(axis < 2);
+	return mTangents[axis];
+}
+
+UINT Waves::NormalPitch() const
+{
+	return mNormalPitch;
+}
+
+XMFLOAT3 Waves::Normal(int i) const
+{
+	const UINT row = i / mNumCols;
+	const UINT k = row * mNormalPitch + (i - row * mNumCols);
+	return XMFLOAT3(mNormals[0][k], mNormals[1][k], mNormals[2][k]);
+}
+
+XMFLOAT3 Waves::TangentX(int i) const
+{
+	const UINT row = i / mNumCols;
+	const UINT k = row * mNormalPitch + (i - row * mNumCols);
+	return XMFLOAT3(mTangents[0][k], mTangents[1][k], 0.f);
+}
+
+void Waves::AllocNormals()
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+
+	mNormalPitch = (n + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+	for (UINT a = 0; a < 3; ++a)
+	{
+		mNormals[a] = AllocHeights(m * mNormalPitch);
+	}
+	for (UINT a = 0; a < 2; ++a)
+	{
+		mTangents[a] = AllocHeights(m * mNormalPitch);
+	}
+
+	// Boundary cells never move, so they keep the flat frame.
+	for (UINT k = 0; k < m * mNormalPitch; ++k)
+	{
+		mNormals[1][k] = 1.f;
+		mTangents[0][k] = 1.f;
+	}
 
-			mPrevSolution[i * n + j] = XMFLOAT3(x, 0.f, z);
-			mCurrSolution[i * n + j] = XMFLOAT3(x, 0.f, z);
+	RebuildNormals();
+}
+
+void Waves::RebuildNormals()
+{
+	const UINT m = mNumRows;
+
+	if (mBoundary == BOUNDARY_PERIODIC)
+	{
+		for (UINT i = 0; i < m - 1; ++i)
+		{
+			NormalPeriodicRow(mCurrHeights, i);
 		}
 	}
+	else if (IsPacked())
+	{
+		AllocPackScratch(1);
+		NormalPackedRows(1, m - 1, mPackScratch);
+	}
+	else
+	{
+		NormalRows(mCurrHeights, 1, m - 1);
+	}
 }
 
-void Waves::Update(float dt)
+void Waves::NormalRows(const float* heights, UINT rowBegin, UINT rowEnd)
 {
-	static float t = 0;
+	const float invTwoDx = 0.5f / mSpatialStep;
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const UINT k = i * mNormalPitch + 1;
+		WavesKernels::NormalRow(
+			&Height(heights, i - 1, 1),
+			&Height(heights, i, 1),
+			&Height(heights, i + 1, 1),
+			mNumCols - 2, mHeightStride, invTwoDx,
+			mNormals[0] + k, mNormals[1] + k, mNormals[2] + k,
+			mTangents[0] + k, mTangents[1] + k);
+	}
+}
 
-	// Accumulate time.
-	t += dt;
+void Waves::SetPyramidEnabled(bool enabled)
+{
+	if (enabled == mbPyramidEnabled)
+	{
+		return;
+	}
 
-	// Only update the simulation at the specified time stemp.
-	if (t >= mTimeStep)
+	mbPyramidEnabled = enabled;
+	if (enabled)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		for (DWORD i = 1; i < mNumRows - 1; ++i)
+		if (mNumRows > 0)
 		{
-			for (DWORD j = 1; j< mNumCols - 1; ++j)
-			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element)
-				// bucause we won't need prev_ij again and the assignment happens last.
-				
-				// Note j indexes x and i indexes z; h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to
-				// keep consistent with our row indices going down.
+			AllocPyramid();
+		}
+	}
+	else
+	{
+		FreePyramid();
+	}
+}
+
+bool Waves::PyramidEnabled() const
+{
+	return mbPyramidEnabled;
+}
+
+UINT Waves::PyramidLevelCount() const
+{
+	return (UINT)mPyramidLevels.size();
+}
+
+const float* Waves::PyramidLevel(UINT level, PyramidReduction reduction) const
+{
+	if (mPyramid[reduction] == NULL)
+	{
+		return NULL;
+	}
+
+	assert(level < mPyramidLevels.size());
+	return mPyramid[reduction] + mPyramidLevels[level].Offset;
+}
+
+void Waves::PyramidLevelSize(UINT level, UINT& rows, UINT& cols, UINT& pitch) const
+{
+	assert(level < mPyramidLevels.size());
+	const PyramidLevelDesc& desc = mPyramidLevels[level];
+	rows = desc.Rows;
+	cols = desc.Cols;
+	pitch = desc.Pitch;
+}
+
+void Waves::AllocPyramid()
+{
+	mPyramidLevels.clear();
+
+	UINT rows = mNumRows;
+	UINT cols = mNumCols;
+	UINT total = 0;
+	do
+	{
+		rows = (rows + 1) / 2;
+		cols = (cols + 1) / 2;
+
+		PyramidLevelDesc desc;
+		desc.Rows = rows;
+		desc.Cols = cols;
+		desc.Pitch = (cols + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+		desc.Offset = total;
+		mPyramidLevels.push_back(desc);
+
+		total += rows * desc.Pitch;
+	} while (rows > 1 || cols > 1);
+
+	for (UINT r = 0; r < 3; ++r)
+	{
+		mPyramid[r] = AllocHeights(total);
+	}
+
+	ReducePyramidBase();
+	ReducePyramidUpper();
+}
+
+void Waves::FreePyramid()
+{
+	for (UINT r = 0; r < 3; ++r)
+	{
+		_aligned_free(mPyramid[r]);
+		mPyramid[r] = NULL;
+	}
+	mPyramidLevels.clear();
+
+	_aligned_free(mPyramidScratch);
+	mPyramidScratch = NULL;
+	mPyramidScratchBands = 0;
+}
+
+void Waves::ReducePyramidPair(const float* heights, UINT r)
+{
+	assert(mStorage == STORAGE_SOA);
+
+	const UINT a = 2 * r;
+	const UINT b = MathHelper::Min(a + 1, mNumRows - 1);
+	ReducePyramidRow(heights + a * mRowPitch, heights + b * mRowPitch, r);
+}
+
+void Waves::ReducePyramidRow(const float* a, const float* b, UINT r)
+{
+	const UINT k = r * mPyramidLevels[0].Pitch;
+	WavesKernels::ReduceRow2x2(a, b, a, b, a, b, mNumCols,
+		mPyramid[PYRAMID_MIN] + k, mPyramid[PYRAMID_MAX] + k, mPyramid[PYRAMID_AVERAGE] + k);
+}
+
+void Waves::ReducePyramidBase()
+{
+	const UINT baseRows = mPyramidLevels[0].Rows;
+	UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, baseRows / MinRowsPerBand);
+	if (mThreadPool == NULL || numBands <= 1)
+	{
+		numBands = 1;
+	}
+
+	// Other storage modes are widened two rows at a time first.
+	const bool direct = mStorage == STORAGE_SOA;
+	const UINT scratchPitch = (mNumCols + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+	if (!direct && mPyramidScratchBands < numBands)
+	{
+		_aligned_free(mPyramidScratch);
+		mPyramidScratch = AllocHeights(numBands * 2 * scratchPitch);
+		mPyramidScratchBands = numBands;
+	}
+
+	auto band = [this, baseRows, numBands, direct, scratchPitch](UINT b)
+	{
+		const UINT rBegin = baseRows * b / numBands;
+		const UINT rEnd = baseRows * (b + 1) / numBands;
+		float* scratch = direct ? NULL : mPyramidScratch + b * 2 * scratchPitch;
 
-				mPrevSolution[i * mNumCols + j].y =
-					mK1 * mPrevSolution[i * mNumCols + j].y +
-					mK2 * mCurrSolution[i * mNumCols + j].y + 
-					mK3 * ( mCurrSolution[(i + 1) * mNumCols + j].y + 
-							mCurrSolution[(i - 1) * mNumCols + j].y + 
-							mCurrSolution[i * mNumCols + j + 1].y + 
-							mCurrSolution[i * mNumCols + j - 1].y);
+		for (UINT r = rBegin; r < rEnd; ++r)
+		{
+			if (direct)
+			{
+				ReducePyramidPair(mCurrHeights, r);
+				continue;
 			}
+
+			const UINT first = 2 * r;
+			const UINT last = MathHelper::Min(first + 1, mNumRows - 1);
+			ReadRegion(LEVEL_CURRENT, first, last + 1, 0, mNumCols, scratch, scratchPitch);
+			ReducePyramidRow(scratch, scratch + (last - first) * scratchPitch, r);
 		}
+	};
+
+	if (numBands == 1)
+	{
+		band(0);
+	}
+	else
+	{
+		mThreadPool->ParallelFor(numBands, band);
+	}
+}
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+void Waves::ReducePyramidUpper()
+{
+	// Each level is a quarter of the one below, so together they cost about
+	// a third of the base and run serially while it is still in cache.
+	for (UINT l = 1; l < mPyramidLevels.size(); ++l)
+	{
+		const PyramidLevelDesc& src = mPyramidLevels[l - 1];
+		const PyramidLevelDesc& dst = mPyramidLevels[l];
 
-		t = 0.0f; // reset time
+		for (UINT r = 0; r < dst.Rows; ++r)
+		{
+			const UINT a = src.Offset + 2 * r * src.Pitch;
+			const UINT b = src.Offset + MathHelper::Min(2 * r + 1, src.Rows - 1) * src.Pitch;
+			const UINT k = dst.Offset + r * dst.Pitch;
+			WavesKernels::ReduceRow2x2(
+				mPyramid[PYRAMID_MIN] + a, mPyramid[PYRAMID_MIN] + b,
+				mPyramid[PYRAMID_MAX] + a, mPyramid[PYRAMID_MAX] + b,
+				mPyramid[PYRAMID_AVERAGE] + a, mPyramid[PYRAMID_AVERAGE] + b,
+				src.Cols, mPyramid[PYRAMID_MIN] + k, mPyramid[PYRAMID_MAX] + k, mPyramid[PYRAMID_AVERAGE] + k);
+		}
 	}
 }
 
-void Waves::Disturb(UINT i, UINT j, float magnitude)
+void Waves::SetActivityTracking(bool enabled)
 {
-	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows - 2);
-	assert(j > 1 && j < mNumCols - 2);
+	// Nothing is known to be flat yet, so start with every tile awake.
+	if (enabled && !mbActivityTracking)
+	{
+		mTileActive.assign(mTileActive.size(), 1);
+	}
+	mbActivityTracking = enabled;
+}
 
-	float halfMag = 0.5f * magnitude;
+bool Waves::ActivityTracking() const
+{
+	return mbActivityTracking;
+}
 
-	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i * mNumCols + j].y += magnitude;
-	mCurrSolution[i * mNumCols + j + 1].y += halfMag;
-	mCurrSolution[i * mNumCols + j - 1].y += halfMag;
-	mCurrSolution[(i + 1) * mNumCols + j].y += halfMag;
-	mCurrSolution[(i - 1) * mNumCols + j].y += halfMag;
+void Waves::SetSleepThreshold(float threshold)
+{
+	mSleepThreshold = threshold;
+}
+
+UINT Waves::ActiveTileCount() const
+{
+	UINT count = 0;
+	for (size_t t = 0; t < mTileActive.size(); ++t)
+	{
+		count += mTileActive[t];
+	}
+	return count;
+}
+
+void Waves::SetLandMask(const BYTE* wet)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+
+	mWetMask.assign(wet, wet + m * n);
+	mWetSpans.clear();
+	mWetSpanStart.assign(m + 1, 0);
+
+	// Compress each interior row to its runs of wet columns.
+	for (UINT i = 0; i < m; ++i)
+	{
+		mWetSpanStart[i] = (UINT)mWetSpans.size();
+		if (i == 0 || i == m - 1)
+		{
+			continue;
+		}
+
+		UINT j = 1;
+		while (j < n - 1)
+		{
+			if (!wet[i * n + j])
+			{
+				++j;
+				continue;
+			}
+
+			WetSpan span;
+			span.Begin = j;
+			while (j < n - 1 && wet[i * n + j])
+			{
+				++j;
+			}
+			span.End = j;
+			mWetSpans.push_back(span);
+		}
+	}
+	mWetSpanStart[m] = (UINT)mWetSpans.size();
+
+	// Dry cells start, and stay, flat in both time levels.
+	for (UINT i = 1; i < m - 1; ++i)
+	{
+		for (UINT j = 1; j < n - 1; ++j)
+		{
+			if (wet[i * n + j])
+			{
+				continue;
+			}
+
+			if (IsPacked())
+			{
+				mPrevPacked[i * mRowPitch + j] = 0;
+				mCurrPacked[i * mRowPitch + j] = 0;
+			}
+			else
+			{
+				Height(mPrevHeights, i, j) = 0.f;
+				Height(mCurrHeights, i, j) = 0.f;
+			}
+		}
+	}
+}
+
+void Waves::ClearLandMask()
+{
+	mWetMask.clear();
+	mWetSpans.clear();
+	mWetSpanStart.clear();
+}
+
+bool Waves::IsWet(UINT i, UINT j) const
+{
+	return mWetMask.empty() || mWetMask[i * mNumCols + j] != 0;
+}
+
+UINT Waves::WetCellCount() const
+{
+	if (mWetSpanStart.empty())
+	{
+		return (mNumRows - 2) * (mNumCols - 2);
+	}
+
+	UINT count = 0;
+	for (size_t s = 0; s < mWetSpans.size(); ++s)
+	{
+		count += mWetSpans[s].End - mWetSpans[s].Begin;
+	}
+	return count;
+}
+
+void Waves::SetMaxStepsPerUpdate(UINT maxSteps)
+{
+	mClock.SetMaxStepsPerUpdate(maxSteps);
+}
+
+UINT Waves::MaxStepsPerUpdate() const
+{
+	return mClock.MaxStepsPerUpdate();
+}
+
+float Waves::DroppedTime() const
+{
+	return mClock.DroppedTime();
+}
+
+void Waves::SetStepsPerPass(UINT steps)
+{
+	mStepsPerPass = MathHelper::Max(steps, 1u);
+}
+
+UINT Waves::StepsPerPass() const
+{
+	return mStepsPerPass;
+}
+
+void Waves::Init(UINT m, UINT n, float dx, float dt, float speed, float damping,
+	StorageMode storage, float heightScale, Integrator integrator, Boundary boundary,
+	UINT spongeWidth)
+{
+	// In case Init() called again.
+	Release();
+
+	mNumRows = m;
+	mNumCols = n;
+
+	mVertexCount = m * n;
+	mTriangleCount = (m - 1) * (n - 1) * 2;
+
+	mTimeStep = dt;
+	mSpatialStep = dx;
+	mSpeed = speed;
+	mDamping = damping;
+
+	mClock.Reset(dt);
+
+	const float d = damping * dt + 2.f;
+	const float e = (speed * speed) * (dt * dt) / (dx * dx);
+	mK1 = (damping * dt - 2.f) / d;
+	mK2 = (4.f - 8.f * e) / d;
+	mK3 = (2.f * e) / d;
+
+	// The implicit sweeps want unit-stride fp32 rows.
+	mIntegrator = integrator;
+	mStorage = integrator == INTEGRATOR_ADI ? STORAGE_SOA : storage;
+	mHeightScale = heightScale;
+
+	// Wrapping is only implemented for the explicit fp32 sweep, and the
+	// sponge for fp32 storage.
+	const bool fp32 = mStorage == STORAGE_AOS || mStorage == STORAGE_SOA;
+	const bool supported = boundary == BOUNDARY_FIXED ||
+		(boundary == BOUNDARY_PERIODIC && fp32 && mIntegrator == INTEGRATOR_EXPLICIT) ||
+		(boundary == BOUNDARY_ABSORBING && fp32);
+	assert(supported);
+	mBoundary = supported ? boundary : BOUNDARY_FIXED;
+
+	mSpongeWidth = 0;
+	mSpongeRow.clear();
+	mSpongeCol.clear();
+	if (mBoundary == BOUNDARY_ABSORBING)
+	{
+		// Damping rate s(d) = smax ((w - d) / w)^2 at distance d < w from the
+		// edge: nothing where the rim starts, so the ramp itself reflects
+		// little, and strongest next to the fixed ring.  A wave at speed c
+		// crossing the rim and back loses exp(-2 smax w dx / 3c) of its
+		// amplitude; smax is picked to make that SpongeAttenuation whatever
+		// the grid, and each step scales by exp(-s(d) dt).
+		mSpongeWidth = MathHelper::Min(spongeWidth, (MathHelper::Min(m, n) - 1) / 2);
+		const float maxRate = mSpongeWidth > 0 ? 1.5f * SpongeAttenuation * speed / (mSpongeWidth * dx) : 0.f;
+		auto profile = [this, maxRate, dt](UINT d) -> float
+		{
+			if (d >= mSpongeWidth)
+			{
+				return 1.f;
+			}
+			const float x = (float)(mSpongeWidth - d) / mSpongeWidth;
+			return expf(-maxRate * x * x * dt);
+		};
+
+		mSpongeRow.resize(m);
+		mSpongeCol.resize(n);
+		for (UINT i = 0; i < m; ++i)
+		{
+			mSpongeRow[i] = profile(MathHelper::Min(i, m - 1 - i));
+		}
+		for (UINT j = 0; j < n; ++j)
+		{
+			mSpongeCol[j] = profile(MathHelper::Min(j, n - 1 - j));
+		}
+	}
+
+	if (mIntegrator == INTEGRATOR_ADI)
+	{
+		// Lees' three-level scheme with theta = 1/4,
+		//   A u+ - e theta L u+ = 2u - (1 - damping dt / 2) u- + e (1 - 2 theta) L u + e theta L u-
+		// with A = 1 + damping dt / 2 and L the 5-point Laplacian.  The left
+		// side is factored as A (1 - r Lx)(1 - r Lz), r = e theta / A, which only
+		// adds an O(dt^4) term and keeps the scheme unconditionally stable.
+		const float theta = 0.25f;
+		const float a = 1.f + 0.5f * damping * dt;
+		mImplicitR = e * theta / a;
+		mImplicitQ[0] = (2.f - 4.f * e * (1.f - 2.f * theta)) / a;
+		mImplicitQ[1] = e * (1.f - 2.f * theta) / a;
+		mImplicitQ[2] = -((1.f - 0.5f * damping * dt) + 4.f * e * theta) / a;
+		mImplicitQ[3] = e * theta / a;
+
+		mRowInv.resize(n - 2);
+		mRowUpper.resize(n - 2);
+		mColInv.resize(m - 2);
+		mColUpper.resize(m - 2);
+		WavesKernels::FactorTridiagonal(mImplicitR, n - 2, &mRowInv[0], &mRowUpper[0]);
+		WavesKernels::FactorTridiagonal(mImplicitR, m - 2, &mColInv[0], &mColUpper[0]);
+	}
+
+	// Generate grid vertices in system memory.
+
+	const float halfWidth = (n - 1) * dx * 0.5f;
+	const float halfDepth = (m - 1) * dx * 0.5f;
+
+	mColumnX = new float[n];
+	mRowZ = new float[m];
+
+	for (UINT j = 0; j < n; ++j)
+	{
+		mColumnX[j] = -halfWidth + j * dx;
+	}
+	for (UINT i = 0; i < m; ++i)
+	{
+		mRowZ[i] = halfDepth - i * dx;
+	}
+
+	if (mStorage == STORAGE_AOS)
+	{
+		mPrevSolution = new XMFLOAT3[m * n];
+		mCurrSolution = new XMFLOAT3[m * n];
+
+		for (UINT i = 0; i < m; ++i)
+		{
+			float z = halfDepth - i * dx;
+			for (UINT j = 0; j < n; ++j)
+			{
+				float x = -halfWidth + j * dx;
+
+				mPrevSolution[i * n + j] = XMFLOAT3(x, 0.f, z);
+				mCurrSolution[i * n + j] = XMFLOAT3(x, 0.f, z);
+			}
+		}
+
+		mPrevHeights = &mPrevSolution[0].y;
+		mCurrHeights = &mCurrSolution[0].y;
+		mHeightStride = 3;
+		mRowPitch = 3 * n;
+	}
+	else
+	{
+		mHeightStride = 1;
+		if (mStorage == STORAGE_SOA)
+		{
+			mRowPitch = (n + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+			mPrevHeights = AllocHeights(m * mRowPitch);
+			mCurrHeights = AllocHeights(m * mRowPitch);
+			if (mIntegrator == INTEGRATOR_ADI)
+			{
+				mImplicitHeights = AllocHeights(m * mRowPitch);
+			}
+		}
+		else
+		{
+			// Zero encodes 0.0 in both 16-bit formats.
+			mRowPitch = (n + PackedPerLine - 1) / PackedPerLine * PackedPerLine;
+			mPrevPacked = AllocPacked(m * mRowPitch);
+			mCurrPacked = AllocPacked(m * mRowPitch);
+			mPackScratchPitch = (n + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+		}
+	}
+
+	mTilesDown = (m + ActivityTileSize - 1) / ActivityTileSize;
+	mTilesAcross = (n + ActivityTileSize - 1) / ActivityTileSize;
+	mTileActive.assign(mTilesDown * mTilesAcross, 0);
+	mTileProcess.assign(mTilesDown * mTilesAcross, 0);
+	mTileEnergy.assign(mTilesDown * mTilesAcross, 0.f);
+
+	ClearLandMask();
+
+	if (mbNormalsEnabled)
+	{
+		AllocNormals();
+	}
+	if (mbPyramidEnabled)
+	{
+		AllocPyramid();
+	}
+}
+
+UINT Waves::CheckpointPitch() const
+{
+	return mStorage == STORAGE_AOS ? mNumCols : mRowPitch;
+}
+
+UINT Waves::CheckpointElementBytes() const
+{
+	return IsPacked() ? sizeof(USHORT) : sizeof(float);
+}
+
+void Waves::SaveLevel(TimeLevel level, BYTE* dest) const
+{
+	const bool current = level == LEVEL_CURRENT;
+
+	if (mStorage == STORAGE_AOS)
+	{
+		ReadRegion(level, 0, mNumRows, 0, mNumCols, reinterpret_cast<float*>(dest), mNumCols);
+	}
+	else if (IsPacked())
+	{
+		CopyMemory(dest, current ? mCurrPacked : mPrevPacked, mNumRows * mRowPitch * sizeof(USHORT));
+	}
+	else
+	{
+		CopyMemory(dest, current ? mCurrHeights : mPrevHeights, mNumRows * mRowPitch * sizeof(float));
+	}
+}
+
+void Waves::LoadLevel(TimeLevel level, const BYTE* src, UINT srcPitch)
+{
+	const bool current = level == LEVEL_CURRENT;
+
+	if (mStorage == STORAGE_AOS)
+	{
+		WriteRegion(level, 0, mNumRows, 0, mNumCols, reinterpret_cast<const float*>(src), srcPitch);
+		return;
+	}
+
+	BYTE* dest = IsPacked() ?
+		reinterpret_cast<BYTE*>(current ? mCurrPacked : mPrevPacked) :
+		reinterpret_cast<BYTE*>(current ? mCurrHeights : mPrevHeights);
+	const UINT elementBytes = CheckpointElementBytes();
+
+	// Saved by a build with other row padding: row by row.
+	if (srcPitch == mRowPitch)
+	{
+		CopyMemory(dest, src, mNumRows * mRowPitch * elementBytes);
+	}
+	else
+	{
+		for (UINT i = 0; i < mNumRows; ++i)
+		{
+			CopyMemory(dest + i * mRowPitch * elementBytes, src + i * srcPitch * elementBytes, mNumCols * elementBytes);
+		}
+	}
+}
+
+bool Waves::SaveCheckpoint(const char* path) const
+{
+	if (mNumRows == 0)
+	{
+		return false;
+	}
+
+	const UINT pitch = CheckpointPitch();
+	const UINT levelBytes = (mNumRows * pitch * CheckpointElementBytes() + 63) / 64 * 64;
+	const UINT maskBytes = (UINT)mWetMask.size();
+
+	// Written beside path and moved over it once complete, so a crash
+	// mid-write leaves the last good checkpoint in place.
+	const std::string tempPath = std::string(path) + ".tmp";
+	{
+		MappedFile file;
+		if (!file.Create(tempPath.c_str(), (UINT64)CheckpointHeaderBytes + 2 * (UINT64)levelBytes + maskBytes))
+		{
+			return false;
+		}
+
+		BYTE* view = file.View();
+		ZeroMemory(view, CheckpointHeaderBytes);
+
+		CheckpointHeader& header = *reinterpret_cast<CheckpointHeader*>(view);
+		header.Magic = CheckpointMagic;
+		header.Version = CheckpointVersion;
+		header.Rows = mNumRows;
+		header.Cols = mNumCols;
+		header.RowPitch = pitch;
+		header.ElementBytes = CheckpointElementBytes();
+		header.LevelBytes = levelBytes;
+		header.Storage = mStorage;
+		header.Integrator = mIntegrator;
+		header.Boundary = mBoundary;
+		header.SpongeWidth = mSpongeWidth;
+		header.HasLandMask = maskBytes > 0 ? 1 : 0;
+		header.SpatialStep = mSpatialStep;
+		header.TimeStep = mTimeStep;
+		header.Speed = mSpeed;
+		header.Damping = mDamping;
+		header.HeightScale = mHeightScale;
+		header.TimeAccumulator = mClock.BankedTime();
+		header.DroppedTime = mClock.DroppedTime();
+
+		BYTE* levels = view + CheckpointHeaderBytes;
+		SaveLevel(LEVEL_PREVIOUS, levels);
+		SaveLevel(LEVEL_CURRENT, levels + levelBytes);
+		if (maskBytes > 0)
+		{
+			CopyMemory(levels + 2 * levelBytes, &mWetMask[0], maskBytes);
+		}
+
+		if (!file.Flush())
+		{
+			return false;
+		}
+	}
+
+	if (!MoveFileExA(tempPath.c_str(), path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH))
+	{
+		DeleteFileA(tempPath.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool Waves::LoadCheckpoint(const char* path)
+{
+	return ReadCheckpoint(path, true);
+}
+
+bool Waves::ResumeCheckpoint(const char* path)
+{
+	return ReadCheckpoint(path, false);
+}
+
+bool Waves::ReadCheckpoint(const char* path, bool reinit)
+{
+	MappedFile file;
+	if (!file.OpenRead(path) || file.Bytes() < CheckpointHeaderBytes)
+	{
+		return false;
+	}
+
+	const BYTE* view = file.View();
+	const CheckpointHeader& header = *reinterpret_cast<const CheckpointHeader*>(view);
+	if (header.Magic != CheckpointMagic || header.Version != CheckpointVersion ||
+		header.Rows < 3 || header.Cols < 3 || header.RowPitch < header.Cols ||
+		header.Storage > STORAGE_FIXED16 || header.Integrator > INTEGRATOR_ADI ||
+		header.Boundary > BOUNDARY_ABSORBING)
+	{
+		return false;
+	}
+
+	// INTEGRATOR_ADI always runs in fp32.
+	const bool packed = header.Integrator != INTEGRATOR_ADI &&
+		(header.Storage == STORAGE_FP16 || header.Storage == STORAGE_FIXED16);
+	if (header.ElementBytes != (packed ? sizeof(USHORT) : sizeof(float)))
+	{
+		return false;
+	}
+
+	const UINT64 maskBytes = header.HasLandMask ? (UINT64)header.Rows * header.Cols : 0;
+	const UINT64 levelBytes = (UINT64)header.Rows * header.RowPitch * header.ElementBytes;
+	if (header.LevelBytes < levelBytes ||
+		file.Bytes() < CheckpointHeaderBytes + 2 * (UINT64)header.LevelBytes + maskBytes)
+	{
+		return false;
+	}
+
+	const BYTE* levels = view + CheckpointHeaderBytes;
+	const BYTE* mask = levels + 2 * header.LevelBytes;
+
+	if (reinit)
+	{
+		Init(header.Rows, header.Cols, header.SpatialStep, header.TimeStep, header.Speed, header.Damping,
+			(StorageMode)header.Storage, header.HeightScale, (Integrator)header.Integrator,
+			(Boundary)header.Boundary, header.SpongeWidth);
+
+		if (maskBytes > 0)
+		{
+			SetLandMask(mask);
+		}
+	}
+	else
+	{
+		// Only heights saved from exactly this grid, mask included, carry on
+		// where they left off; anything else would be a different sea.
+		if (header.Rows != mNumRows || header.Cols != mNumCols ||
+			header.Storage != (UINT)mStorage || header.Integrator != (UINT)mIntegrator ||
+			header.Boundary != (UINT)mBoundary || header.SpongeWidth != mSpongeWidth ||
+			header.SpatialStep != mSpatialStep || header.TimeStep != mTimeStep ||
+			header.Speed != mSpeed || header.Damping != mDamping || header.HeightScale != mHeightScale ||
+			maskBytes != mWetMask.size() ||
+			(maskBytes > 0 && memcmp(mask, &mWetMask[0], (size_t)maskBytes) != 0))
+		{
+			return false;
+		}
+	}
+	LoadLevel(LEVEL_PREVIOUS, levels, header.RowPitch);
+	LoadLevel(LEVEL_CURRENT, levels + header.LevelBytes, header.RowPitch);
+
+	mClock.Restore(header.TimeAccumulator, header.DroppedTime);
+
+	// Nothing is known to be flat any more.
+	if (mbActivityTracking)
+	{
+		mTileActive.assign(mTilesDown * mTilesAcross, 1);
+	}
+	if (mbNormalsEnabled)
+	{
+		RebuildNormals();
+	}
+	if (mbPyramidEnabled)
+	{
+		ReducePyramidBase();
+		ReducePyramidUpper();
+	}
+
+	return true;
+}
+
+UINT Waves::Update(float dt)
+{
+	const UINT numSteps = mClock.Advance(dt);
+	if (numSteps > 0)
+	{
+		UpdateSteps(numSteps);
+	}
+
+	return numSteps;
+}
+
+void Waves::Step()
+{
+	if (mIntegrator == INTEGRATOR_ADI)
+	{
+		StepImplicit();
+		return;
+	}
+
+	if (mBoundary == BOUNDARY_PERIODIC)
+	{
+		StepPeriodic();
+		return;
+	}
+
+	const bool packed = IsPacked();
+	if (mbActivityTracking && !packed)
+	{
+		StepSparse();
+		return;
+	}
+
+	// Only update interior points; we use zero boundary conditions.
+	const UINT interiorRows = mNumRows - 2;
+	const UINT maxBands = interiorRows / MinRowsPerBand;
+	UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, maxBands);
+	if (mThreadPool == NULL || numBands <= 1)
+	{
+		numBands = 1;
+	}
+
+	if (packed)
+	{
+		AllocPackScratch(numBands);
+	}
+
+	// Rows only read the current buffer and write their own cells of the
+	// previous one, so bands are independent within a step.  Every row is
+	// computed by the same kernel whichever thread picks it up.
+	auto band = [this, interiorRows, numBands, packed](UINT b)
+	{
+		const UINT rowBegin = 1 + interiorRows * b / numBands;
+		const UINT rowEnd = 1 + interiorRows * (b + 1) / numBands;
+		if (packed)
+		{
+			StepPackedRows(rowBegin, rowEnd, mPackScratch + b * PackedWindowRows * mPackScratchPitch);
+		}
+		else
+		{
+			StepRows(rowBegin, rowEnd);
+		}
+	};
+
+	if (numBands == 1)
+	{
+		band(0);
+	}
+	else
+	{
+		mThreadPool->ParallelFor(numBands, band);
+	}
+
+	if (packed)
+	{
+		std::swap(mPrevPacked, mCurrPacked);
+
+		// Widening rows again is the expensive part, so the frame is a second
+		// banded sweep over the stored heights rather than fused.
+		if (mbNormalsEnabled)
+		{
+			auto normals = [this, interiorRows, numBands](UINT b)
+			{
+				const UINT rowBegin = 1 + interiorRows * b / numBands;
+				const UINT rowEnd = 1 + interiorRows * (b + 1) / numBands;
+				NormalPackedRows(rowBegin, rowEnd, mPackScratch + b * PackedWindowRows * mPackScratchPitch);
+			};
+			if (numBands == 1)
+			{
+				normals(0);
+			}
+			else
+			{
+				mThreadPool->ParallelFor(numBands, normals);
+			}
+		}
+		return;
+	}
+
+	// The first and last row of a band need new heights from the neighbouring
+	// band, so StepRows leaves their normals until every band is done.
+	if (mbNormalsEnabled)
+	{
+		for (UINT b = 0; b < numBands; ++b)
+		{
+			const UINT rowBegin = 1 + interiorRows * b / numBands;
+			const UINT rowEnd = 1 + interiorRows * (b + 1) / numBands;
+			NormalRows(mPrevHeights, rowBegin, rowBegin + 1);
+			if (rowEnd - 1 > rowBegin)
+			{
+				NormalRows(mPrevHeights, rowEnd - 1, rowEnd);
+			}
+		}
+	}
+
+	// Likewise the pyramid rows whose pair of grid rows starts in the band
+	// above or takes in a boundary row.
+	if (mbPyramidInStep)
+	{
+		for (UINT b = 0; b < numBands; ++b)
+		{
+			const UINT rowBegin = 1 + interiorRows * b / numBands;
+			if ((rowBegin & 1) != 0)
+			{
+				ReducePyramidPair(mPrevHeights, rowBegin / 2);
+			}
+		}
+		ReducePyramidPair(mPrevHeights, (mNumRows - 1) / 2);
+	}
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevSolution, mCurrSolution);
+	std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::StepPeriodic()
+{
+	// Every row moves, including the first; the last repeats it.
+	const UINT rows = mNumRows - 1;
+	const UINT maxBands = rows / MinRowsPerBand;
+	UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, maxBands);
+	if (mThreadPool == NULL || numBands <= 1)
+	{
+		numBands = 1;
+	}
+
+	auto band = [this, rows, numBands](UINT b)
+	{
+		StepPeriodicRows(rows * b / numBands, rows * (b + 1) / numBands);
+	};
+
+	if (numBands == 1)
+	{
+		band(0);
+	}
+	else
+	{
+		mThreadPool->ParallelFor(numBands, band);
+	}
+
+	// As in Step(), band edge rows wait for their neighbours.  Row 0 is
+	// always one, so the repeated last row is in place before row m - 2
+	// reads it.
+	if (mbNormalsEnabled)
+	{
+		for (UINT b = 0; b < numBands; ++b)
+		{
+			const UINT rowBegin = rows * b / numBands;
+			const UINT rowEnd = rows * (b + 1) / numBands;
+			NormalPeriodicRow(mPrevHeights, rowBegin);
+			if (rowEnd - 1 > rowBegin)
+			{
+				NormalPeriodicRow(mPrevHeights, rowEnd - 1);
+			}
+		}
+	}
+
+	std::swap(mPrevSolution, mCurrSolution);
+	std::swap(mPrevHeights, mCurrHeights);
+}
+
+void Waves::ApplySponge()
+{
+	const UINT m = mNumRows;
+	const UINT maxBands = m / MinRowsPerBand;
+	UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, maxBands);
+	if (mThreadPool == NULL || numBands <= 1)
+	{
+		numBands = 1;
+	}
+
+	// Every cell is scaled on its own, so the bands, like the step's, only
+	// split the work.
+	auto band = [this, m, numBands](UINT b)
+	{
+		SpongeRows(m * b / numBands, m * (b + 1) / numBands);
+	};
+
+	if (numBands == 1)
+	{
+		band(0);
+	}
+	else
+	{
+		mThreadPool->ParallelFor(numBands, band);
+	}
+}
+
+void Waves::SpongeRows(UINT rowBegin, UINT rowEnd)
+{
+	const UINT n = mNumCols;
+	const UINT w = mSpongeWidth;
+	float* levels[2] = { mPrevHeights, mCurrHeights };
+
+	for (UINT a = 0; a < 2; ++a)
+	{
+		float* heights = levels[a];
+		for (UINT i = rowBegin; i < rowEnd; ++i)
+		{
+			const float rowScale = mSpongeRow[i];
+			if (rowScale < 1.f)
+			{
+				for (UINT j = 0; j < n; ++j)
+				{
+					Height(heights, i, j) *= rowScale * mSpongeCol[j];
+				}
+				continue;
+			}
+
+			// Rows clear of the top and bottom rims only touch their ends.
+			for (UINT j = 0; j < w; ++j)
+			{
+				Height(heights, i, j) *= mSpongeCol[j];
+				Height(heights, i, n - 1 - j) *= mSpongeCol[n - 1 - j];
+			}
+		}
+	}
+}
+
+UINT Waves::RowAbove(UINT i) const
+{
+	return i > 0 ? i - 1 : mNumRows - 2;
+}
+
+void Waves::StepPeriodicRows(UINT rowBegin, UINT rowEnd)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	const UINT stride = mHeightStride;
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		// The repeated last row and column stand in for the wrapped
+		// neighbours below and to the right, so only the row above and the
+		// left neighbour of column 0 need wrapping.
+		const UINT above = RowAbove(i);
+		WavesKernels::StepRow(
+			&Height(mPrevHeights, i, 1),
+			&Height(mCurrHeights, above, 1),
+			&Height(mCurrHeights, i, 1),
+			&Height(mCurrHeights, i + 1, 1),
+			n - 2, stride, mK1, mK2, mK3);
+
+		// Column 0 through the same kernel, on a gathered copy of its row
+		// neighbourhood.
+		const float row[3] = { Height(mCurrHeights, i, n - 2), Height(mCurrHeights, i, 0), Height(mCurrHeights, i, 1) };
+		float& first = Height(mPrevHeights, i, 0);
+		WavesKernels::StepRow(&first, &Height(mCurrHeights, above, 0), &row[1],
+			&Height(mCurrHeights, i + 1, 0), 1, 1, mK1, mK2, mK3);
+		Height(mPrevHeights, i, n - 1) = first;
+
+		// Nothing reads the new level during the step, so the repeated row
+		// can be written at once.
+		if (i == 0)
+		{
+			for (UINT j = 0; j < n; ++j)
+			{
+				Height(mPrevHeights, m - 1, j) = Height(mPrevHeights, 0, j);
+			}
+		}
+
+		if (mbNormalsEnabled && i >= rowBegin + 2)
+		{
+			NormalPeriodicRow(mPrevHeights, i - 1);
+		}
+	}
+}
+
+void Waves::NormalPeriodicRow(const float* heights, UINT i)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	const UINT above = RowAbove(i);
+	const UINT k = i * mNormalPitch;
+	const float invTwoDx = 0.5f / mSpatialStep;
+
+	WavesKernels::NormalRow(
+		&Height(heights, above, 1),
+		&Height(heights, i, 1),
+		&Height(heights, i + 1, 1),
+		n - 2, mHeightStride, invTwoDx,
+		mNormals[0] + k + 1, mNormals[1] + k + 1, mNormals[2] + k + 1,
+		mTangents[0] + k + 1, mTangents[1] + k + 1);
+
+	const float row[3] = { Height(heights, i, n - 2), Height(heights, i, 0), Height(heights, i, 1) };
+	WavesKernels::NormalRow(&Height(heights, above, 0), &row[1], &Height(heights, i + 1, 0),
+		1, 1, invTwoDx,
+		mNormals[0] + k, mNormals[1] + k, mNormals[2] + k,
+		mTangents[0] + k, mTangents[1] + k);
+
+	float* fields[5] = { mNormals[0], mNormals[1], mNormals[2], mTangents[0], mTangents[1] };
+	for (UINT a = 0; a < 5; ++a)
+	{
+		fields[a][k + n - 1] = fields[a][k];
+		if (i == 0)
+		{
+			CopyMemory(fields[a] + (m - 1) * mNormalPitch, fields[a], n * sizeof(float));
+		}
+	}
+}
+
+void Waves::StepImplicit()
+{
+	const UINT interiorRows = mNumRows - 2;
+	const UINT interiorCols = mNumCols - 2;
+	const UINT maxBands = interiorRows / MinRowsPerBand;
+	UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, maxBands);
+	if (mThreadPool == NULL || numBands <= 1)
+	{
+		numBands = 1;
+	}
+	const UINT numBlocks = (interiorCols + ImplicitBlockCols - 1) / ImplicitBlockCols;
+
+	// Rows are independent in the x sweep and columns in the z sweep, so each
+	// sweep splits freely; every line is solved by the same kernel whichever
+	// thread takes it.  An implicit step spreads a disturbance over the whole
+	// grid at once, mostly as tiny values, so the sweeps flush denormals
+	// rather than pay for them everywhere.
+	auto rows = [this, interiorRows, numBands](UINT b)
+	{
+		WavesKernels::FlushDenormalsScope flush;
+		ImplicitRows(1 + interiorRows * b / numBands, 1 + interiorRows * (b + 1) / numBands);
+	};
+	auto columns = [this](UINT b)
+	{
+		WavesKernels::FlushDenormalsScope flush;
+		const UINT colBegin = 1 + b * ImplicitBlockCols;
+		ImplicitColumns(colBegin, MathHelper::Min(colBegin + ImplicitBlockCols, mNumCols - 1));
+	};
+
+	if (mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor(numBands, rows);
+		mThreadPool->ParallelFor(numBlocks, columns);
+	}
+	else
+	{
+		rows(0);
+		for (UINT b = 0; b < numBlocks; ++b)
+		{
+			columns(b);
+		}
+	}
+
+	// The solved buffer is the new current solution, the old current one
+	// becomes the previous and the old previous is the next step's scratch.
+	std::swap(mImplicitHeights, mPrevHeights);
+	std::swap(mPrevHeights, mCurrHeights);
+
+	// No row is final until the column sweep is done, so the frame is a
+	// separate banded pass.
+	if (mbNormalsEnabled)
+	{
+		auto normals = [this, interiorRows, numBands](UINT b)
+		{
+			NormalRows(mCurrHeights, 1 + interiorRows * b / numBands, 1 + interiorRows * (b + 1) / numBands);
+		};
+		if (mThreadPool != NULL)
+		{
+			mThreadPool->ParallelFor(numBands, normals);
+		}
+		else
+		{
+			normals(0);
+		}
+	}
+}
+
+void Waves::ImplicitRows(UINT rowBegin, UINT rowEnd)
+{
+	const UINT n = mNumCols;
+	const UINT count = n - 2;
+	const float r = mImplicitR;
+
+	for (UINT i0 = rowBegin; i0 < rowEnd; i0 += ImplicitGroupRows)
+	{
+		const UINT i1 = MathHelper::Min(i0 + ImplicitGroupRows, rowEnd);
+		for (UINT i = i0; i < i1; ++i)
+		{
+			float* out = &Height(mImplicitHeights, i, 1);
+			WavesKernels::ImplicitRhsRow(out,
+				&Height(mPrevHeights, i - 1, 1),
+				&Height(mPrevHeights, i, 1),
+				&Height(mPrevHeights, i + 1, 1),
+				&Height(mCurrHeights, i - 1, 1),
+				&Height(mCurrHeights, i, 1),
+				&Height(mCurrHeights, i + 1, 1),
+				count, mImplicitQ[0], mImplicitQ[1], mImplicitQ[2], mImplicitQ[3]);
+
+			// The boundary columns are known at the new time level (zero, or a
+			// halo), so they move to the right-hand side.
+			const float left = Height(mCurrHeights, i, 0);
+			const float right = Height(mCurrHeights, i, n - 1);
+			out[0] += r * left;
+			out[count - 1] += r * right;
+			Height(mImplicitHeights, i, 0) = left;
+			Height(mImplicitHeights, i, n - 1) = right;
+		}
+
+		// The rows of a group are still in cache; solve them together.
+		WavesKernels::SolveTridiagonal(&Height(mImplicitHeights, i0, 1), count, 1,
+			i1 - i0, mRowPitch, r, &mRowInv[0], &mRowUpper[0]);
+	}
+}
+
+void Waves::ImplicitColumns(UINT colBegin, UINT colEnd)
+{
+	const UINT m = mNumRows;
+	const UINT count = colEnd - colBegin;
+	const float r = mImplicitR;
+
+	float* top = &Height(mImplicitHeights, 0, colBegin);
+	float* bottom = &Height(mImplicitHeights, m - 1, colBegin);
+	float* first = &Height(mImplicitHeights, 1, colBegin);
+	float* last = &Height(mImplicitHeights, m - 2, colBegin);
+
+	CopyMemory(top, &Height(mCurrHeights, 0, colBegin), count * sizeof(float));
+	CopyMemory(bottom, &Height(mCurrHeights, m - 1, colBegin), count * sizeof(float));
+	for (UINT j = 0; j < count; ++j)
+	{
+		first[j] += r * top[j];
+		last[j] += r * bottom[j];
+	}
+
+	// Adjacent columns are adjacent floats, so each SIMD lane runs one column.
+	WavesKernels::SolveTridiagonal(first, m - 2, mRowPitch, count, 1, r, &mColInv[0], &mColUpper[0]);
+}
+
+void Waves::StepSparse()
+{
+	// Asleep tiles are exactly zero in both buffers, so they stay zero
+	// unless an awake neighbour pushes energy into them.
+	for (UINT ty = 0; ty < mTilesDown; ++ty)
+	{
+		for (UINT tx = 0; tx < mTilesAcross; ++tx)
+		{
+			BYTE process = 0;
+			for (UINT y = (ty > 0 ? ty - 1 : 0); y <= ty + 1 && y < mTilesDown; ++y)
+			{
+				for (UINT x = (tx > 0 ? tx - 1 : 0); x <= tx + 1 && x < mTilesAcross; ++x)
+				{
+					process |= mTileActive[y * mTilesAcross + x];
+				}
+			}
+			mTileProcess[ty * mTilesAcross + tx] = process;
+		}
+	}
+
+	// Tile rows only write their own cells, but settling zeroes cells that
+	// neighbouring rows read, so it waits for every row to finish stepping.
+	auto step = [this](UINT ty) { StepTileRow(ty); };
+	auto settle = [this](UINT ty) { SettleTileRow(ty); };
+	if (mThreadPool != NULL)
+	{
+		mThreadPool->ParallelFor(mTilesDown, step);
+		mThreadPool->ParallelFor(mTilesDown, settle);
+	}
+	else
+	{
+		for (UINT ty = 0; ty < mTilesDown; ++ty)
+		{
+			step(ty);
+		}
+		for (UINT ty = 0; ty < mTilesDown; ++ty)
+		{
+			settle(ty);
+		}
+	}
+
+	std::swap(mPrevSolution, mCurrSolution);
+	std::swap(mPrevHeights, mCurrHeights);
+
+	// Only cells in or next to a stepped tile can have a new frame.
+	if (mbNormalsEnabled)
+	{
+		for (UINT t = 0; t < mTileProcess.size(); ++t)
+		{
+			if (mTileProcess[t] == 0)
+			{
+				continue;
+			}
+
+			const UINT ty = t / mTilesAcross;
+			const UINT tx = t - ty * mTilesAcross;
+			const UINT r0 = MathHelper::Max(ty * ActivityTileSize, 2u) - 1;
+			const UINT r1 = MathHelper::Min((ty + 1) * ActivityTileSize + 1, mNumRows - 1);
+			const UINT c0 = MathHelper::Max(tx * ActivityTileSize, 2u) - 1;
+			const UINT c1 = MathHelper::Min((tx + 1) * ActivityTileSize + 1, mNumCols - 1);
+			const float invTwoDx = 0.5f / mSpatialStep;
+
+			for (UINT i = r0; i < r1; ++i)
+			{
+				const UINT k = i * mNormalPitch + c0;
+				WavesKernels::NormalRow(
+					&Height(mCurrHeights, i - 1, c0),
+					&Height(mCurrHeights, i, c0),
+					&Height(mCurrHeights, i + 1, c0),
+					c1 - c0, mHeightStride, invTwoDx,
+					mNormals[0] + k, mNormals[1] + k, mNormals[2] + k,
+					mTangents[0] + k, mTangents[1] + k);
+			}
+		}
+	}
+}
+
+void Waves::StepTileRow(UINT ty)
+{
+	const UINT T = ActivityTileSize;
+	const UINT rowBegin = MathHelper::Max(ty * T, 1u);
+	const UINT rowEnd = MathHelper::Min((ty + 1) * T, mNumRows - 1);
+	BYTE* process = &mTileProcess[ty * mTilesAcross];
+	float* energy = &mTileEnergy[ty * mTilesAcross];
+
+	for (UINT tx = 0; tx < mTilesAcross; ++tx)
+	{
+		energy[tx] = 0.f;
+	}
+
+	UINT tx = 0;
+	while (tx < mTilesAcross)
+	{
+		if (process[tx] == 0)
+		{
+			++tx;
+			continue;
+		}
+
+		// Merge neighbouring tiles into one run so the kernel sees long rows.
+		UINT runEnd = tx + 1;
+		while (runEnd < mTilesAcross && process[runEnd] != 0)
+		{
+			++runEnd;
+		}
+
+		const UINT colBegin = MathHelper::Max(tx * T, 1u);
+		const UINT colEnd = MathHelper::Min(runEnd * T, mNumCols - 1);
+
+		for (UINT i = rowBegin; i < rowEnd; ++i)
+		{
+			auto span = [this, i](UINT c0, UINT c1)
+			{
+				WavesKernels::StepRow(
+					&Height(mPrevHeights, i, c0),
+					&Height(mCurrHeights, i - 1, c0),
+					&Height(mCurrHeights, i, c0),
+					&Height(mCurrHeights, i + 1, c0),
+					c1 - c0, mHeightStride, mK1, mK2, mK3);
+			};
+			ForEachWetSpan(i, colBegin, colEnd, span);
+
+			// Measure both levels that survive the swap while they are hot.
+			for (UINT x = tx; x < runEnd; ++x)
+			{
+				const UINT c0 = MathHelper::Max(x * T, colBegin);
+				const UINT c1 = MathHelper::Min((x + 1) * T, colEnd);
+				const float e = MathHelper::Max(
+					WavesKernels::MaxAbsRow(&Height(mPrevHeights, i, c0), c1 - c0, mHeightStride),
+					WavesKernels::MaxAbsRow(&Height(mCurrHeights, i, c0), c1 - c0, mHeightStride));
+				energy[x] = MathHelper::Max(energy[x], e);
+			}
+		}
+
+		tx = runEnd;
+	}
+}
+
+void Waves::SettleTileRow(UINT ty)
+{
+	const UINT T = ActivityTileSize;
+	const UINT rowBegin = MathHelper::Max(ty * T, 1u);
+	const UINT rowEnd = MathHelper::Min((ty + 1) * T, mNumRows - 1);
+
+	for (UINT tx = 0; tx < mTilesAcross; ++tx)
+	{
+		const UINT t = ty * mTilesAcross + tx;
+		if (mTileProcess[t] == 0)
+		{
+			continue;
+		}
+
+		if (mTileEnergy[t] >= mSleepThreshold)
+		{
+			mTileActive[t] = 1;
+			continue;
+		}
+
+		// Flatten the remaining ripples so the tile can be skipped exactly.
+		mTileActive[t] = 0;
+		const UINT colBegin = MathHelper::Max(tx * T, 1u);
+		const UINT colEnd = MathHelper::Min((tx + 1) * T, mNumCols - 1);
+		for (UINT i = rowBegin; i < rowEnd; ++i)
+		{
+			for (UINT j = colBegin; j < colEnd; ++j)
+			{
+				Height(mPrevHeights, i, j) = 0.f;
+				Height(mCurrHeights, i, j) = 0.f;
+			}
+		}
+	}
+}
+
+void Waves::WakeTiles(UINT i, UINT j)
+{
+	// The 5-point splat can cross into the next tile.
+	WakeTiles(i - 1, i + 2, j - 1, j + 2);
+}
+
+void Waves::WakeTiles(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd)
+{
+	const UINT T = ActivityTileSize;
+	for (UINT y = rowBegin / T; y <= (rowEnd - 1) / T; ++y)
+	{
+		for (UINT x = colBegin / T; x <= (colEnd - 1) / T; ++x)
+		{
+			mTileActive[y * mTilesAcross + x] = 1;
+		}
+	}
+}
+
+void Waves::UpdateSteps(UINT numSteps)
+{
+	// Blocking needs unit-stride rows and a dense explicit sweep.
+	const bool blocking = mStorage == STORAGE_SOA && !mbActivityTracking &&
+		mIntegrator == INTEGRATOR_EXPLICIT && mBoundary == BOUNDARY_FIXED;
+	const UINT stepsPerPass = blocking ? mStepsPerPass : 1;
+
+	// Only the last step's heights reach the pyramid.  The dense SoA sweep
+	// can reduce them as it writes them; everything else takes a pass.
+	const bool refreshPyramid = mbPyramidEnabled && numSteps > 0;
+	bool pyramidBaseDone = false;
+
+	while (numSteps > 0)
+	{
+		const UINT k = MathHelper::Min(numSteps, stepsPerPass);
+		if (k > 1)
+		{
+			StepBlocked(k);
+		}
+		else
+		{
+			mbPyramidInStep = refreshPyramid && blocking && numSteps == 1;
+			Step();
+			pyramidBaseDone = mbPyramidInStep;
+			mbPyramidInStep = false;
+
+			if (mBoundary == BOUNDARY_ABSORBING)
+			{
+				ApplySponge();
+			}
+		}
+		numSteps -= k;
+	}
+
+	if (refreshPyramid)
+	{
+		if (!pyramidBaseDone)
+		{
+			ReducePyramidBase();
+		}
+		ReducePyramidUpper();
+	}
+}
+
+void Waves::StepBlocked(UINT numSteps)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+
+	// Normals need one more ring of final heights around each tile.
+	const UINT halo = numSteps + (mbNormalsEnabled ? 1 : 0);
+
+	// Tiles are a strip of columns wide enough for long SIMD runs, and as
+	// many rows as let both scratch arrays fit the tile budget.  The halo is
+	// recomputed by both neighbours, so keep tiles at least twice its size.
+	const UINT tileCols = MathHelper::Max(MathHelper::Min(n - 2, PassTileCols), 2 * halo);
+	const UINT scratchPitch = (tileCols + 2 * halo + 2 + FloatsPerLine - 1) / FloatsPerLine * FloatsPerLine;
+	const UINT budgetRows = PassTileBytes / (2 * scratchPitch * sizeof(float));
+	const UINT tileRows = MathHelper::Max(budgetRows > 4 * halo ? budgetRows - 2 * halo : 0, 2 * halo);
+
+	const UINT tilesDown = (m - 2 + tileRows - 1) / tileRows;
+	const UINT tilesAcross = (n - 2 + tileCols - 1) / tileCols;
+	const UINT numTiles = tilesDown * tilesAcross;
+	const UINT numSlots = MathHelper::Min(ThreadCount(), numTiles);
+
+	if (mPassPrevHeights == NULL)
+	{
+		mPassPrevHeights = AllocHeights(m * mRowPitch);
+		mPassCurrHeights = AllocHeights(m * mRowPitch);
+	}
+
+	const UINT slotFloats = (tileRows + 2 * halo) * scratchPitch;
+	if (mPassScratchFloats < 2 * slotFloats * numSlots)
+	{
+		_aligned_free(mPassScratch);
+		mPassScratchFloats = 2 * slotFloats * numSlots;
+		mPassScratch = AllocHeights(mPassScratchFloats);
+	}
+
+	// Tiles are dealt out round-robin so each slot owns one scratch pair.
+	auto slot = [=](UINT s)
+	{
+		PassTile tile;
+		tile.Halo = halo;
+		tile.ScratchPrev = mPassScratch + 2 * s * slotFloats;
+		tile.ScratchCurr = tile.ScratchPrev + slotFloats;
+		tile.ScratchPitch = scratchPitch;
+
+		for (UINT t = s; t < numTiles; t += numSlots)
+		{
+			const UINT ty = t / tilesAcross;
+			const UINT tx = t - ty * tilesAcross;
+			tile.RowBegin = 1 + ty * tileRows;
+			tile.RowEnd = MathHelper::Min(tile.RowBegin + tileRows, m - 1);
+			tile.ColBegin = 1 + tx * tileCols;
+			tile.ColEnd = MathHelper::Min(tile.ColBegin + tileCols, n - 1);
+			StepBlockedTile(numSteps, tile);
+		}
+	};
+
+	if (mThreadPool != NULL && numSlots > 1)
+	{
+		mThreadPool->ParallelFor(numSlots, slot);
+	}
+	else
+	{
+		slot(0);
+	}
+
+	std::swap(mPrevHeights, mPassPrevHeights);
+	std::swap(mCurrHeights, mPassCurrHeights);
+}
+
+void Waves::StepBlockedTile(UINT numSteps, const PassTile& tile)
+{
+	const UINT m = mNumRows;
+	const UINT n = mNumCols;
+	const UINT pitch = mRowPitch;
+	const UINT spitch = tile.ScratchPitch;
+
+	// Load the tile plus its halo; the fixed boundary cells come along when
+	// the halo reaches them.
+	const UINT halo = tile.Halo;
+	const UINT firstRow = tile.RowBegin > halo ? tile.RowBegin - halo : 0;
+	const UINT lastRow = MathHelper::Min(tile.RowEnd + halo, m);
+	const UINT firstCol = tile.ColBegin > halo ? tile.ColBegin - halo : 0;
+	const UINT lastCol = MathHelper::Min(tile.ColEnd + halo, n);
+
+	const UINT loadBytes = (lastCol - firstCol) * sizeof(float);
+	for (UINT i = firstRow; i < lastRow; ++i)
+	{
+		const UINT r = i - firstRow;
+		CopyMemory(tile.ScratchPrev + r * spitch, mPrevHeights + i * pitch + firstCol, loadBytes);
+		CopyMemory(tile.ScratchCurr + r * spitch, mCurrHeights + i * pitch + firstCol, loadBytes);
+	}
+
+	float* prev = tile.ScratchPrev;
+	float* curr = tile.ScratchCurr;
+	for (UINT s = 0; s < numSteps; ++s)
+	{
+		// Each step can trust one cell less of halo on every side.
+		const UINT shrink = halo - s - 1;
+		const UINT lo = MathHelper::Max(tile.RowBegin > shrink ? tile.RowBegin - shrink : 0, 1u);
+		const UINT hi = MathHelper::Min(tile.RowEnd + shrink, m - 1);
+		const UINT left = MathHelper::Max(tile.ColBegin > shrink ? tile.ColBegin - shrink : 0, 1u);
+		const UINT right = MathHelper::Min(tile.ColEnd + shrink, n - 1);
+
+		for (UINT i = lo; i < hi; ++i)
+		{
+			const UINT r = i - firstRow;
+			auto span = [=](UINT colBegin, UINT colEnd)
+			{
+				const UINT c = colBegin - firstCol;
+				WavesKernels::StepRow(
+					prev + r * spitch + c,
+					curr + (r - 1) * spitch + c,
+					curr + r * spitch + c,
+					curr + (r + 1) * spitch + c,
+					colEnd - colBegin, 1, mK1, mK2, mK3);
+			};
+			ForEachWetSpan(i, left, right, span);
+		}
+
+		std::swap(prev, curr);
+	}
+
+	const UINT c = tile.ColBegin - firstCol;
+	const UINT storeBytes = (tile.ColEnd - tile.ColBegin) * sizeof(float);
+	const float invTwoDx = 0.5f / mSpatialStep;
+	for (UINT i = tile.RowBegin; i < tile.RowEnd; ++i)
+	{
+		const UINT r = i - firstRow;
+		CopyMemory(mPassPrevHeights + i * pitch + tile.ColBegin, prev + r * spitch + c, storeBytes);
+		CopyMemory(mPassCurrHeights + i * pitch + tile.ColBegin, curr + r * spitch + c, storeBytes);
+
+		// The extra halo ring keeps the neighbours of every tile cell valid.
+		if (mbNormalsEnabled)
+		{
+			const UINT k = i * mNormalPitch + tile.ColBegin;
+			WavesKernels::NormalRow(
+				curr + (r - 1) * spitch + c,
+				curr + r * spitch + c,
+				curr + (r + 1) * spitch + c,
+				tile.ColEnd - tile.ColBegin, 1, invTwoDx,
+				mNormals[0] + k, mNormals[1] + k, mNormals[2] + k,
+				mTangents[0] + k, mTangents[1] + k);
+		}
+	}
+}
+
+void Waves::StepRows(UINT rowBegin, UINT rowEnd)
+{
+	const UINT stride = mHeightStride;
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element)
+		// bucause we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z; h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to
+		// keep consistent with our row indices going down.
+
+		auto span = [this, i, stride](UINT colBegin, UINT colEnd)
+		{
+			WavesKernels::StepRow(
+				&Height(mPrevHeights, i, colBegin),
+				&Height(mCurrHeights, i - 1, colBegin),
+				&Height(mCurrHeights, i, colBegin),
+				&Height(mCurrHeights, i + 1, colBegin),
+				colEnd - colBegin, stride, mK1, mK2, mK3);
+		};
+		ForEachWetSpan(i, 1, mNumCols - 1, span);
+
+		// Row i completes the new neighbourhood of row i - 1, whose heights
+		// are still in cache.
+		if (mbNormalsEnabled && i >= rowBegin + 2)
+		{
+			NormalRows(mPrevHeights, i - 1, i);
+		}
+
+		// An odd row completes the pair i - 1, i of the pyramid base.
+		if (mbPyramidInStep && (i & 1) != 0 && i > rowBegin)
+		{
+			ReducePyramidPair(mPrevHeights, i / 2);
+		}
+	}
+}
+
+void Waves::WriteVertices(void* dest, UINT stride, UINT positionOffset, UINT normalOffset, UINT attributes) const
+{
+	assert((attributes & VERTEX_NORMAL) == 0 || mbNormalsEnabled);
+
+	const UINT n = mNumCols;
+	BYTE* base = static_cast<BYTE*>(dest);
+
+	// Packed heights are widened a chunk at a time on the stack.
+	const UINT ChunkCols = 256;
+	float widened[ChunkCols];
+
+	for (UINT i = 0; i < mNumRows; ++i)
+	{
+		for (UINT c0 = 0; c0 < n; c0 += ChunkCols)
+		{
+			const UINT count = MathHelper::Min(n - c0, ChunkCols);
+			BYTE* v = base + (i * n + c0) * stride;
+
+			if (attributes & (VERTEX_POSITION | VERTEX_HEIGHT))
+			{
+				const float* h = widened;
+				UINT hStride = 1;
+				if (IsPacked())
+				{
+					WavesKernels::UnpackRow(mCurrPacked + i * mRowPitch + c0, widened, count,
+						PackFormatOf(mStorage), mHeightScale);
+				}
+				else
+				{
+					h = &Height(mCurrHeights, i, c0);
+					hStride = mHeightStride;
+				}
+
+				if (attributes & VERTEX_POSITION)
+				{
+					WavesKernels::StreamFloat3Row(v + positionOffset, stride, count,
+						mColumnX + c0, 1, h, hStride, mRowZ + i, 0);
+				}
+				else
+				{
+					WavesKernels::StreamFloatRow(v + positionOffset + sizeof(float), stride, count, h, hStride);
+				}
+			}
+
+			if (attributes & VERTEX_NORMAL)
+			{
+				const UINT k = i * mNormalPitch + c0;
+				WavesKernels::StreamFloat3Row(v + normalOffset, stride, count,
+					mNormals[0] + k, 1, mNormals[1] + k, 1, mNormals[2] + k, 1);
+			}
+		}
+	}
+
+	WavesKernels::EndStreaming();
+}
+
+void Waves::ReadHeights(float* dest, UINT destPitch) const
+{
+	const UINT n = mNumCols;
+
+	for (UINT i = 0; i < mNumRows; ++i)
+	{
+		float* row = dest + i * destPitch;
+		if (IsPacked())
+		{
+			WavesKernels::UnpackRow(mCurrPacked + i * mRowPitch, row, n, PackFormatOf(mStorage), mHeightScale);
+		}
+		else if (mHeightStride == 1)
+		{
+			CopyMemory(row, mCurrHeights + i * mRowPitch, n * sizeof(float));
+		}
+		else
+		{
+			for (UINT j = 0; j < n; ++j)
+			{
+				row[j] = Height(mCurrHeights, i, j);
+			}
+		}
+	}
+}
+
+void Waves::SampleHeights(const float* x, const float* z, float* outH,
+	float* outGradX, float* outGradZ, UINT count, ThreadPool* pool) const
+{
+	if (pool == NULL || count < MinParallelSamples)
+	{
+		SamplePoints(x, z, outH, outGradX, outGradZ, count);
+		return;
+	}
+
+	auto band = [=](UINT b)
+	{
+		const UINT k = b * SampleBandPoints;
+		SamplePoints(x + k, z + k, outH + k,
+			outGradX != NULL ? outGradX + k : NULL,
+			outGradZ != NULL ? outGradZ + k : NULL,
+			MathHelper::Min(count - k, SampleBandPoints));
+	};
+	pool->ParallelFor((count + SampleBandPoints - 1) / SampleBandPoints, band);
+}
+
+void Waves::SamplePoints(const float* x, const float* z, float* outH,
+	float* outGradX, float* outGradZ, UINT count) const
+{
+	float gradX[SampleChunkPoints];
+	float gradZ[SampleChunkPoints];
+
+	WavesKernels::SampleGrid grid;
+	grid.Heights = mCurrHeights;
+	grid.Pitch = mRowPitch;
+	grid.Stride = mHeightStride;
+	grid.Rows = mNumRows;
+	grid.Cols = mNumCols;
+	grid.OriginX = mColumnX[0];
+	grid.OriginZ = mRowZ[0];
+	grid.InvDx = 1.f / mSpatialStep;
+
+	for (UINT k = 0; k < count; k += SampleChunkPoints)
+	{
+		const UINT chunk = MathHelper::Min(count - k, SampleChunkPoints);
+		float* gx = outGradX != NULL ? outGradX + k : gradX;
+		float* gz = outGradZ != NULL ? outGradZ + k : gradZ;
+
+		if (IsPacked())
+		{
+			SamplePacked(x + k, z + k, outH + k, gx, gz, chunk);
+		}
+		else
+		{
+			WavesKernels::BilinearRow(grid, x + k, z + k, chunk, outH + k, gx, gz);
+		}
+	}
+}
+
+void Waves::SamplePacked(const float* x, const float* z, float* outH,
+	float* outGradX, float* outGradZ, UINT count) const
+{
+	// Same arithmetic as WavesKernels::BilinearRow().
+	const float invDx = 1.f / mSpatialStep;
+	const float maxU = (float)(mNumCols - 1);
+	const float maxV = (float)(mNumRows - 1);
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		float u = (x[k] - mColumnX[0]) * invDx;
+		float v = (mRowZ[0] - z[k]) * invDx;
+		u = u > 0.f ? u : 0.f;
+		v = v > 0.f ? v : 0.f;
+		u = u < maxU ? u : maxU;
+		v = v < maxV ? v : maxV;
+		const UINT j = MathHelper::Min((UINT)u, mNumCols - 2);
+		const UINT i = MathHelper::Min((UINT)v, mNumRows - 2);
+		const float s = u - j;
+		const float t = v - i;
+
+		const float h00 = PackedHeight(i, j);
+		const float h01 = PackedHeight(i, j + 1);
+		const float h10 = PackedHeight(i + 1, j);
+		const float h11 = PackedHeight(i + 1, j + 1);
+
+		const float d0 = h01 - h00;
+		const float d1 = h11 - h10;
+		const float a = h00 + s * d0;
+		const float b = h10 + s * d1;
+		outH[k] = a + t * (b - a);
+		outGradX[k] = (d0 + t * (d1 - d0)) * invDx;
+		outGradZ[k] = (a - b) * invDx;
+	}
+}
+
+bool Waves::IsPacked() const
+{
+	return mStorage == STORAGE_FP16 || mStorage == STORAGE_FIXED16;
+}
+
+void Waves::AllocPackScratch(UINT numBands)
+{
+	if (mPackScratchBands >= numBands)
+	{
+		return;
+	}
+
+	_aligned_free(mPackScratch);
+	mPackScratch = AllocHeights(numBands * PackedWindowRows * mPackScratchPitch);
+	mPackScratchBands = numBands;
+}
+
+void Waves::StepPackedRows(UINT rowBegin, UINT rowEnd, float* scratch)
+{
+	const UINT n = mNumCols;
+	const WavesKernels::PackFormat format = PackFormatOf(mStorage);
+
+	// Rolling window of widened current rows; each is converted once per
+	// band, plus two rows of overlap at the band edges.
+	float* up = scratch;
+	float* curr = up + mPackScratchPitch;
+	float* down = curr + mPackScratchPitch;
+	float* prev = down + mPackScratchPitch;
+
+	WavesKernels::UnpackRow(mCurrPacked + (rowBegin - 1) * mRowPitch, up, n, format, mHeightScale);
+	WavesKernels::UnpackRow(mCurrPacked + rowBegin * mRowPitch, curr, n, format, mHeightScale);
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		USHORT* prevRow = mPrevPacked + i * mRowPitch;
+		WavesKernels::UnpackRow(mCurrPacked + (i + 1) * mRowPitch, down, n, format, mHeightScale);
+		WavesKernels::UnpackRow(prevRow + 1, prev + 1, n - 2, format, mHeightScale);
+
+		// Dry cells unpack as zero and are packed back untouched.
+		auto span = [=](UINT colBegin, UINT colEnd)
+		{
+			WavesKernels::StepRow(prev + colBegin, up + colBegin, curr + colBegin, down + colBegin,
+				colEnd - colBegin, 1, mK1, mK2, mK3);
+		};
+		ForEachWetSpan(i, 1, n - 1, span);
+
+		WavesKernels::PackRow(prev + 1, prevRow + 1, n - 2, format, mHeightScale);
+
+		float* oldUp = up;
+		up = curr;
+		curr = down;
+		down = oldUp;
+	}
+}
+
+void Waves::NormalPackedRows(UINT rowBegin, UINT rowEnd, float* scratch)
+{
+	const UINT n = mNumCols;
+	const WavesKernels::PackFormat format = PackFormatOf(mStorage);
+	const float invTwoDx = 0.5f / mSpatialStep;
+
+	float* up = scratch;
+	float* curr = up + mPackScratchPitch;
+	float* down = curr + mPackScratchPitch;
+
+	WavesKernels::UnpackRow(mCurrPacked + (rowBegin - 1) * mRowPitch, up, n, format, mHeightScale);
+	WavesKernels::UnpackRow(mCurrPacked + rowBegin * mRowPitch, curr, n, format, mHeightScale);
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		WavesKernels::UnpackRow(mCurrPacked + (i + 1) * mRowPitch, down, n, format, mHeightScale);
+
+		const UINT k = i * mNormalPitch + 1;
+		WavesKernels::NormalRow(up + 1, curr + 1, down + 1, n - 2, 1, invTwoDx,
+			mNormals[0] + k, mNormals[1] + k, mNormals[2] + k,
+			mTangents[0] + k, mTangents[1] + k);
+
+		float* oldUp = up;
+		up = curr;
+		curr = down;
+		down = oldUp;
+	}
+}
+
+float Waves::PackedHeight(UINT i, UINT j) const
+{
+	return WavesKernels::UnpackHeight(mCurrPacked[i * mRowPitch + j], PackFormatOf(mStorage), mHeightScale);
+}
+
+void Waves::AddHeight(UINT i, UINT j, float v)
+{
+	// Land never moves.
+	if (!IsWet(i, j))
+	{
+		return;
+	}
+
+	if (IsPacked())
+	{
+		const WavesKernels::PackFormat format = PackFormatOf(mStorage);
+		USHORT& h = mCurrPacked[i * mRowPitch + j];
+		h = WavesKernels::PackHeight(WavesKernels::UnpackHeight(h, format, mHeightScale) + v, format, mHeightScale);
+	}
+	else
+	{
+		Height(mCurrHeights, i, j) += v;
+	}
+}
+
+void Waves::Disturb(UINT i, UINT j, float magnitude)
+{
+	// Don't disturb boundaries.
+	assert(i > 1 && i < mNumRows - 2);
+	assert(j > 1 && j < mNumCols - 2);
+
+	float halfMag = 0.5f * magnitude;
+
+	// Disturb the ijth vertex height and its neighbors.
+	AddHeight(i, j, magnitude);
+	AddHeight(i, j + 1, halfMag);
+	AddHeight(i, j - 1, halfMag);
+	AddHeight(i + 1, j, halfMag);
+	AddHeight(i - 1, j, halfMag);
+
+	if (mbActivityTracking)
+	{
+		WakeTiles(i, j);
+	}
+}
+
+void Waves::ReadEdge(Edge e, float* dest) const
+{
+	const bool horizontal = e == EDGE_TOP || e == EDGE_BOTTOM;
+	const UINT count = horizontal ? mNumCols - 2 : mNumRows - 2;
+	const UINT fixed = (e == EDGE_TOP || e == EDGE_LEFT) ? 1 : (horizontal ? mNumRows : mNumCols) - 2;
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		const UINT i = horizontal ? fixed : k + 1;
+		const UINT j = horizontal ? k + 1 : fixed;
+		dest[k] = IsPacked() ? PackedHeight(i, j) : Height(mCurrHeights, i, j);
+	}
+}
+
+void Waves::WriteHalo(Edge e, const float* src)
+{
+	const bool horizontal = e == EDGE_TOP || e == EDGE_BOTTOM;
+	const UINT count = horizontal ? mNumCols - 2 : mNumRows - 2;
+	const UINT fixed = (e == EDGE_TOP || e == EDGE_LEFT) ? 0 : (horizontal ? mNumRows : mNumCols) - 1;
+
+	bool moving = false;
+	for (UINT k = 0; k < count; ++k)
+	{
+		const UINT i = horizontal ? fixed : k + 1;
+		const UINT j = horizontal ? k + 1 : fixed;
+		if (IsPacked())
+		{
+			mCurrPacked[i * mRowPitch + j] = WavesKernels::PackHeight(src[k], PackFormatOf(mStorage), mHeightScale);
+		}
+		else
+		{
+			Height(mCurrHeights, i, j) = src[k];
+		}
+		moving |= src[k] != 0.f;
+	}
+
+	// Motion arriving through the halo wakes the tiles along that edge.
+	if (mbActivityTracking && moving)
+	{
+		if (horizontal)
+		{
+			const UINT row = fixed == 0 ? 0 : mNumRows - 2;
+			WakeTiles(row, row + 2, 0, mNumCols);
+		}
+		else
+		{
+			const UINT col = fixed == 0 ? 0 : mNumCols - 2;
+			WakeTiles(0, mNumRows, col, col + 2);
+		}
+	}
+}
+
+void Waves::ReadRegion(TimeLevel level, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+	float* dest, UINT pitch) const
+{
+	assert(rowEnd <= mNumRows && colEnd <= mNumCols);
+
+	const UINT count = colEnd - colBegin;
+	const bool current = level == LEVEL_CURRENT;
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		float* row = dest + (i - rowBegin) * pitch;
+		if (IsPacked())
+		{
+			const USHORT* packed = (current ? mCurrPacked : mPrevPacked) + i * mRowPitch;
+			WavesKernels::UnpackRow(packed + colBegin, row, count, PackFormatOf(mStorage), mHeightScale);
+		}
+		else
+		{
+			const float* heights = current ? mCurrHeights : mPrevHeights;
+			for (UINT j = colBegin; j < colEnd; ++j)
+			{
+				row[j - colBegin] = Height(heights, i, j);
+			}
+		}
+	}
+}
+
+void Waves::WriteRegion(TimeLevel level, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+	const float* src, UINT pitch)
+{
+	assert(rowEnd <= mNumRows && colEnd <= mNumCols);
+
+	const UINT count = colEnd - colBegin;
+	const bool current = level == LEVEL_CURRENT;
+
+	for (UINT i = rowBegin; i < rowEnd; ++i)
+	{
+		const float* row = src + (i - rowBegin) * pitch;
+		if (IsPacked())
+		{
+			USHORT* packed = (current ? mCurrPacked : mPrevPacked) + i * mRowPitch;
+			WavesKernels::PackRow(row, packed + colBegin, count, PackFormatOf(mStorage), mHeightScale);
+		}
+		else
+		{
+			float* heights = current ? mCurrHeights : mPrevHeights;
+			for (UINT j = colBegin; j < colEnd; ++j)
+			{
+				Height(heights, i, j) = row[j - colBegin];
+			}
+		}
+
+		// Land never moves.
+		if (!mWetMask.empty())
+		{
+			for (UINT j = colBegin; j < colEnd; ++j)
+			{
+				if (IsWet(i, j))
+				{
+					continue;
+				}
+				if (IsPacked())
+				{
+					(current ? mCurrPacked : mPrevPacked)[i * mRowPitch + j] =
+						WavesKernels::PackHeight(0.f, PackFormatOf(mStorage), mHeightScale);
+				}
+				else
+				{
+					Height(current ? mCurrHeights : mPrevHeights, i, j) = 0.f;
+				}
+			}
+		}
+	}
+
+	if (mbActivityTracking && rowBegin < rowEnd && colBegin < colEnd)
+	{
+		WakeTiles(rowBegin, rowEnd, colBegin, colEnd);
+	}
+}
+
+void Waves::DisturbBatch(const Impulse* impulses, UINT count)
+{
+	mBatch.clear();
+	mBatchWeights.clear();
+	mBatchMaxReach = 0;
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		AddBatchImpulse((float)impulses[k].Row, (float)impulses[k].Col,
+			impulses[k].Magnitude, impulses[k].Radius);
+	}
+
+	ApplyBatch();
+}
+
+void Waves::DisturbBatch(const WorldImpulse* impulses, UINT count)
+{
+	mBatch.clear();
+	mBatchWeights.clear();
+	mBatchMaxReach = 0;
+
+	// Invert the grid layout from Init(): x = -halfWidth + j * dx,
+	// z = halfDepth - i * dx.
+	const float invDx = 1.f / mSpatialStep;
+	const float halfWidth = (mNumCols - 1) * mSpatialStep * 0.5f;
+	const float halfDepth = (mNumRows - 1) * mSpatialStep * 0.5f;
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		float row = (halfDepth - impulses[k].Z) * invDx;
+		float col = (impulses[k].X + halfWidth) * invDx;
+		const float radius = impulses[k].Radius * invDx;
+
+		if (radius <= 0.f)
+		{
+			row = floorf(row + 0.5f);
+			col = floorf(col + 0.5f);
+		}
+
+		// Entirely off the grid.
+		const float reach = 2.f * radius + 1.f;
+		if (row + reach < 0.f || col + reach < 0.f ||
+			row - reach > (float)mNumRows || col - reach > (float)mNumCols)
+		{
+			continue;
+		}
+
+		AddBatchImpulse(row, col, impulses[k].Magnitude, radius);
+	}
+
+	ApplyBatch();
+}
+
+void Waves::AddBatchImpulse(float centerRow, float centerCol, float magnitude, float radius)
+{
+	// Footprint half-size in cells.
+	const float reach = radius > 0.f ? 2.f * radius : 1.f;
+
+	// Clip to the interior; boundary cells stay at zero.
+	const float lastRow = (float)(mNumRows - 2);
+	const float lastCol = (float)(mNumCols - 2);
+	const float r0 = MathHelper::Max(ceilf(centerRow - reach), 1.f);
+	const float r1 = MathHelper::Min(floorf(centerRow + reach), lastRow);
+	const float c0 = MathHelper::Max(ceilf(centerCol - reach), 1.f);
+	const float c1 = MathHelper::Min(floorf(centerCol + reach), lastCol);
+	if (r0 > r1 || c0 > c1)
+	{
+		return;
+	}
+
+	BatchImpulse b;
+	b.RowBegin = (UINT)r0;
+	b.RowEnd = (UINT)r1 + 1;
+	b.ColBegin = (UINT)c0;
+	b.ColEnd = (UINT)c1 + 1;
+	b.CenterRow = centerRow;
+	b.CenterCol = centerCol;
+	b.Magnitude = magnitude;
+	b.InvRadiusSq = 0.f;
+	b.WeightOffset = 0;
+
+	// The Gaussian is separable; the column factor is shared by every row.
+	if (radius > 0.f)
+	{
+		b.InvRadiusSq = 1.f / (radius * radius);
+		b.WeightOffset = (UINT)mBatchWeights.size();
+		for (UINT j = b.ColBegin; j < b.ColEnd; ++j)
+		{
+			const float d = (float)j - centerCol;
+			mBatchWeights.push_back(magnitude * expf(-d * d * b.InvRadiusSq));
+		}
+	}
+
+	mBatchMaxReach = MathHelper::Max(mBatchMaxReach, b.RowEnd - b.RowBegin);
+	mBatch.push_back(b);
+}
+
+void Waves::ApplyBatch()
+{
+	if (mBatch.empty())
+	{
+		return;
+	}
+
+	// Row order keeps each band's writes together and makes the per-cell
+	// summation order independent of how rows are split.  A counting sort on
+	// the first row is linear and stable.
+	mBatchRowStart.assign(mNumRows + 1, 0);
+	for (size_t k = 0; k < mBatch.size(); ++k)
+	{
+		++mBatchRowStart[mBatch[k].RowBegin + 1];
+	}
+	for (UINT i = 0; i < mNumRows; ++i)
+	{
+		mBatchRowStart[i + 1] += mBatchRowStart[i];
+	}
+
+	mBatchSorted.resize(mBatch.size());
+	for (size_t k = 0; k < mBatch.size(); ++k)
+	{
+		mBatchSorted[mBatchRowStart[mBatch[k].RowBegin]++] = mBatch[k];
+	}
+
+	// The scatter advanced every start to the next row's; shift them back.
+	for (UINT i = mNumRows; i > 0; --i)
+	{
+		mBatchRowStart[i] = mBatchRowStart[i - 1];
+	}
+	mBatchRowStart[0] = 0;
+
+	const UINT interiorRows = mNumRows - 2;
+	const UINT maxBands = interiorRows / MinRowsPerBand;
+	const UINT numBands = MathHelper::Min(ThreadCount() * BandsPerThread, maxBands);
+
+	if (mThreadPool == NULL || numBands <= 1 || mBatch.size() < numBands)
+	{
+		ApplyBatchRows(1, mNumRows - 1);
+	}
+	else
+	{
+		auto band = [this, interiorRows, numBands](UINT b)
+		{
+			const UINT rowBegin = 1 + interiorRows * b / numBands;
+			const UINT rowEnd = 1 + interiorRows * (b + 1) / numBands;
+			ApplyBatchRows(rowBegin, rowEnd);
+		};
+		mThreadPool->ParallelFor(numBands, band);
+	}
+
+	if (mbActivityTracking)
+	{
+		for (size_t k = 0; k < mBatchSorted.size(); ++k)
+		{
+			const BatchImpulse& b = mBatchSorted[k];
+			WakeTiles(b.RowBegin, b.RowEnd, b.ColBegin, b.ColEnd);
+		}
+	}
+}
+
+void Waves::ApplyBatchRows(UINT rowBegin, UINT rowEnd)
+{
+	// Impulses are sorted by first row and none spans more than
+	// mBatchMaxReach rows, so earlier ones cannot reach this band.
+	const UINT firstRow = rowBegin > mBatchMaxReach ? rowBegin - mBatchMaxReach : 0;
+	const UINT end = mBatchRowStart[rowEnd];
+
+	for (UINT k = mBatchRowStart[firstRow]; k < end; ++k)
+	{
+		const BatchImpulse& b = mBatchSorted[k];
+		const UINT r0 = MathHelper::Max(b.RowBegin, rowBegin);
+		const UINT r1 = MathHelper::Min(b.RowEnd, rowEnd);
+
+		for (UINT i = r0; i < r1; ++i)
+		{
+			if (b.InvRadiusSq == 0.f)
+			{
+				// Same 5-point splat as Disturb().
+				const UINT ci = (UINT)b.CenterRow;
+				const UINT cj = (UINT)b.CenterCol;
+				const float halfMag = 0.5f * b.Magnitude;
+				if (i != ci)
+				{
+					if (cj >= b.ColBegin && cj < b.ColEnd)
+					{
+						AddHeight(i, cj, halfMag);
+					}
+					continue;
+				}
+
+				for (UINT j = b.ColBegin; j < b.ColEnd; ++j)
+				{
+					AddHeight(i, j, j == cj ? b.Magnitude : halfMag);
+				}
+				continue;
+			}
+
+			const float d = (float)i - b.CenterRow;
+			const float rowWeight = expf(-d * d * b.InvRadiusSq);
+			const float* colWeights = &mBatchWeights[b.WeightOffset];
+			for (UINT j = b.ColBegin; j < b.ColEnd; ++j)
+			{
+				AddHeight(i, j, rowWeight * colWeights[j - b.ColBegin]);
+			}
+		}
+	}
 }
@@ -1,11 +1,140 @@
-#pragma
+#pragma once
 
 #include <Windows.h>
 #include <xnamath.h>
+#include <vector>
+
+#include "FixedStepClock.h"
+
+class ThreadPool;
 
 class Waves
 {
 public:
+	// Grid-space impulse: Radius is in cells; 0 applies the same 5-point
+	// splat as Disturb(), otherwise a Gaussian exp(-d^2 / Radius^2) cut off
+	// at 2 * Radius.
+	struct Impulse
+	{
+		UINT Row;
+		UINT Col;
+		float Magnitude;
+		float Radius;
+	};
+
+	// World-space impulse in the grid's local xz-plane; Radius is in world
+	// units and 0 snaps to the nearest cell for a 5-point splat.
+	struct WorldImpulse
+	{
+		float X;
+		float Z;
+		float Magnitude;
+		float Radius;
+	};
+
+	// Memory layout of the solution buffers.
+	enum StorageMode
+	{
+		// One XMFLOAT3 per grid point.
+		STORAGE_AOS,
+
+		// Heights only, in 64-byte aligned rows.  x and z never change so they
+		// are rebuilt from the grid and the stencil streams nothing but heights.
+		STORAGE_SOA,
+
+		// SoA rows of 16-bit heights, a quarter of the float traffic of
+		// STORAGE_SOA.  Rows are widened to fp32 in a small per-thread window,
+		// stepped with the usual kernel and rounded back, so results are the
+		// same on every machine and thread count.  Steps always run densely
+		// and one at a time (no activity tracking or temporal blocking).
+		STORAGE_FP16,
+
+		// As STORAGE_FP16 but heights are signed 16-bit multiples of the
+		// height scale passed to Init(); the range is +-32768 * scale and
+		// larger heights saturate.
+		STORAGE_FIXED16,
+	};
+
+	// Vertex attributes WriteVertices() can fill.
+	enum VertexAttribute
+	{
+		// x, y and z of the position.
+		VERTEX_POSITION = 1,
+
+		// Only y; x and z never change, so a buffer that keeps its contents
+		// between frames can have them written once and marked static.
+		VERTEX_HEIGHT = 2,
+
+		// Unit normal, needs SetNormalsEnabled(true).
+		VERTEX_NORMAL = 4,
+	};
+
+	// Grid edges: row 0, row m - 1, column 0 and column n - 1.
+	enum Edge
+	{
+		EDGE_TOP,
+		EDGE_BOTTOM,
+		EDGE_LEFT,
+		EDGE_RIGHT,
+	};
+
+	// The two solution time levels: after a step, current holds the new
+	// heights and previous the ones they replaced.
+	enum TimeLevel
+	{
+		LEVEL_CURRENT,
+		LEVEL_PREVIOUS,
+	};
+
+	// Reductions kept by the height pyramid.
+	enum PyramidReduction
+	{
+		PYRAMID_MIN,
+		PYRAMID_MAX,
+		PYRAMID_AVERAGE,
+	};
+
+	// Time integration scheme, chosen in Init().
+	enum Integrator
+	{
+		// Leapfrog stencil.  Stable only while speed * dt / dx < 1 / sqrt(2).
+		INTEGRATOR_EXPLICIT,
+
+		// Alternating-direction implicit scheme (Lees, theta = 1/4): the new
+		// heights come from a tridiagonal solve along every row and then every
+		// column.  Unconditionally stable, so dt can be several times the
+		// explicit limit, though phase accuracy still drops as speed * dt / dx
+		// grows.  Always uses STORAGE_SOA and runs dense single steps (no
+		// activity tracking or temporal blocking).  Halo values written by
+		// WriteHalo() are held for the whole step, so tiled grids only
+		// approximate one large grid in this mode.
+		INTEGRATOR_ADI,
+	};
+
+	// Treatment of the grid edges, chosen in Init().
+	enum Boundary
+	{
+		// The outer ring of cells is held fixed: zero, or halo values written
+		// by WriteHalo().  Waves reflect off it.
+		BOUNDARY_FIXED,
+
+		// The grid wraps around in both directions with a period of m - 1 rows
+		// and n - 1 columns.  The last row and column repeat the first, so
+		// copies of the grid placed (n - 1) * dx apart tile without a seam and
+		// one small patch can be instanced over a whole ocean.  Needs
+		// INTEGRATOR_EXPLICIT and fp32 storage (STORAGE_AOS or STORAGE_SOA);
+		// steps run dense and one at a time, and the land mask is ignored.
+		BOUNDARY_PERIODIC,
+
+		// The outer ring is fixed as for BOUNDARY_FIXED, but a sponge layer
+		// of spongeWidth cells (see Init()) inside it damps both time levels
+		// a little more every cell closer to the edge, so outgoing waves fade
+		// instead of coming back.  The grid only has to cover the region of
+		// interest plus the rim.  Needs fp32 storage (STORAGE_AOS or
+		// STORAGE_SOA, or INTEGRATOR_ADI) and runs one step at a time.
+		BOUNDARY_ABSORBING,
+	};
+
 	Waves();
 	~Waves();
 
@@ -13,14 +142,395 @@ public:
 	UINT ColumnCount() const;
 	UINT VertexCount() const;
 	UINT TriangleCount() const;
+	StorageMode Storage() const;
+	Integrator TimeIntegrator() const;
+	Boundary BoundaryMode() const;
+	float TimeStep() const;
+	float SpatialStep() const;
 
 	// Returns the solution at the ith grid point.
-	const XMFLOAT3& operator[](int i) const { return mCurrSolution[i]; }
+	XMFLOAT3 operator[](int i) const
+	{
+		if (mStorage == STORAGE_AOS)
+		{
+			return mCurrSolution[i];
+		}
+
+		const UINT row = i / mNumCols;
+		const UINT col = i - row * mNumCols;
+		const float y = mStorage == STORAGE_SOA ? mCurrHeights[row * mRowPitch + col] : PackedHeight(row, col);
+		return XMFLOAT3(mColumnX[col], y, mRowZ[row]);
+	}
+
+	///<summary>
+	/// Writes the current solution straight into caller memory laid out as
+	/// VertexCount() vertices of stride bytes, e.g. a mapped vertex buffer.
+	/// Only the attributes in the VertexAttribute mask are touched; the rest
+	/// of each vertex is left as it is.  Uses non-temporal stores so the
+	/// destination does not displace the solver's data from the cache.
+	///</summary>
+	void WriteVertices(void* dest, UINT stride, UINT positionOffset, UINT normalOffset, UINT attributes) const;
+
+	// Copies the current heights as fp32 rows of destPitch floats, whatever
+	// the storage mode.
+	void ReadHeights(float* dest, UINT destPitch) const;
+
+	///<summary>
+	/// Height and slope (dh/dx, dh/dz) at count points (x[k], z[k]) in the
+	/// grid's local xz-plane, bilinear between the four grid points around
+	/// each, for buoyancy of many floating objects at once.  Points off the
+	/// grid are clamped to its edge and either gradient array may be NULL.
+	///
+	/// Large batches are split across pool if one is given; a point's result
+	/// does not depend on the split.  The grid's own pool is never used, so
+	/// any number of threads may sample the same grid at once, but not while
+	/// it steps or is otherwise modified.  pool must not be running another
+	/// ParallelFor, e.g. a step of this grid if it is the grid's own pool.
+	///</summary>
+	void SampleHeights(const float* x, const float* z, float* outH,
+		float* outGradX, float* outGradZ, UINT count, ThreadPool* pool = NULL) const;
+
+	// heightScale is the height of one STORAGE_FIXED16 unit; the other
+	// storage modes ignore it.  The default, about 1 mm, spans +-32, clear
+	// of the +-11 or so the demo's disturbances reach.  spongeWidth is the
+	// rim of BOUNDARY_ABSORBING in cells.  It soaks up waves shorter than
+	// about its own width almost completely; longer swells partly reflect.
+	// Init() overrides two choices it cannot honour.  INTEGRATOR_ADI always
+	// runs on STORAGE_SOA, whatever storage says.  A boundary the integrator
+	// and storage do not support (see Boundary) asserts in debug builds and
+	// falls back to BOUNDARY_FIXED.  Storage() and BoundaryMode() report what
+	// the grid actually got.
+	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping,
+		StorageMode storage = STORAGE_AOS, float heightScale = 1.f / 1024.f,
+		Integrator integrator = INTEGRATOR_EXPLICIT, Boundary boundary = BOUNDARY_FIXED,
+		UINT spongeWidth = 16);
+
+	///<summary>
+	/// Warm starts.  SaveCheckpoint writes the Init() parameters, both time
+	/// levels, the clock and the land mask to a versioned binary file.
+	/// LoadCheckpoint re-runs Init() with the saved parameters, maps the file
+	/// and copies each time level out of the mapping in one block, so the
+	/// simulation carries on exactly where the saved one stopped.  Thread
+	/// count, activity tracking, normals and the catch-up cap keep their
+	/// current settings.  Both return false, and LoadCheckpoint leaves the
+	/// grid untouched, if the file cannot be written or read or is not a
+	/// checkpoint of this version.  SaveCheckpoint writes path.tmp and moves
+	/// it over path when complete, so an interrupted save keeps the old file.
+	///
+	/// ResumeCheckpoint is LoadCheckpoint for a grid the caller has already
+	/// set up: it keeps the live Init() parameters and land mask, and returns
+	/// false without touching anything unless the file was saved from a grid
+	/// with the same parameters and mask.
+	///</summary>
+	bool SaveCheckpoint(const char* path) const;
+	bool LoadCheckpoint(const char* path);
+	bool ResumeCheckpoint(const char* path);
+
+	///<summary>
+	/// Adds dt to this instance's clock and runs every whole time step that
+	/// is due, up to the catch-up cap, as one batch through UpdateSteps().
+	/// Time beyond the cap is dropped so a long frame cannot snowball into
+	/// ever longer ones.  Returns the number of steps run.
+	///</summary>
+	UINT Update(float dt);
+
+	// Upper bound on steps run by one Update() call.
+	void SetMaxStepsPerUpdate(UINT maxSteps);
+	UINT MaxStepsPerUpdate() const;
+
+	// Simulation time discarded by the catch-up cap since Init().
+	float DroppedTime() const;
 
-	void Init(UINT m, UINT n, float dx, float dt, float speed, float damping);
-	void Update(float dt);
 	void Disturb(UINT i, UINT j, float magnitude);
 
+	///<summary>
+	/// Halo exchange for grids that are tiles of a larger one.  ReadEdge copies
+	/// the current heights just inside edge e (row 1, row m - 2, column 1 or
+	/// column n - 2) and WriteHalo overwrites the boundary cells on edge e, so
+	/// the next step sees a neighbour's heights instead of zero.  Both skip
+	/// the corners: n - 2 values for top/bottom, m - 2 for left/right.
+	///</summary>
+	void ReadEdge(Edge e, float* dest) const;
+	void WriteHalo(Edge e, const float* src);
+
+	///<summary>
+	/// Rectangle access for grids nested inside coarser or finer ones: rows
+	/// [rowBegin, rowEnd) by columns [colBegin, colEnd) of one time level, as
+	/// fp32 rows of pitch floats.  WriteRegion may cover the boundary ring;
+	/// dry cells stay at zero and tracked tiles it touches are woken.
+	///</summary>
+	void ReadRegion(TimeLevel level, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+		float* dest, UINT pitch) const;
+	void WriteRegion(TimeLevel level, UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd,
+		const float* src, UINT pitch);
+
+	///<summary>
+	/// Applies many impulses in one pass.  They are sorted by the first row
+	/// they touch and written row band by row band, in parallel when a thread
+	/// pool is configured; each cell always receives its contributions in the
+	/// same order, so the result does not depend on the thread count.  Parts
+	/// of an impulse that fall on the boundary or off the grid are dropped.
+	///</summary>
+	void DisturbBatch(const Impulse* impulses, UINT count);
+	void DisturbBatch(const WorldImpulse* impulses, UINT count);
+
+	// Splits each step into row bands run on a persistent pool of numThreads
+	// threads (the caller included).  0 or 1 runs serially.  The result is
+	// bit-identical for any thread count.
+	void SetThreadCount(UINT numThreads);
+	UINT ThreadCount() const;
+
+	///<summary>
+	/// Runs numSteps fixed time steps.  With STORAGE_SOA and a steps-per-pass
+	/// value k > 1 the grid is cut into tiles small enough to stay in L2; each
+	/// tile is loaded once with a k-cell halo, advanced k steps in scratch
+	/// memory (the valid region shrinks by a cell per step, a trapezoid in
+	/// time) and written back, so the height field crosses DRAM once per k
+	/// steps instead of once per step.  Results match k single steps exactly.
+	///</summary>
+	void UpdateSteps(UINT numSteps);
+
+	void SetStepsPerPass(UINT steps);
+	UINT StepsPerPass() const;
+
+	// Keeps a per-vertex normal and +x tangent field in step with the
+	// heights.  It is produced in the same sweep as each step, from rows that
+	// are still in cache, rather than by a second pass over the grid.
+	// Disturb() does not refresh it; the next step does.
+	void SetNormalsEnabled(bool enabled);
+	bool NormalsEnabled() const;
+
+	// SoA surface frame fields in rows of NormalPitch() floats; axis 0, 1, 2
+	// is x, y, z.  The +x tangent has no z component.  NULL when disabled.
+	const float* NormalField(UINT axis) const;
+	const float* TangentField(UINT axis) const;
+	UINT NormalPitch() const;
+
+	XMFLOAT3 Normal(int i) const;
+	XMFLOAT3 TangentX(int i) const;
+
+	///<summary>
+	/// Min / max / average height pyramid for LOD and culling consumers.
+	/// Level 0 halves the grid: texel (i, j) covers grid points 2i, 2i + 1 by
+	/// 2j, 2j + 1, an odd last row or column paired with itself, and each
+	/// level halves the one below down to 1 x 1.  It is rebuilt at the end of
+	/// every UpdateSteps().  When the last step of the batch is a dense
+	/// STORAGE_SOA explicit step, level 0 is reduced inside that step's sweep
+	/// from rows still in cache; other modes reduce it in a separate banded
+	/// pass.  Disturb() does not refresh it.
+	///</summary>
+	void SetPyramidEnabled(bool enabled);
+	bool PyramidEnabled() const;
+	UINT PyramidLevelCount() const;
+
+	// Rows of pitch floats; NULL when disabled.
+	const float* PyramidLevel(UINT level, PyramidReduction reduction) const;
+	void PyramidLevelSize(UINT level, UINT& rows, UINT& cols, UINT& pitch) const;
+
+	///<summary>
+	/// Tracks which ActivityTileSize x ActivityTileSize tiles hold any motion.
+	/// Disturb() wakes tiles; a step only runs over awake tiles and their
+	/// neighbours, and a tile whose two time levels both fall below the sleep
+	/// threshold is flattened to exactly zero and goes back to sleep.  Steps
+	/// run one at a time in this mode (no temporal blocking).
+	///</summary>
+	void SetActivityTracking(bool enabled);
+	bool ActivityTracking() const;
+	void SetSleepThreshold(float threshold);
+	UINT ActiveTileCount() const;
+
+	static const UINT ActivityTileSize = 32;
+
+	///<summary>
+	/// Land mask for coastal scenes.  Dry cells are held at zero like the
+	/// grid boundary, so waves reflect off the shore, and every sweep only
+	/// visits the runs of wet cells in each row.  Disturbances that land on
+	/// dry cells are dropped.  wet holds RowCount() x ColumnCount() bytes,
+	/// nonzero for water; the boundary ring stays fixed either way.  The
+	/// INTEGRATOR_ADI sweeps solve whole grid lines and ignore the mask, as
+	/// do BOUNDARY_PERIODIC grids.
+	///</summary>
+	void SetLandMask(const BYTE* wet);
+
+	// Builds the mask from terrain: a cell is wet where terrainHeight(x, z)
+	// is below waterLevel, e.g. from [this](float x, float z) { return GetHeight(x, z); }.
+	template<typename HeightFn>
+	void SetLandMaskFromTerrain(HeightFn terrainHeight, float waterLevel = 0.f)
+	{
+		std::vector<BYTE> wet(mNumRows * mNumCols);
+		for (UINT i = 0; i < mNumRows; ++i)
+		{
+			for (UINT j = 0; j < mNumCols; ++j)
+			{
+				wet[i * mNumCols + j] = terrainHeight(mColumnX[j], mRowZ[i]) < waterLevel ? 1 : 0;
+			}
+		}
+		SetLandMask(&wet[0]);
+	}
+
+	void ClearLandMask();
+	bool IsWet(UINT i, UINT j) const;
+
+	// Interior cells the sweeps visit.
+	UINT WetCellCount() const;
+
+private:
+	void Release();
+
+	// Advances every interior row by one step and swaps the buffers.
+	void Step();
+
+	// Advances interior rows [rowBegin, rowEnd) by one time step.
+	void StepRows(UINT rowBegin, UINT rowEnd);
+
+	// INTEGRATOR_ADI counterpart of Step().  ImplicitRows builds the
+	// right-hand side of rows [rowBegin, rowEnd) and solves them along x;
+	// ImplicitColumns then solves columns [colBegin, colEnd) along z.
+	void StepImplicit();
+	void ImplicitRows(UINT rowBegin, UINT rowEnd);
+	void ImplicitColumns(UINT colBegin, UINT colEnd);
+
+	// BOUNDARY_PERIODIC counterpart of Step().  StepPeriodicRows advances
+	// rows [rowBegin, rowEnd) of the m - 1 distinct ones: the bulk of each row
+	// through the usual kernel, with the wrapped row above passed in for row
+	// 0, then column 0 on its own with its left neighbour gathered from
+	// column n - 2.  The repeated last column is refreshed as each row
+	// finishes and the repeated last row once every band is done.
+	void StepPeriodic();
+	void StepPeriodicRows(UINT rowBegin, UINT rowEnd);
+	void NormalPeriodicRow(const float* heights, UINT i);
+	UINT RowAbove(UINT i) const;
+
+	// BOUNDARY_ABSORBING: scales both time levels of the rim cells by the
+	// sponge profile after each step, in row bands on the thread pool.
+	void ApplySponge();
+	void SpongeRows(UINT rowBegin, UINT rowEnd);
+
+	// 16-bit storage counterparts.  scratch holds PackedWindowRows fp32 rows
+	// of mPackScratchPitch floats owned by the calling thread.
+	bool IsPacked() const;
+	void StepPackedRows(UINT rowBegin, UINT rowEnd, float* scratch);
+	void NormalPackedRows(UINT rowBegin, UINT rowEnd, float* scratch);
+	void AllocPackScratch(UINT numBands);
+	float PackedHeight(UINT i, UINT j) const;
+	void AddHeight(UINT i, UINT j, float v);
+
+	// Activity tracking counterparts of Step().  StepTileRow advances the
+	// tiles of one tile row that need it and measures them; SettleTileRow
+	// then puts quiet ones to sleep once no other row reads them.
+	void StepSparse();
+	void StepTileRow(UINT ty);
+	void SettleTileRow(UINT ty);
+	void WakeTiles(UINT i, UINT j);
+	void WakeTiles(UINT rowBegin, UINT rowEnd, UINT colBegin, UINT colEnd);
+
+	// Calls fn(spanBegin, spanEnd) for every run of wet cells of row i that
+	// overlaps [colBegin, colEnd), clipped to it; without a land mask the
+	// whole range is one run.
+	template<typename Fn>
+	void ForEachWetSpan(UINT i, UINT colBegin, UINT colEnd, Fn& fn) const
+	{
+		if (mWetSpanStart.empty())
+		{
+			fn(colBegin, colEnd);
+			return;
+		}
+
+		for (UINT s = mWetSpanStart[i]; s < mWetSpanStart[i + 1]; ++s)
+		{
+			const WetSpan& span = mWetSpans[s];
+			if (span.Begin >= colEnd)
+			{
+				break;
+			}
+			const UINT c0 = span.Begin > colBegin ? span.Begin : colBegin;
+			const UINT c1 = span.End < colEnd ? span.End : colEnd;
+			if (c0 < c1)
+			{
+				fn(c0, c1);
+			}
+		}
+	}
+
+	// Impulse prepared for DisturbBatch, already clipped to the interior.
+	struct BatchImpulse
+	{
+		UINT RowBegin;
+		UINT RowEnd;
+		UINT ColBegin;
+		UINT ColEnd;
+		float CenterRow;
+		float CenterCol;
+		float Magnitude;
+		float InvRadiusSq; // 0 for the 5-point splat
+		UINT WeightOffset; // Gaussian column weights in mBatchWeights
+	};
+
+	void AddBatchImpulse(float centerRow, float centerCol, float magnitude, float radius);
+	void ApplyBatch();
+	void ApplyBatchRows(UINT rowBegin, UINT rowEnd);
+
+	// SampleHeights() on one run of points, a kernel call per chunk; 16-bit
+	// storage decodes each corner on its own.
+	void SamplePoints(const float* x, const float* z, float* outH,
+		float* outGradX, float* outGradZ, UINT count) const;
+	void SamplePacked(const float* x, const float* z, float* outH,
+		float* outGradX, float* outGradZ, UINT count) const;
+
+	// Height pyramid.  ReducePyramidPair reduces fp32 rows 2r and 2r + 1 of
+	// heights (STORAGE_SOA layout) into base row r; ReducePyramidBase does
+	// every base row from the current heights in whatever storage, and
+	// ReducePyramidUpper builds the levels above the base.
+	void AllocPyramid();
+	void FreePyramid();
+	void ReducePyramidPair(const float* heights, UINT r);
+	void ReducePyramidRow(const float* a, const float* b, UINT r);
+	void ReducePyramidBase();
+	void ReducePyramidUpper();
+
+	// Recomputes the surface frame of rows [rowBegin, rowEnd) from heights.
+	void NormalRows(const float* heights, UINT rowBegin, UINT rowEnd);
+	void AllocNormals();
+	void RebuildNormals();
+
+	// A checkpoint holds each time level as rows of CheckpointPitch()
+	// elements: the solver's own rows, so they move in one block, except
+	// for STORAGE_AOS, which keeps only the heights.
+	UINT CheckpointPitch() const;
+	UINT CheckpointElementBytes() const;
+	void SaveLevel(TimeLevel level, BYTE* dest) const;
+	void LoadLevel(TimeLevel level, const BYTE* src, UINT srcPitch);
+	bool ReadCheckpoint(const char* path, bool reinit);
+
+	struct PassTile
+	{
+		UINT Halo;
+		UINT RowBegin;
+		UINT RowEnd;
+		UINT ColBegin;
+		UINT ColEnd;
+		float* ScratchPrev;
+		float* ScratchCurr;
+		UINT ScratchPitch;
+	};
+
+	// Advances every interior cell by numSteps using temporal blocking.
+	void StepBlocked(UINT numSteps);
+
+	// Advances one tile by numSteps inside its scratch pair and writes both
+	// resulting time levels to the pass buffers.
+	void StepBlockedTile(UINT numSteps, const PassTile& tile);
+
+	float& Height(float* heights, UINT i, UINT j) const
+	{
+		return heights[i * mRowPitch + j * mHeightStride];
+	}
+
+	const float& Height(const float* heights, UINT i, UINT j) const
+	{
+		return heights[i * mRowPitch + j * mHeightStride];
+	}
+
 private:
 	UINT mNumRows;
 	UINT mNumCols;
@@ -35,7 +545,119 @@ private:
 
 	float mTimeStep;
 	float mSpatialStep;
+	float mSpeed;
+	float mDamping;
+
+	FixedStepClock mClock;
+
+	StorageMode mStorage;
+	Integrator mIntegrator;
+	Boundary mBoundary;
 
+	// BOUNDARY_ABSORBING only: the cell (i, j) factor is
+	// mSpongeRow[i] * mSpongeCol[j], 1 outside the rim.
+	UINT mSpongeWidth;
+	std::vector<float> mSpongeRow;
+	std::vector<float> mSpongeCol;
+
+	// INTEGRATOR_ADI only: right-hand side weights, the off-diagonal of the
+	// row and column systems and their factorisations, and the buffer the
+	// row sweep writes and the column sweep solves in place.
+	float mImplicitQ[4];
+	float mImplicitR;
+	std::vector<float> mRowInv;
+	std::vector<float> mRowUpper;
+	std::vector<float> mColInv;
+	std::vector<float> mColUpper;
+	float* mImplicitHeights;
+
+	// STORAGE_AOS only.
 	XMFLOAT3* mPrevSolution;
 	XMFLOAT3* mCurrSolution;
+
+	// Height views used by the solver.  For STORAGE_AOS they alias the y
+	// members of the solution arrays (stride 3), for STORAGE_SOA they own
+	// aligned rows of mRowPitch floats (stride 1).
+	float* mPrevHeights;
+	float* mCurrHeights;
+	UINT mHeightStride;
+	UINT mRowPitch;
+
+	// STORAGE_FP16 and STORAGE_FIXED16 only: rows of mRowPitch values.
+	USHORT* mPrevPacked;
+	USHORT* mCurrPacked;
+	float mHeightScale;
+	float* mPackScratch;
+	UINT mPackScratchPitch;
+	UINT mPackScratchBands;
+
+	// x of each column and z of each row.
+	float* mColumnX;
+	float* mRowZ;
+
+	// NULL when running serially.
+	ThreadPool* mThreadPool;
+
+	UINT mStepsPerPass;
+
+	// Temporal blocking writes here while other bands still read their halos
+	// from the live buffers; the two pairs are swapped after each pass.
+	float* mPassPrevHeights;
+	float* mPassCurrHeights;
+
+	// Per-thread tile scratch, allocated on demand.
+	float* mPassScratch;
+	UINT mPassScratchFloats;
+
+	bool mbActivityTracking;
+	float mSleepThreshold;
+	UINT mTilesDown;
+	UINT mTilesAcross;
+	std::vector<BYTE> mTileActive;
+	std::vector<BYTE> mTileProcess;
+	std::vector<float> mTileEnergy;
+
+	// Land mask: one byte per cell, and the wet runs of interior columns of
+	// row i at mWetSpans[mWetSpanStart[i]] up to mWetSpans[mWetSpanStart[i + 1]].
+	// All empty when there is no mask.
+	struct WetSpan
+	{
+		UINT Begin;
+		UINT End;
+	};
+	std::vector<BYTE> mWetMask;
+	std::vector<WetSpan> mWetSpans;
+	std::vector<UINT> mWetSpanStart;
+
+	// DisturbBatch scratch, kept to avoid reallocating every call.
+	std::vector<BatchImpulse> mBatch;
+	std::vector<BatchImpulse> mBatchSorted;
+	std::vector<UINT> mBatchRowStart;
+	std::vector<float> mBatchWeights;
+	UINT mBatchMaxReach;
+
+	bool mbNormalsEnabled;
+	float* mNormals[3];
+	float* mTangents[2];
+	UINT mNormalPitch;
+
+	// Every level of one reduction lives in one block, level l at
+	// mPyramidLevels[l].Offset.  mbPyramidInStep asks StepRows() to reduce
+	// the base as it goes.
+	struct PyramidLevelDesc
+	{
+		UINT Rows;
+		UINT Cols;
+		UINT Pitch;
+		UINT Offset;
+	};
+	bool mbPyramidEnabled;
+	bool mbPyramidInStep;
+	float* mPyramid[3];
+	std::vector<PyramidLevelDesc> mPyramidLevels;
+
+	// fp32 copies of two grid rows per band for storage modes other than
+	// STORAGE_SOA, allocated on demand.
+	float* mPyramidScratch;
+	UINT mPyramidScratchBands;
 };
@@ -8,18 +8,34 @@ struct Vertex
 	XMFLOAT4 Color;
 };
 
-WavesApp::WavesApp(HINSTANCE hInstance)
+namespace
+{
+	// With -warmstart on the command line, the app saves the sea at exit,
+	// so the next such run does not start from a flat one.
+	const wchar_t* WarmStartFlag = L"-warmstart";
+	const char* WavesCheckpointPath = "waves.ckpt";
+
+	// With -exportheights on the command line, the mapping tools open with
+	// SharedHeightsReader.
+	const wchar_t* ExportHeightsFlag = L"-exportheights";
+	const char* WavesExportName = "Local\\WavesHeights";
+}
+
+WavesApp::WavesApp(HINSTANCE hInstance, PCWSTR cmdLine)
 	: D3DApp(hInstance)
 	, mLandVB(NULL), mLandIB(NULL)
-	, mWavesVB(NULL), mWavesIB(NULL)
+	, mWavesVB(NULL), mWavesColorVB(NULL), mWavesIB(NULL)
 	, mFX(NULL), mTech(NULL)
 	, mfxWorldViewProj(NULL)
 	, mInputLayout(NULL)
+	, mWavesInputLayout(NULL)
 	, mWireframeRS(NULL)
 	, mGridIndexCount(0)
 	, mTheta(1.5f * MathHelper::Pi)
 	, mPhi(0.1f * MathHelper::Pi)
 	, mRadius(200.f)
+	, mbWarmStart(cmdLine != NULL && wcsstr(cmdLine, WarmStartFlag) != NULL)
+	, mbExportHeights(cmdLine != NULL && wcsstr(cmdLine, ExportHeightsFlag) != NULL)
 {
 	mMainWindowCaption = L"Waves Demo";
 
@@ -35,12 +51,20 @@ WavesApp::WavesApp(HINSTANCE hInstance)
 
 WavesApp::~WavesApp()
 {
+	mWaves.Stop();
+	if (mbWarmStart)
+	{
+		mWaves.Simulation().SaveCheckpoint(WavesCheckpointPath);
+	}
+
 	ReleaseCOM(mLandVB);
 	ReleaseCOM(mLandIB);
 	ReleaseCOM(mWavesVB);
+	ReleaseCOM(mWavesColorVB);
 	ReleaseCOM(mWavesIB);
 	ReleaseCOM(mFX);
 	ReleaseCOM(mInputLayout);
+	ReleaseCOM(mWavesInputLayout);
 	ReleaseCOM(mWireframeRS);
 }
 
@@ -51,13 +75,33 @@ bool WavesApp::Init()
 		return false;
 	}
 
-	mWaves.Init(200, 200, 0.8f, 0.03f, 3.25f, 0.4f);
+	mWaves.Simulation().Init(200, 200, 0.8f, 0.03f, 3.25f, 0.4f, Waves::STORAGE_SOA);
+
+	// The hills poke out of the water; only step the cells around them.
+	mWaves.Simulation().SetLandMaskFromTerrain([this](float x, float z) { return GetHeight(x, z); });
+
+	// Carry on from the last warm-started run's sea, so the surface is
+	// settled from the first frame.  A file from another grid or terrain is
+	// ignored and replaced at exit.
+	if (mbWarmStart)
+	{
+		mWaves.Simulation().ResumeCheckpoint(WavesCheckpointPath);
+	}
+
+	// Nothing else depends on the export, so run without it if the mapping
+	// cannot be made.
+	if (mbExportHeights && mHeightExport.Init(WavesExportName, mWaves.Simulation()))
+	{
+		mWaves.SetHeightExport(&mHeightExport);
+	}
 
 	BuildLandGeometryBuffers();
 	BuildWavesGeometryBuffers();
 	BuildFX();
 	BuildVertexLayout();
 
+	mWaves.Start();
+
 	D3D11_RASTERIZER_DESC wireframeDesc;
 	ZeroMemory(&wireframeDesc, sizeof(D3D11_RASTERIZER_DESC));
 	wireframeDesc.FillMode = D3D11_FILL_WIREFRAME;
@@ -109,21 +153,20 @@ void WavesApp::UdapteScene(const float InDeltaTime)
 		mWaves.Disturb(i, j, r);
 	}
 
-	mWaves.Update(InDeltaTime);
-
 	//
-	// Update the wave vertex buffer with the new solution.
+	// Update the wave vertex buffer with the new solution, if the
+	// simulation thread has finished one since the last frame.
 	//
 
+	if (!mWaves.AcquireLatest())
+	{
+		return;
+	}
+
 	D3D11_MAPPED_SUBRESOURCE MappedData;
 	HR(mD3DImmediateContext->Map(mWavesVB, 0, D3D11_MAP_WRITE_DISCARD, 0, &MappedData));
 
-	Vertex* v = reinterpret_cast<Vertex*>(MappedData.pData);
-	for (UINT i = 0; i < mWaves.VertexCount(); ++i)
-	{
-		v[i].Pos = mWaves[i];
-		v[i].Color = XMFLOAT4(0.f, 0.f, 0.f, 1.f);
-	}
+	mWaves.WriteVertices(MappedData.pData, sizeof(XMFLOAT3), 0, 0, Waves::VERTEX_POSITION);
 
 	mD3DImmediateContext->Unmap(mWavesVB, 0);
 }
@@ -165,7 +208,11 @@ void WavesApp::DrawScene()
 
 		mD3DImmediateContext->RSSetState(mWireframeRS);
 
-		mD3DImmediateContext->IASetVertexBuffers(0, 1, &mWavesVB, &stride, &offset);
+		ID3D11Buffer* wavesVBs[2] = { mWavesVB, mWavesColorVB };
+		UINT wavesStrides[2] = { sizeof(XMFLOAT3), sizeof(XMFLOAT4) };
+		UINT wavesOffsets[2] = { 0, 0 };
+		mD3DImmediateContext->IASetInputLayout(mWavesInputLayout);
+		mD3DImmediateContext->IASetVertexBuffers(0, 2, wavesVBs, wavesStrides, wavesOffsets);
 		mD3DImmediateContext->IASetIndexBuffer(mWavesIB, DXGI_FORMAT_R32_UINT, 0);
 
 		world = XMLoadFloat4x4(&mWavesWorld);
@@ -176,6 +223,7 @@ void WavesApp::DrawScene()
 
 		// Restore default.
 		mD3DImmediateContext->RSSetState(0);
+		mD3DImmediateContext->IASetInputLayout(mInputLayout);
 	}
 
 	HR(mSwapChain->Present(0, 0));
@@ -314,12 +362,25 @@ void WavesApp::BuildWavesGeometryBuffers()
 
 	D3D11_BUFFER_DESC vbd;
 	vbd.Usage = D3D11_USAGE_DYNAMIC;
-	vbd.ByteWidth = sizeof(Vertex) * mWaves.VertexCount();
+	vbd.ByteWidth = sizeof(XMFLOAT3) * mWaves.VertexCount();
 	vbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
 	vbd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
 	vbd.MiscFlags = 0;
 	HR(mD3DDevice->CreateBuffer(&vbd, 0, &mWavesVB));
 
+	// The color never changes, so it lives in its own immutable stream.
+	std::vector<XMFLOAT4> colors(mWaves.VertexCount(), XMFLOAT4(0.f, 0.f, 0.f, 1.f));
+
+	D3D11_BUFFER_DESC cbd;
+	cbd.Usage = D3D11_USAGE_IMMUTABLE;
+	cbd.ByteWidth = sizeof(XMFLOAT4) * mWaves.VertexCount();
+	cbd.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+	cbd.CPUAccessFlags = 0;
+	cbd.MiscFlags = 0;
+	D3D11_SUBRESOURCE_DATA cinitData;
+	cinitData.pSysMem = &colors[0];
+	HR(mD3DDevice->CreateBuffer(&cbd, &cinitData, &mWavesColorVB));
+
 
 	// Create the index buffer.  The index buffer is fixed, so we only 
 	// need to create and set once.
@@ -390,4 +451,14 @@ void WavesApp::BuildVertexLayout()
 	mTech->GetPassByIndex(0)->GetDesc(&passDesc);
 	HR(mD3DDevice->CreateInputLayout(vertexDesc, 2, passDesc.pIAInputSignature,
 		passDesc.IAInputSignatureSize, &mInputLayout));
+
+	// Waves: position in slot 0, color in slot 1.
+	D3D11_INPUT_ELEMENT_DESC wavesDesc[] =
+	{
+		{"POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0},
+		{"COLOR",    0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0}
+	};
+
+	HR(mD3DDevice->CreateInputLayout(wavesDesc, 2, passDesc.pIAInputSignature,
+		passDesc.IAInputSignatureSize, &mWavesInputLayout));
 }
@@ -3,12 +3,12 @@
 #include "../../Common/D3DApp.h"
 #include "../../Common/d3dx11effect.h"
 
-#include "Waves.h"
+#include "AsyncWaves.h"
 
 class WavesApp : public D3DApp
 {
 public:
-	WavesApp(HINSTANCE hInstance);
+	WavesApp(HINSTANCE hInstance, PCWSTR cmdLine = NULL);
 	virtual ~WavesApp();
 
 private:
@@ -32,6 +32,7 @@ private:
 	ID3D11Buffer* mLandVB;
 	ID3D11Buffer* mLandIB;
 	ID3D11Buffer* mWavesVB;
+	ID3D11Buffer* mWavesColorVB;
 	ID3D11Buffer* mWavesIB;
 
 	ID3DX11Effect* mFX;
@@ -40,6 +41,10 @@ private:
 
 	ID3D11InputLayout* mInputLayout;
 
+	// Positions and colors in separate streams, so the per-frame update only
+	// rewrites positions.
+	ID3D11InputLayout* mWavesInputLayout;
+
 	ID3D11RasterizerState* mWireframeRS;
 
 	// Define transformations from local spaces to world space.
@@ -48,7 +53,11 @@ private:
 
 	UINT mGridIndexCount;
 
-	Waves mWaves;
+	// Stepped on its own thread; the frame only uploads finished solutions.
+	AsyncWaves mWaves;
+
+	// The same solutions for external tools, if mbExportHeights.
+	SharedHeightsPublisher mHeightExport;
 
 	XMFLOAT4X4 mView;
 	XMFLOAT4X4 mProj;
@@ -58,4 +67,10 @@ private:
 	float mRadius;
 
 	POINT mLastMousePos;
+
+	// Resume from and save to WavesCheckpointPath.
+	bool mbWarmStart;
+
+	// Publish heights under WavesExportName.
+	bool mbExportHeights;
 };
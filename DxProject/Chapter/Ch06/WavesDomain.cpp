@@ -0,0 +1,182 @@
+#include "WavesDomain.h"
+
+#include <cassert>
+
+WavesDomain::WavesDomain()
+	: mTransport(NULL)
+	, mRank(0), mNumRanks(1)
+	, mRowBegin(0), mRowEnd(0)
+	, mbFailed(false)
+{
+}
+
+void WavesDomain::Init(HaloTransport* transport, UINT rank, UINT numRanks,
+	UINT m, UINT n, float dx, float dt, float speed, float damping, Waves::StorageMode storage)
+{
+	assert(rank < numRanks && m - 2 >= numRanks);
+
+	mTransport = transport;
+	mRank = rank;
+	mNumRanks = numRanks;
+	mClock.Reset(dt);
+	mbFailed = false;
+
+	// Same split as the row bands of Waves::Step().
+	const UINT interiorRows = m - 2;
+	mRowBegin = 1 + interiorRows * rank / numRanks;
+	mRowEnd = 1 + interiorRows * (rank + 1) / numRanks;
+
+	// The first and last rows are halos, or the real boundary at either end
+	// of the grid.
+	mBand.Init(mRowEnd - mRowBegin + 2, n, dx, dt, speed, damping, storage);
+
+	mSendRow.resize(n - 2);
+	mReceiveRow.resize(n - 2);
+}
+
+UINT WavesDomain::RowBegin() const
+{
+	return mRowBegin;
+}
+
+UINT WavesDomain::RowEnd() const
+{
+	return mRowEnd;
+}
+
+Waves& WavesDomain::Band()
+{
+	return mBand;
+}
+
+const Waves& WavesDomain::Band() const
+{
+	return mBand;
+}
+
+UINT WavesDomain::Update(float dt)
+{
+	// The same clock as Waves::Update(), so every rank and a single process
+	// agree on how many steps each call runs.
+	if (mbFailed)
+	{
+		return 0;
+	}
+
+	const UINT numSteps = mClock.Advance(dt);
+	for (UINT s = 0; s < numSteps; ++s)
+	{
+		if (!UpdateSteps(1))
+		{
+			return s;
+		}
+	}
+
+	return numSteps;
+}
+
+void WavesDomain::SetMaxStepsPerUpdate(UINT maxSteps)
+{
+	mClock.SetMaxStepsPerUpdate(maxSteps);
+}
+
+float WavesDomain::DroppedTime() const
+{
+	return mClock.DroppedTime();
+}
+
+bool WavesDomain::UpdateSteps(UINT numSteps)
+{
+	// One halo row only covers one step.
+	for (UINT s = 0; s < numSteps && !mbFailed; ++s)
+	{
+		if (!ExchangeHalos())
+		{
+			// Stepping on with the halo half filled would only hide the
+			// divergence.
+			mbFailed = true;
+			break;
+		}
+		mBand.UpdateSteps(1);
+	}
+
+	return !mbFailed;
+}
+
+bool WavesDomain::Failed() const
+{
+	return mbFailed;
+}
+
+bool WavesDomain::ExchangeHalos()
+{
+	const UINT count = (UINT)mSendRow.size();
+
+	// Send both edges before receiving either; the transports buffer at
+	// least one message per link, so no pair of ranks can deadlock.
+	if (mRank > 0)
+	{
+		mBand.ReadEdge(Waves::EDGE_TOP, &mSendRow[0]);
+		if (!mTransport->Send(mRank - 1, &mSendRow[0], count))
+		{
+			return false;
+		}
+	}
+	if (mRank + 1 < mNumRanks)
+	{
+		mBand.ReadEdge(Waves::EDGE_BOTTOM, &mSendRow[0]);
+		if (!mTransport->Send(mRank + 1, &mSendRow[0], count))
+		{
+			return false;
+		}
+	}
+
+	if (mRank > 0)
+	{
+		if (!mTransport->Receive(mRank - 1, &mReceiveRow[0], count))
+		{
+			return false;
+		}
+		mBand.WriteHalo(Waves::EDGE_TOP, &mReceiveRow[0]);
+	}
+	if (mRank + 1 < mNumRanks)
+	{
+		if (!mTransport->Receive(mRank + 1, &mReceiveRow[0], count))
+		{
+			return false;
+		}
+		mBand.WriteHalo(Waves::EDGE_BOTTOM, &mReceiveRow[0]);
+	}
+
+	return true;
+}
+
+void WavesDomain::Disturb(UINT i, UINT j, float magnitude)
+{
+	// The splat reaches one row either side; the band clips it to the rows
+	// it owns.
+	if (i + 1 < mRowBegin || i > mRowEnd)
+	{
+		return;
+	}
+
+	Waves::Impulse impulse;
+	impulse.Row = i + 1 - mRowBegin;
+	impulse.Col = j;
+	impulse.Magnitude = magnitude;
+	impulse.Radius = 0.f;
+	mBand.DisturbBatch(&impulse, 1);
+}
+
+void WavesDomain::ReadBand(float* dest, UINT destPitch) const
+{
+	const UINT n = mBand.ColumnCount();
+
+	mBandHeights.resize(mBand.RowCount() * n);
+	mBand.ReadHeights(&mBandHeights[0], n);
+
+	for (UINT i = mRowBegin; i < mRowEnd; ++i)
+	{
+		CopyMemory(dest + i * destPitch, &mBandHeights[(i - mRowBegin + 1) * n], n * sizeof(float));
+	}
+}
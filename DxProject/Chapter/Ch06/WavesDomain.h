@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Waves.h"
+#include "HaloTransport.h"
+
+#include <vector>
+
+///<summary>
+/// One rank's share of a Waves grid split across processes or nodes.
+///
+/// The m x n grid is cut into numRanks bands of interior rows, split the
+/// same way Waves splits rows between threads.  Each rank steps its band as
+/// a Waves grid with one extra row above and below; before every step those
+/// halo rows are swapped with the neighbouring ranks through a HaloTransport.
+/// The heights of every cell match a single-process Waves with the same
+/// parameters and disturbances exactly.
+///
+/// Every rank runs the same sequence of calls (SPMD): the same dt to
+/// Update() and the same Disturb() calls, each applying only its share.
+///</summary>
+class WavesDomain
+{
+public:
+	WavesDomain();
+
+	// The transport must outlive this object.  Needs m - 2 >= numRanks.
+	void Init(HaloTransport* transport, UINT rank, UINT numRanks,
+		UINT m, UINT n, float dx, float dt, float speed, float damping,
+		Waves::StorageMode storage = Waves::STORAGE_SOA);
+
+	// Global rows [RowBegin(), RowEnd()) are owned by this rank.
+	UINT RowBegin() const;
+	UINT RowEnd() const;
+
+	// The band's grid; its row r is global row RowBegin() - 1 + r.  Thread
+	// count, storage and activity tracking are configured on it as usual.
+	Waves& Band();
+	const Waves& Band() const;
+
+	// Fixed-step clock with a catch-up cap, as Waves::Update(); the band's
+	// own clock is not used.  Returns the number of steps run, which falls
+	// short if a halo exchange fails.
+	UINT Update(float dt);
+	void SetMaxStepsPerUpdate(UINT maxSteps);
+	float DroppedTime() const;
+
+	// Returns false if a halo exchange failed, before or during this call.
+	bool UpdateSteps(UINT numSteps);
+
+	///<summary>
+	/// True once a halo exchange has failed, e.g. a neighbouring rank died or
+	/// timed out.  The band has then drifted from the rest of the grid and
+	/// the run cannot be trusted, so it stops stepping for good: Update()
+	/// and UpdateSteps() do nothing and the caller should abort the run.
+	///</summary>
+	bool Failed() const;
+
+	// Global cell indices, as Waves::Disturb().
+	void Disturb(UINT i, UINT j, float magnitude);
+
+	// Copies the owned rows into rows [RowBegin(), RowEnd()) of a full-size
+	// array of destPitch floats per row.
+	void ReadBand(float* dest, UINT destPitch) const;
+
+private:
+	bool ExchangeHalos();
+
+	WavesDomain(const WavesDomain&);
+	WavesDomain& operator=(const WavesDomain&);
+
+private:
+	HaloTransport* mTransport;
+	UINT mRank;
+	UINT mNumRanks;
+	UINT mRowBegin;
+	UINT mRowEnd;
+
+	FixedStepClock mClock;
+
+	bool mbFailed;
+
+	Waves mBand;
+	std::vector<float> mSendRow;
+	std::vector<float> mReceiveRow;
+	mutable std::vector<float> mBandHeights;
+};
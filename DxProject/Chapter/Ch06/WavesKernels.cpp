@@ -0,0 +1,1687 @@
+#include "WavesKernels.h"
+
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <intrin.h>
+#include <immintrin.h>
+#define WAVES_X86 1
+#else
+#define WAVES_X86 0
+#endif
+
+namespace
+{
+	WavesKernels::SimdLevel DetectSimdLevel()
+	{
+#if WAVES_X86
+		int info[4];
+		__cpuid(info, 0);
+		const int maxLeaf = info[0];
+
+		__cpuid(info, 1);
+		const bool sse2 = (info[3] & (1 << 26)) != 0;
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const bool avx = (info[2] & (1 << 28)) != 0;
+
+		// The OS has to save the upper halves of the ymm registers too.
+		bool avx2 = false;
+		if (osxsave && avx && maxLeaf >= 7 && (_xgetbv(0) & 0x6) == 0x6)
+		{
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+		}
+
+		if (avx2)
+		{
+			return WavesKernels::SIMD_AVX2;
+		}
+		if (sse2)
+		{
+			return WavesKernels::SIMD_SSE2;
+		}
+#endif
+		return WavesKernels::SIMD_SCALAR;
+	}
+
+	WavesKernels::SimdLevel& ActiveSimdLevel()
+	{
+		static WavesKernels::SimdLevel level = DetectSimdLevel();
+		return level;
+	}
+
+	// F16C comes with every AVX2 part we care about but is its own cpuid bit.
+	bool HasF16C()
+	{
+#if WAVES_X86
+		static const bool f16c = []()
+		{
+			int info[4];
+			__cpuid(info, 1);
+			return (info[2] & (1 << 29)) != 0;
+		}();
+		return f16c && ActiveSimdLevel() == WavesKernels::SIMD_AVX2;
+#else
+		return false;
+#endif
+	}
+
+	union FloatBits
+	{
+		float F;
+		UINT U;
+	};
+
+	// Round-to-nearest-even float -> half, matching vcvtps2ph.
+	USHORT FloatToHalf(float value)
+	{
+		const UINT f32Infinity = 255u << 23;
+		const UINT f16Max = (127u + 16u) << 23;
+		const UINT denormMagic = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+		FloatBits v;
+		v.F = value;
+		const UINT sign = v.U & 0x80000000u;
+		v.U ^= sign;
+
+		UINT o;
+		if (v.U >= f16Max)
+		{
+			// Inf stays Inf, NaN becomes a quiet NaN.
+			o = v.U > f32Infinity ? 0x7e00u : 0x7c00u;
+		}
+		else if (v.U < (113u << 23))
+		{
+			// Subnormal or zero: let an fp add do the rounding.
+			FloatBits magic;
+			magic.U = denormMagic;
+			v.F += magic.F;
+			o = v.U - denormMagic;
+		}
+		else
+		{
+			const UINT mantissaOdd = (v.U >> 13) & 1u;
+			v.U -= (UINT)(127 - 15) << 23;
+			v.U += 0xfffu;
+			v.U += mantissaOdd;
+			o = v.U >> 13;
+		}
+
+		return (USHORT)(o | (sign >> 16));
+	}
+
+	float HalfToFloat(USHORT h)
+	{
+		const UINT shiftedExp = 0x7c00u << 13;
+
+		FloatBits o;
+		o.U = (h & 0x7fffu) << 13;
+		const UINT exp = shiftedExp & o.U;
+		o.U += (127u - 15u) << 23;
+
+		if (exp == shiftedExp)
+		{
+			// Inf or NaN.
+			o.U += (128u - 16u) << 23;
+		}
+		else if (exp == 0)
+		{
+			// Subnormal: renormalise.
+			FloatBits magic;
+			magic.U = 113u << 23;
+			o.U += 1u << 23;
+			o.F -= magic.F;
+		}
+
+		o.U |= (UINT)(h & 0x8000u) << 16;
+		return o.F;
+	}
+
+	// Saturate in float first so the vector conversion never sees a value
+	// it would turn into the integer indefinite.
+	short FloatToFixed(float h, float invScale)
+	{
+		float q = h * invScale;
+		q = q < -32768.f ? -32768.f : (q > 32767.f ? 32767.f : q);
+		return (short)lrintf(q);
+	}
+
+	void StepRowScalar(float* prev, const float* up, const float* curr, const float* down,
+		UINT count, UINT stride, float k1, float k2, float k3)
+	{
+		const float* right = curr + stride;
+		const float* left = curr - stride;
+
+		// In place is fine: prev_ij is read once, before it is overwritten.
+		for (UINT j = 0; j < count; ++j)
+		{
+			const UINT k = j * stride;
+			prev[k] =
+				k1 * prev[k] +
+				k2 * curr[k] +
+				k3 * (down[k] +
+					  up[k] +
+					  right[k] +
+					  left[k]);
+		}
+	}
+
+	void NormalRowScalar(const float* up, const float* curr, const float* down,
+		UINT count, UINT stride, float invTwoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const float* right = curr + stride;
+		const float* left = curr - stride;
+
+		for (UINT j = 0; j < count; ++j)
+		{
+			const UINT k = j * stride;
+			const float dhdx = (right[k] - left[k]) * invTwoDx;
+			const float dhdz = (up[k] - down[k]) * invTwoDx;
+
+			const float invN = 1.f / sqrtf(dhdx * dhdx + dhdz * dhdz + 1.f);
+			nx[j] = -dhdx * invN;
+			ny[j] = invN;
+			nz[j] = -dhdz * invN;
+
+			const float invT = 1.f / sqrtf(dhdx * dhdx + 1.f);
+			tx[j] = invT;
+			ty[j] = dhdx * invT;
+		}
+	}
+
+	float MaxAbsRowScalar(const float* row, UINT count, UINT stride)
+	{
+		float result = 0.f;
+		for (UINT j = 0; j < count; ++j)
+		{
+			result = fmaxf(result, fabsf(row[j * stride]));
+		}
+		return result;
+	}
+
+#if WAVES_X86
+	void StepRowSSE2(float* prev, const float* up, const float* curr, const float* down,
+		UINT count, float k1, float k2, float k3)
+	{
+		const __m128 K1 = _mm_set1_ps(k1);
+		const __m128 K2 = _mm_set1_ps(k2);
+		const __m128 K3 = _mm_set1_ps(k3);
+
+		UINT j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j + 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j - 1));
+
+			__m128 h = _mm_mul_ps(K1, _mm_loadu_ps(prev + j));
+			h = _mm_add_ps(h, _mm_mul_ps(K2, _mm_loadu_ps(curr + j)));
+			h = _mm_add_ps(h, _mm_mul_ps(K3, sum));
+
+			_mm_storeu_ps(prev + j, h);
+		}
+
+		StepRowScalar(prev + j, up + j, curr + j, down + j, count - j, 1, k1, k2, k3);
+	}
+
+	void StepRowAVX2(float* prev, const float* up, const float* curr, const float* down,
+		UINT count, float k1, float k2, float k3)
+	{
+		// No FMA on purpose: fused rounding would make this path disagree
+		// with the scalar fallback.
+		const __m256 K1 = _mm256_set1_ps(k1);
+		const __m256 K2 = _mm256_set1_ps(k2);
+		const __m256 K3 = _mm256_set1_ps(k3);
+
+		UINT j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j + 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j - 1));
+
+			__m256 h = _mm256_mul_ps(K1, _mm256_loadu_ps(prev + j));
+			h = _mm256_add_ps(h, _mm256_mul_ps(K2, _mm256_loadu_ps(curr + j)));
+			h = _mm256_add_ps(h, _mm256_mul_ps(K3, sum));
+
+			_mm256_storeu_ps(prev + j, h);
+		}
+
+		// Avoid the AVX-SSE transition penalty before the scalar tail.
+		_mm256_zeroupper();
+
+		StepRowScalar(prev + j, up + j, curr + j, down + j, count - j, 1, k1, k2, k3);
+	}
+
+	// sqrt and div are correctly rounded in every path, so the vector loops
+	// agree with NormalRowScalar to the bit.
+	void NormalRowSSE2(const float* up, const float* curr, const float* down,
+		UINT count, float invTwoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const __m128 S = _mm_set1_ps(invTwoDx);
+		const __m128 One = _mm_set1_ps(1.f);
+		const __m128 Sign = _mm_set1_ps(-0.f);
+
+		UINT j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			const __m128 dhdx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(curr + j + 1), _mm_loadu_ps(curr + j - 1)), S);
+			const __m128 dhdz = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)), S);
+			const __m128 dx2 = _mm_mul_ps(dhdx, dhdx);
+
+			const __m128 lenN = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(dx2, _mm_mul_ps(dhdz, dhdz)), One));
+			const __m128 invN = _mm_div_ps(One, lenN);
+			_mm_storeu_ps(nx + j, _mm_mul_ps(_mm_xor_ps(dhdx, Sign), invN));
+			_mm_storeu_ps(ny + j, invN);
+			_mm_storeu_ps(nz + j, _mm_mul_ps(_mm_xor_ps(dhdz, Sign), invN));
+
+			const __m128 invT = _mm_div_ps(One, _mm_sqrt_ps(_mm_add_ps(dx2, One)));
+			_mm_storeu_ps(tx + j, invT);
+			_mm_storeu_ps(ty + j, _mm_mul_ps(dhdx, invT));
+		}
+
+		NormalRowScalar(up + j, curr + j, down + j, count - j, 1, invTwoDx,
+			nx + j, ny + j, nz + j, tx + j, ty + j);
+	}
+
+	void NormalRowAVX2(const float* up, const float* curr, const float* down,
+		UINT count, float invTwoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty)
+	{
+		const __m256 S = _mm256_set1_ps(invTwoDx);
+		const __m256 One = _mm256_set1_ps(1.f);
+		const __m256 Sign = _mm256_set1_ps(-0.f);
+
+		UINT j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m256 dhdx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(curr + j + 1), _mm256_loadu_ps(curr + j - 1)), S);
+			const __m256 dhdz = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j)), S);
+			const __m256 dx2 = _mm256_mul_ps(dhdx, dhdx);
+
+			const __m256 lenN = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(dx2, _mm256_mul_ps(dhdz, dhdz)), One));
+			const __m256 invN = _mm256_div_ps(One, lenN);
+			_mm256_storeu_ps(nx + j, _mm256_mul_ps(_mm256_xor_ps(dhdx, Sign), invN));
+			_mm256_storeu_ps(ny + j, invN);
+			_mm256_storeu_ps(nz + j, _mm256_mul_ps(_mm256_xor_ps(dhdz, Sign), invN));
+
+			const __m256 invT = _mm256_div_ps(One, _mm256_sqrt_ps(_mm256_add_ps(dx2, One)));
+			_mm256_storeu_ps(tx + j, invT);
+			_mm256_storeu_ps(ty + j, _mm256_mul_ps(dhdx, invT));
+		}
+
+		_mm256_zeroupper();
+
+		NormalRowScalar(up + j, curr + j, down + j, count - j, 1, invTwoDx,
+			nx + j, ny + j, nz + j, tx + j, ty + j);
+	}
+
+	float MaxAbsRowSSE2(const float* row, UINT count)
+	{
+		const __m128 Abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 m = _mm_setzero_ps();
+
+		UINT j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			m = _mm_max_ps(m, _mm_and_ps(_mm_loadu_ps(row + j), Abs));
+		}
+
+		m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+		m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+		return fmaxf(_mm_cvtss_f32(m), MaxAbsRowScalar(row + j, count - j, 1));
+	}
+#endif
+}
+
+WavesKernels::SimdLevel WavesKernels::GetSimdLevel()
+{
+	return ActiveSimdLevel();
+}
+
+void WavesKernels::SetSimdLevel(SimdLevel level)
+{
+	const SimdLevel supported = DetectSimdLevel();
+	ActiveSimdLevel() = level < supported ? level : supported;
+}
+
+void WavesKernels::StepRow(float* prev, const float* up, const float* curr, const float* down,
+	UINT count, UINT stride, float k1, float k2, float k3)
+{
+#if WAVES_X86
+	if (stride == 1)
+	{
+		switch (ActiveSimdLevel())
+		{
+		case SIMD_AVX2:
+			StepRowAVX2(prev, up, curr, down, count, k1, k2, k3);
+			return;
+		case SIMD_SSE2:
+			StepRowSSE2(prev, up, curr, down, count, k1, k2, k3);
+			return;
+		default:
+			break;
+		}
+	}
+#endif
+
+	StepRowScalar(prev, up, curr, down, count, stride, k1, k2, k3);
+}
+
+void WavesKernels::NormalRow(const float* up, const float* curr, const float* down,
+	UINT count, UINT stride, float invTwoDx,
+	float* nx, float* ny, float* nz, float* tx, float* ty)
+{
+#if WAVES_X86
+	if (stride == 1)
+	{
+		switch (ActiveSimdLevel())
+		{
+		case SIMD_AVX2:
+			NormalRowAVX2(up, curr, down, count, invTwoDx, nx, ny, nz, tx, ty);
+			return;
+		case SIMD_SSE2:
+			NormalRowSSE2(up, curr, down, count, invTwoDx, nx, ny, nz, tx, ty);
+			return;
+		default:
+			break;
+		}
+	}
+#endif
+
+	NormalRowScalar(up, curr, down, count, stride, invTwoDx, nx, ny, nz, tx, ty);
+}
+
+float WavesKernels::MaxAbsRow(const float* row, UINT count, UINT stride)
+{
+	// A reduction is memory bound; SSE2 is as fast as AVX here.
+#if WAVES_X86
+	if (stride == 1 && ActiveSimdLevel() != SIMD_SCALAR)
+	{
+		return MaxAbsRowSSE2(row, count);
+	}
+#endif
+
+	return MaxAbsRowScalar(row, count, stride);
+}
+
+float WavesKernels::UnpackHeight(USHORT v, PackFormat format, float scale)
+{
+	if (format == PACK_FP16)
+	{
+		return HalfToFloat(v);
+	}
+	return (float)(short)v * scale;
+}
+
+USHORT WavesKernels::PackHeight(float h, PackFormat format, float scale)
+{
+	if (format == PACK_FP16)
+	{
+		return FloatToHalf(h);
+	}
+	return (USHORT)FloatToFixed(h, 1.f / scale);
+}
+
+void WavesKernels::UnpackRow(const USHORT* src, float* dst, UINT count, PackFormat format, float scale)
+{
+	UINT j = 0;
+
+#if WAVES_X86
+	if (format == PACK_FP16 && HasF16C())
+	{
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m128i h = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+			_mm256_storeu_ps(dst + j, _mm256_cvtph_ps(h));
+		}
+		_mm256_zeroupper();
+	}
+	else if (format == PACK_FIXED16 && ActiveSimdLevel() != SIMD_SCALAR)
+	{
+		// Sign-extend by interleaving with itself and shifting back down.
+		const __m128 S = _mm_set1_ps(scale);
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + j));
+			const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16);
+			const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(q, q), 16);
+			_mm_storeu_ps(dst + j, _mm_mul_ps(_mm_cvtepi32_ps(lo), S));
+			_mm_storeu_ps(dst + j + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), S));
+		}
+	}
+#endif
+
+	for (; j < count; ++j)
+	{
+		dst[j] = UnpackHeight(src[j], format, scale);
+	}
+}
+
+void WavesKernels::PackRow(const float* src, USHORT* dst, UINT count, PackFormat format, float scale)
+{
+	UINT j = 0;
+	const float invScale = 1.f / scale;
+
+#if WAVES_X86
+	if (format == PACK_FP16 && HasF16C())
+	{
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(src + j), _MM_FROUND_TO_NEAREST_INT);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), h);
+		}
+		_mm256_zeroupper();
+	}
+	else if (format == PACK_FIXED16 && ActiveSimdLevel() != SIMD_SCALAR)
+	{
+		// cvtps_epi32 rounds to nearest even like lrintf; packs saturates,
+		// but the clamp already keeps every lane in range.
+		const __m128 I = _mm_set1_ps(invScale);
+		const __m128 Lo = _mm_set1_ps(-32768.f);
+		const __m128 Hi = _mm_set1_ps(32767.f);
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + j), I), Lo), Hi);
+			const __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + j + 4), I), Lo), Hi);
+			const __m128i q = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j), q);
+		}
+	}
+#endif
+
+	for (; j < count; ++j)
+	{
+		dst[j] = format == PACK_FP16 ? FloatToHalf(src[j]) : (USHORT)FloatToFixed(src[j], invScale);
+	}
+}
+
+namespace
+{
+	inline void StreamFloat(BYTE* dest, float value)
+	{
+#if WAVES_X86
+		if (ActiveSimdLevel() != WavesKernels::SIMD_SCALAR)
+		{
+			FloatBits bits;
+			bits.F = value;
+			_mm_stream_si32(reinterpret_cast<int*>(dest), (int)bits.U);
+			return;
+		}
+#endif
+		*reinterpret_cast<float*>(dest) = value;
+	}
+}
+
+void WavesKernels::StreamFloat3Row(BYTE* dest, UINT stride, UINT count,
+	const float* a, UINT aStride, const float* b, UINT bStride, const float* c, UINT cStride)
+{
+	UINT j = 0;
+
+#if WAVES_X86
+	const bool packed = stride == 3 * sizeof(float) && aStride == 1 && bStride == 1 && cStride <= 1;
+	if (packed && ActiveSimdLevel() != SIMD_SCALAR)
+	{
+		// Streaming needs 16-byte alignment; four float3s realign a 4-byte
+		// aligned destination within the first three.
+		while (j < count && (reinterpret_cast<size_t>(dest + j * stride) & 15) != 0)
+		{
+			StreamFloat(dest + j * stride, a[j]);
+			StreamFloat(dest + j * stride + 4, b[j]);
+			StreamFloat(dest + j * stride + 8, c[j * cStride]);
+			++j;
+		}
+
+		for (; j + 4 <= count; j += 4)
+		{
+			const __m128 A = _mm_loadu_ps(a + j);
+			const __m128 B = _mm_loadu_ps(b + j);
+			const __m128 C = cStride != 0 ? _mm_loadu_ps(c + j) : _mm_set1_ps(c[0]);
+
+			// a0 b0 c0 a1 | b1 c1 a2 b2 | c2 a3 b3 c3
+			const __m128 lo = _mm_unpacklo_ps(A, B);
+			const __m128 hi = _mm_unpackhi_ps(A, B);
+			const __m128 t0 = _mm_shuffle_ps(C, lo, _MM_SHUFFLE(2, 2, 0, 0));
+			const __m128 t1 = _mm_shuffle_ps(lo, C, _MM_SHUFFLE(1, 1, 3, 3));
+			const __m128 t2 = _mm_shuffle_ps(C, hi, _MM_SHUFFLE(3, 2, 2, 2));
+			const __m128 t3 = _mm_shuffle_ps(hi, C, _MM_SHUFFLE(3, 3, 3, 3));
+
+			float* out = reinterpret_cast<float*>(dest + j * stride);
+			_mm_stream_ps(out, _mm_shuffle_ps(lo, t0, _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_stream_ps(out + 4, _mm_shuffle_ps(t1, hi, _MM_SHUFFLE(1, 0, 2, 0)));
+			_mm_stream_ps(out + 8, _mm_shuffle_ps(t2, t3, _MM_SHUFFLE(2, 0, 2, 0)));
+		}
+	}
+#endif
+
+	for (; j < count; ++j)
+	{
+		BYTE* v = dest + j * stride;
+		StreamFloat(v, a[j * aStride]);
+		StreamFloat(v + 4, b[j * bStride]);
+		StreamFloat(v + 8, c[j * cStride]);
+	}
+}
+
+void WavesKernels::StreamFloatRow(BYTE* dest, UINT stride, UINT count, const float* a, UINT aStride)
+{
+	for (UINT j = 0; j < count; ++j)
+	{
+		StreamFloat(dest + j * stride, a[j * aStride]);
+	}
+}
+
+void WavesKernels::EndStreaming()
+{
+#if WAVES_X86
+	_mm_sfence();
+#endif
+}
+
+namespace
+{
+	void ImplicitRhsRowScalar(float* out,
+		const float* prevUp, const float* prev, const float* prevDown,
+		const float* up, const float* curr, const float* down,
+		UINT count, float q1, float q2, float q3, float q4)
+	{
+		const float* right = curr + 1;
+		const float* left = curr - 1;
+		const float* prevRight = prev + 1;
+		const float* prevLeft = prev - 1;
+
+		for (UINT j = 0; j < count; ++j)
+		{
+			out[j] =
+				q1 * curr[j] +
+				q2 * (down[j] + up[j] + right[j] + left[j]) +
+				q3 * prev[j] +
+				q4 * (prevDown[j] + prevUp[j] + prevRight[j] + prevLeft[j]);
+		}
+	}
+
+	// Thomas sweep with the factorisation from FactorTridiagonal():
+	//   d'[0] = d[0] * inv[0],  d'[k] = (d[k] + r * d'[k - 1]) * inv[k]
+	//   x[k] = d'[k] + upper[k] * x[k + 1]
+	void SolveLineScalar(float* x, UINT length, UINT stride, float r, const float* inv, const float* upper)
+	{
+		x[0] = x[0] * inv[0];
+		for (UINT k = 1; k < length; ++k)
+		{
+			x[k * stride] = (x[k * stride] + r * x[(k - 1) * stride]) * inv[k];
+		}
+		for (UINT k = length - 1; k-- > 0;)
+		{
+			x[k * stride] = x[k * stride] + upper[k] * x[(k + 1) * stride];
+		}
+	}
+
+#if WAVES_X86
+	void ImplicitRhsRowSSE2(float* out,
+		const float* prevUp, const float* prev, const float* prevDown,
+		const float* up, const float* curr, const float* down,
+		UINT count, float q1, float q2, float q3, float q4)
+	{
+		const __m128 Q1 = _mm_set1_ps(q1);
+		const __m128 Q2 = _mm_set1_ps(q2);
+		const __m128 Q3 = _mm_set1_ps(q3);
+		const __m128 Q4 = _mm_set1_ps(q4);
+
+		UINT j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j + 1));
+			sum = _mm_add_ps(sum, _mm_loadu_ps(curr + j - 1));
+
+			__m128 prevSum = _mm_add_ps(_mm_loadu_ps(prevDown + j), _mm_loadu_ps(prevUp + j));
+			prevSum = _mm_add_ps(prevSum, _mm_loadu_ps(prev + j + 1));
+			prevSum = _mm_add_ps(prevSum, _mm_loadu_ps(prev + j - 1));
+
+			__m128 h = _mm_mul_ps(Q1, _mm_loadu_ps(curr + j));
+			h = _mm_add_ps(h, _mm_mul_ps(Q2, sum));
+			h = _mm_add_ps(h, _mm_mul_ps(Q3, _mm_loadu_ps(prev + j)));
+			h = _mm_add_ps(h, _mm_mul_ps(Q4, prevSum));
+
+			_mm_storeu_ps(out + j, h);
+		}
+
+		ImplicitRhsRowScalar(out + j, prevUp + j, prev + j, prevDown + j,
+			up + j, curr + j, down + j, count - j, q1, q2, q3, q4);
+	}
+
+	void ImplicitRhsRowAVX2(float* out,
+		const float* prevUp, const float* prev, const float* prevDown,
+		const float* up, const float* curr, const float* down,
+		UINT count, float q1, float q2, float q3, float q4)
+	{
+		const __m256 Q1 = _mm256_set1_ps(q1);
+		const __m256 Q2 = _mm256_set1_ps(q2);
+		const __m256 Q3 = _mm256_set1_ps(q3);
+		const __m256 Q4 = _mm256_set1_ps(q4);
+
+		UINT j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			__m256 sum = _mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j + 1));
+			sum = _mm256_add_ps(sum, _mm256_loadu_ps(curr + j - 1));
+
+			__m256 prevSum = _mm256_add_ps(_mm256_loadu_ps(prevDown + j), _mm256_loadu_ps(prevUp + j));
+			prevSum = _mm256_add_ps(prevSum, _mm256_loadu_ps(prev + j + 1));
+			prevSum = _mm256_add_ps(prevSum, _mm256_loadu_ps(prev + j - 1));
+
+			__m256 h = _mm256_mul_ps(Q1, _mm256_loadu_ps(curr + j));
+			h = _mm256_add_ps(h, _mm256_mul_ps(Q2, sum));
+			h = _mm256_add_ps(h, _mm256_mul_ps(Q3, _mm256_loadu_ps(prev + j)));
+			h = _mm256_add_ps(h, _mm256_mul_ps(Q4, prevSum));
+
+			_mm256_storeu_ps(out + j, h);
+		}
+
+		_mm256_zeroupper();
+
+		ImplicitRhsRowScalar(out + j, prevUp + j, prev + j, prevDown + j,
+			up + j, curr + j, down + j, count - j, q1, q2, q3, q4);
+	}
+
+	// 4 * Vectors adjacent lines, one per lane.  The recurrence is a chain
+	// of dependent adds and multiplies, so several registers are swept side
+	// by side to keep the pipeline busy.
+	template<UINT Vectors>
+	void SolveLinesSSE2(float* x, UINT length, UINT stride, float r, const float* inv, const float* upper)
+	{
+		const __m128 R = _mm_set1_ps(r);
+		__m128 d[Vectors];
+
+		const __m128 I0 = _mm_set1_ps(inv[0]);
+		for (UINT v = 0; v < Vectors; ++v)
+		{
+			d[v] = _mm_mul_ps(_mm_loadu_ps(x + 4 * v), I0);
+			_mm_storeu_ps(x + 4 * v, d[v]);
+		}
+		for (UINT k = 1; k < length; ++k)
+		{
+			float* row = x + k * stride;
+			const __m128 I = _mm_set1_ps(inv[k]);
+			for (UINT v = 0; v < Vectors; ++v)
+			{
+				d[v] = _mm_mul_ps(_mm_add_ps(_mm_loadu_ps(row + 4 * v), _mm_mul_ps(R, d[v])), I);
+				_mm_storeu_ps(row + 4 * v, d[v]);
+			}
+		}
+		for (UINT k = length - 1; k-- > 0;)
+		{
+			float* row = x + k * stride;
+			const __m128 U = _mm_set1_ps(upper[k]);
+			for (UINT v = 0; v < Vectors; ++v)
+			{
+				d[v] = _mm_add_ps(_mm_loadu_ps(row + 4 * v), _mm_mul_ps(U, d[v]));
+				_mm_storeu_ps(row + 4 * v, d[v]);
+			}
+		}
+	}
+
+	template<UINT Vectors>
+	void SolveLinesAVX2(float* x, UINT length, UINT stride, float r, const float* inv, const float* upper)
+	{
+		const __m256 R = _mm256_set1_ps(r);
+		__m256 d[Vectors];
+
+		const __m256 I0 = _mm256_set1_ps(inv[0]);
+		for (UINT v = 0; v < Vectors; ++v)
+		{
+			d[v] = _mm256_mul_ps(_mm256_loadu_ps(x + 8 * v), I0);
+			_mm256_storeu_ps(x + 8 * v, d[v]);
+		}
+		for (UINT k = 1; k < length; ++k)
+		{
+			float* row = x + k * stride;
+			const __m256 I = _mm256_set1_ps(inv[k]);
+			for (UINT v = 0; v < Vectors; ++v)
+			{
+				d[v] = _mm256_mul_ps(_mm256_add_ps(_mm256_loadu_ps(row + 8 * v), _mm256_mul_ps(R, d[v])), I);
+				_mm256_storeu_ps(row + 8 * v, d[v]);
+			}
+		}
+		for (UINT k = length - 1; k-- > 0;)
+		{
+			float* row = x + k * stride;
+			const __m256 U = _mm256_set1_ps(upper[k]);
+			for (UINT v = 0; v < Vectors; ++v)
+			{
+				d[v] = _mm256_add_ps(_mm256_loadu_ps(row + 8 * v), _mm256_mul_ps(U, d[v]));
+				_mm256_storeu_ps(row + 8 * v, d[v]);
+			}
+		}
+
+		_mm256_zeroupper();
+	}
+
+	inline __m128 GatherLines(float* const* rows, UINT k)
+	{
+		return _mm_set_ps(rows[3][k], rows[2][k], rows[1][k], rows[0][k]);
+	}
+
+	inline void ScatterLines(float* const* rows, UINT k, __m128 v)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, v);
+		for (UINT l = 0; l < 4; ++l)
+		{
+			rows[l][k] = lanes[l];
+		}
+	}
+
+	// 4 * Groups unit-stride lines lineStride apart.  Each 4x4 block of a
+	// group is transposed so a register holds the same cell of four lines,
+	// swept, and transposed back; a ragged end goes through lane gathers.
+	// Groups are independent chains interleaved like the registers above.
+	template<UINT Groups>
+	void SolveRowsSSE2(float* x, UINT length, UINT lineStride, float r, const float* inv, const float* upper)
+	{
+		float* rows[4 * Groups];
+		for (UINT l = 0; l < 4 * Groups; ++l)
+		{
+			rows[l] = x + l * lineStride;
+		}
+
+		const __m128 R = _mm_set1_ps(r);
+		const UINT full = length & ~3u;
+		__m128 c[Groups][4];
+		__m128 d[Groups];
+		for (UINT g = 0; g < Groups; ++g)
+		{
+			d[g] = _mm_setzero_ps();
+		}
+
+		for (UINT k = 0; k < full; k += 4)
+		{
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				float* const* gr = rows + 4 * g;
+				c[g][0] = _mm_loadu_ps(gr[0] + k);
+				c[g][1] = _mm_loadu_ps(gr[1] + k);
+				c[g][2] = _mm_loadu_ps(gr[2] + k);
+				c[g][3] = _mm_loadu_ps(gr[3] + k);
+				_MM_TRANSPOSE4_PS(c[g][0], c[g][1], c[g][2], c[g][3]);
+
+				c[g][0] = k == 0 ?
+					_mm_mul_ps(c[g][0], _mm_set1_ps(inv[0])) :
+					_mm_mul_ps(_mm_add_ps(c[g][0], _mm_mul_ps(R, d[g])), _mm_set1_ps(inv[k]));
+			}
+			for (UINT t = 1; t < 4; ++t)
+			{
+				const __m128 I = _mm_set1_ps(inv[k + t]);
+				for (UINT g = 0; g < Groups; ++g)
+				{
+					c[g][t] = _mm_mul_ps(_mm_add_ps(c[g][t], _mm_mul_ps(R, c[g][t - 1])), I);
+				}
+			}
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				float* const* gr = rows + 4 * g;
+				d[g] = c[g][3];
+				_MM_TRANSPOSE4_PS(c[g][0], c[g][1], c[g][2], c[g][3]);
+				_mm_storeu_ps(gr[0] + k, c[g][0]);
+				_mm_storeu_ps(gr[1] + k, c[g][1]);
+				_mm_storeu_ps(gr[2] + k, c[g][2]);
+				_mm_storeu_ps(gr[3] + k, c[g][3]);
+			}
+		}
+		for (UINT k = full; k < length; ++k)
+		{
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				const __m128 v = GatherLines(rows + 4 * g, k);
+				d[g] = k == 0 ?
+					_mm_mul_ps(v, _mm_set1_ps(inv[0])) :
+					_mm_mul_ps(_mm_add_ps(v, _mm_mul_ps(R, d[g])), _mm_set1_ps(inv[k]));
+				ScatterLines(rows + 4 * g, k, d[g]);
+			}
+		}
+
+		// d now holds the last cell, which is already final.
+		for (UINT k = length - 1; k-- > full;)
+		{
+			const __m128 U = _mm_set1_ps(upper[k]);
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				d[g] = _mm_add_ps(GatherLines(rows + 4 * g, k), _mm_mul_ps(U, d[g]));
+				ScatterLines(rows + 4 * g, k, d[g]);
+			}
+		}
+		for (UINT k = full; k >= 4; k -= 4)
+		{
+			const UINT b = k - 4;
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				float* const* gr = rows + 4 * g;
+				c[g][0] = _mm_loadu_ps(gr[0] + b);
+				c[g][1] = _mm_loadu_ps(gr[1] + b);
+				c[g][2] = _mm_loadu_ps(gr[2] + b);
+				c[g][3] = _mm_loadu_ps(gr[3] + b);
+				_MM_TRANSPOSE4_PS(c[g][0], c[g][1], c[g][2], c[g][3]);
+
+				if (k < length)
+				{
+					c[g][3] = _mm_add_ps(c[g][3], _mm_mul_ps(_mm_set1_ps(upper[b + 3]), d[g]));
+				}
+			}
+			for (UINT t = 3; t-- > 0;)
+			{
+				const __m128 U = _mm_set1_ps(upper[b + t]);
+				for (UINT g = 0; g < Groups; ++g)
+				{
+					c[g][t] = _mm_add_ps(c[g][t], _mm_mul_ps(U, c[g][t + 1]));
+				}
+			}
+			for (UINT g = 0; g < Groups; ++g)
+			{
+				float* const* gr = rows + 4 * g;
+				d[g] = c[g][0];
+				_MM_TRANSPOSE4_PS(c[g][0], c[g][1], c[g][2], c[g][3]);
+				_mm_storeu_ps(gr[0] + b, c[g][0]);
+				_mm_storeu_ps(gr[1] + b, c[g][1]);
+				_mm_storeu_ps(gr[2] + b, c[g][2]);
+				_mm_storeu_ps(gr[3] + b, c[g][3]);
+			}
+		}
+	}
+#endif
+}
+
+void WavesKernels::ImplicitRhsRow(float* out,
+	const float* prevUp, const float* prev, const float* prevDown,
+	const float* up, const float* curr, const float* down,
+	UINT count, float q1, float q2, float q3, float q4)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		ImplicitRhsRowAVX2(out, prevUp, prev, prevDown, up, curr, down, count, q1, q2, q3, q4);
+		return;
+	case SIMD_SSE2:
+		ImplicitRhsRowSSE2(out, prevUp, prev, prevDown, up, curr, down, count, q1, q2, q3, q4);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	ImplicitRhsRowScalar(out, prevUp, prev, prevDown, up, curr, down, count, q1, q2, q3, q4);
+}
+
+void WavesKernels::FactorTridiagonal(float r, UINT length, float* inv, float* upper)
+{
+	// Diagonally dominant for any r >= 0, so no pivoting is needed.
+	const float diagonal = 1.f + 2.f * r;
+
+	inv[0] = 1.f / diagonal;
+	upper[0] = r * inv[0];
+	for (UINT k = 1; k < length; ++k)
+	{
+		inv[k] = 1.f / (diagonal - r * upper[k - 1]);
+		upper[k] = r * inv[k];
+	}
+}
+
+void WavesKernels::SolveTridiagonal(float* data, UINT length, UINT elementStride,
+	UINT lineCount, UINT lineStride, float r, const float* inv, const float* upper)
+{
+	UINT l = 0;
+
+#if WAVES_X86
+	const SimdLevel level = ActiveSimdLevel();
+	if (lineStride == 1 && level == SIMD_AVX2)
+	{
+		for (; l + 32 <= lineCount; l += 32)
+		{
+			SolveLinesAVX2<4>(data + l, length, elementStride, r, inv, upper);
+		}
+		for (; l + 8 <= lineCount; l += 8)
+		{
+			SolveLinesAVX2<1>(data + l, length, elementStride, r, inv, upper);
+		}
+	}
+	if (lineStride == 1 && level != SIMD_SCALAR)
+	{
+		for (; l + 16 <= lineCount; l += 16)
+		{
+			SolveLinesSSE2<4>(data + l, length, elementStride, r, inv, upper);
+		}
+		for (; l + 4 <= lineCount; l += 4)
+		{
+			SolveLinesSSE2<1>(data + l, length, elementStride, r, inv, upper);
+		}
+	}
+	else if (elementStride == 1 && level != SIMD_SCALAR)
+	{
+		for (; l + 8 <= lineCount; l += 8)
+		{
+			SolveRowsSSE2<2>(data + l * lineStride, length, lineStride, r, inv, upper);
+		}
+		for (; l + 4 <= lineCount; l += 4)
+		{
+			SolveRowsSSE2<1>(data + l * lineStride, length, lineStride, r, inv, upper);
+		}
+	}
+#endif
+
+	for (; l < lineCount; ++l)
+	{
+		SolveLineScalar(data + l * lineStride, length, elementStride, r, inv, upper);
+	}
+}
+
+WavesKernels::FlushDenormalsScope::FlushDenormalsScope()
+	: mSavedMode(0)
+{
+#if WAVES_X86
+	mSavedMode = _mm_getcsr();
+	_mm_setcsr(mSavedMode | _MM_FLUSH_ZERO_ON | _MM_DENORMALS_ZERO_ON);
+#endif
+}
+
+WavesKernels::FlushDenormalsScope::~FlushDenormalsScope()
+{
+#if WAVES_X86
+	_mm_setcsr(mSavedMode);
+#endif
+}
+
+namespace
+{
+	// Cody-Waite split of pi / 2; the first two parts have few enough bits
+	// that j * part is exact for the quadrant counts we care about.
+	const float TwoOverPi = 0.636619772367581343f;
+	const float HalfPiA = 1.5703125f;
+	const float HalfPiB = 4.837512969970703125e-4f;
+	const float HalfPiC = 7.54978995489188216e-8f;
+
+	// Cephes single precision coefficients on [-pi/4, pi/4].
+	const float SinC0 = -1.6666654611e-1f;
+	const float SinC1 = 8.3321608736e-3f;
+	const float SinC2 = -1.9515295891e-4f;
+	const float CosC0 = 4.166664568298827e-2f;
+	const float CosC1 = -1.388731625493765e-3f;
+	const float CosC2 = 2.443315711809948e-5f;
+
+	void ButterflyScalar(float* ar, float* ai, float* br, float* bi,
+		const float* wr, const float* wi, UINT wStride, UINT count)
+	{
+		for (UINT j = 0; j < count; ++j)
+		{
+			const float w0 = wr[j * wStride];
+			const float w1 = wi[j * wStride];
+			const float tr = br[j] * w0 - bi[j] * w1;
+			const float ti = br[j] * w1 + bi[j] * w0;
+			br[j] = ar[j] - tr;
+			bi[j] = ai[j] - ti;
+			ar[j] = ar[j] + tr;
+			ai[j] = ai[j] + ti;
+		}
+	}
+
+	void SinCosScalar(float x, float& s, float& c)
+	{
+		// lrintf rounds to nearest even, as cvtps2dq does.
+		const int q = (int)lrintf(x * TwoOverPi);
+		const float j = (float)q;
+		const float y = ((x - j * HalfPiA) - j * HalfPiB) - j * HalfPiC;
+		const float y2 = y * y;
+
+		const float ps = (SinC2 * y2 + SinC1) * y2 + SinC0;
+		const float sinY = y + (y * y2) * ps;
+		const float pc = (CosC2 * y2 + CosC1) * y2 + CosC0;
+		const float cosY = (1.f - 0.5f * y2) + (y2 * y2) * pc;
+
+		// Quadrant: swap on odd q, then sin flips on q & 2 and cos on (q + 1) & 2.
+		float sv = (q & 1) ? cosY : sinY;
+		float cv = (q & 1) ? sinY : cosY;
+		s = (q & 2) ? -sv : sv;
+		c = ((q + 1) & 2) ? -cv : cv;
+	}
+
+	void GerstnerScalar(const float* x, const float* z, UINT zStride, UINT count,
+		const WavesKernels::GerstnerTerm* terms, UINT termCount, float* outX, float* outY, float* outZ)
+	{
+		for (UINT k = 0; k < count; ++k)
+		{
+			const float px = x[k];
+			const float pz = z[k * zStride];
+			float sumX = 0.f;
+			float sumY = 0.f;
+			float sumZ = 0.f;
+
+			for (UINT w = 0; w < termCount; ++w)
+			{
+				const WavesKernels::GerstnerTerm& t = terms[w];
+				float sv, cv;
+				SinCosScalar((t.Kx * px + t.Kz * pz) + t.Offset, sv, cv);
+				sumX = sumX + t.DisplaceX * cv;
+				sumY = sumY + t.Amplitude * sv;
+				sumZ = sumZ + t.DisplaceZ * cv;
+			}
+
+			outX[k] = px + sumX;
+			outY[k] = sumY;
+			outZ[k] = pz + sumZ;
+		}
+	}
+
+#if WAVES_X86
+	void ButterflySSE2(float* ar, float* ai, float* br, float* bi,
+		const float* wr, const float* wi, bool broadcast, UINT count)
+	{
+		UINT j = 0;
+		for (; j + 4 <= count; j += 4)
+		{
+			const __m128 w0 = broadcast ? _mm_set1_ps(wr[0]) : _mm_loadu_ps(wr + j);
+			const __m128 w1 = broadcast ? _mm_set1_ps(wi[0]) : _mm_loadu_ps(wi + j);
+			const __m128 xr = _mm_loadu_ps(br + j);
+			const __m128 xi = _mm_loadu_ps(bi + j);
+			const __m128 tr = _mm_sub_ps(_mm_mul_ps(xr, w0), _mm_mul_ps(xi, w1));
+			const __m128 ti = _mm_add_ps(_mm_mul_ps(xr, w1), _mm_mul_ps(xi, w0));
+			const __m128 yr = _mm_loadu_ps(ar + j);
+			const __m128 yi = _mm_loadu_ps(ai + j);
+			_mm_storeu_ps(br + j, _mm_sub_ps(yr, tr));
+			_mm_storeu_ps(bi + j, _mm_sub_ps(yi, ti));
+			_mm_storeu_ps(ar + j, _mm_add_ps(yr, tr));
+			_mm_storeu_ps(ai + j, _mm_add_ps(yi, ti));
+		}
+
+		const UINT wStride = broadcast ? 0 : 1;
+		ButterflyScalar(ar + j, ai + j, br + j, bi + j,
+			wr + j * wStride, wi + j * wStride, wStride, count - j);
+	}
+
+	void ButterflyAVX2(float* ar, float* ai, float* br, float* bi,
+		const float* wr, const float* wi, bool broadcast, UINT count)
+	{
+		UINT j = 0;
+		for (; j + 8 <= count; j += 8)
+		{
+			const __m256 w0 = broadcast ? _mm256_set1_ps(wr[0]) : _mm256_loadu_ps(wr + j);
+			const __m256 w1 = broadcast ? _mm256_set1_ps(wi[0]) : _mm256_loadu_ps(wi + j);
+			const __m256 xr = _mm256_loadu_ps(br + j);
+			const __m256 xi = _mm256_loadu_ps(bi + j);
+			const __m256 tr = _mm256_sub_ps(_mm256_mul_ps(xr, w0), _mm256_mul_ps(xi, w1));
+			const __m256 ti = _mm256_add_ps(_mm256_mul_ps(xr, w1), _mm256_mul_ps(xi, w0));
+			const __m256 yr = _mm256_loadu_ps(ar + j);
+			const __m256 yi = _mm256_loadu_ps(ai + j);
+			_mm256_storeu_ps(br + j, _mm256_sub_ps(yr, tr));
+			_mm256_storeu_ps(bi + j, _mm256_sub_ps(yi, ti));
+			_mm256_storeu_ps(ar + j, _mm256_add_ps(yr, tr));
+			_mm256_storeu_ps(ai + j, _mm256_add_ps(yi, ti));
+		}
+
+		_mm256_zeroupper();
+
+		ButterflySSE2(ar + j, ai + j, br + j, bi + j,
+			broadcast ? wr : wr + j, broadcast ? wi : wi + j, broadcast, count - j);
+	}
+
+	void SinCos4(__m128 v, __m128& s, __m128& c)
+	{
+		const __m128 One = _mm_set1_ps(1.f);
+		const __m128 Half = _mm_set1_ps(0.5f);
+		const __m128 Sign = _mm_set1_ps(-0.f);
+		const __m128i IntOne = _mm_set1_epi32(1);
+
+		const __m128i q = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(TwoOverPi)));
+		const __m128 j = _mm_cvtepi32_ps(q);
+
+		__m128 y = _mm_sub_ps(v, _mm_mul_ps(j, _mm_set1_ps(HalfPiA)));
+		y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(HalfPiB)));
+		y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(HalfPiC)));
+		const __m128 y2 = _mm_mul_ps(y, y);
+
+		__m128 ps = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SinC2), y2), _mm_set1_ps(SinC1));
+		ps = _mm_add_ps(_mm_mul_ps(ps, y2), _mm_set1_ps(SinC0));
+		const __m128 sinY = _mm_add_ps(y, _mm_mul_ps(_mm_mul_ps(y, y2), ps));
+
+		__m128 pc = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(CosC2), y2), _mm_set1_ps(CosC1));
+		pc = _mm_add_ps(_mm_mul_ps(pc, y2), _mm_set1_ps(CosC0));
+		const __m128 cosY = _mm_add_ps(_mm_sub_ps(One, _mm_mul_ps(Half, y2)), _mm_mul_ps(_mm_mul_ps(y2, y2), pc));
+
+		const __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, IntOne), IntOne));
+		const __m128 sv = _mm_or_ps(_mm_and_ps(swap, cosY), _mm_andnot_ps(swap, sinY));
+		const __m128 cv = _mm_or_ps(_mm_and_ps(swap, sinY), _mm_andnot_ps(swap, cosY));
+
+		// Bit 1 of q, or of q + 1, moved up to the sign bit.
+		const __m128 sinSign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(q, 30)), Sign);
+		const __m128 cosSign = _mm_and_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(q, IntOne), 30)), Sign);
+		s = _mm_xor_ps(sv, sinSign);
+		c = _mm_xor_ps(cv, cosSign);
+	}
+
+	void SinCos8(__m256 v, __m256& s, __m256& c)
+	{
+		const __m256 One = _mm256_set1_ps(1.f);
+		const __m256 Half = _mm256_set1_ps(0.5f);
+		const __m256 Sign = _mm256_set1_ps(-0.f);
+		const __m256i IntOne = _mm256_set1_epi32(1);
+
+		const __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(TwoOverPi)));
+		const __m256 j = _mm256_cvtepi32_ps(q);
+
+		__m256 y = _mm256_sub_ps(v, _mm256_mul_ps(j, _mm256_set1_ps(HalfPiA)));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(j, _mm256_set1_ps(HalfPiB)));
+		y = _mm256_sub_ps(y, _mm256_mul_ps(j, _mm256_set1_ps(HalfPiC)));
+		const __m256 y2 = _mm256_mul_ps(y, y);
+
+		__m256 ps = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(SinC2), y2), _mm256_set1_ps(SinC1));
+		ps = _mm256_add_ps(_mm256_mul_ps(ps, y2), _mm256_set1_ps(SinC0));
+		const __m256 sinY = _mm256_add_ps(y, _mm256_mul_ps(_mm256_mul_ps(y, y2), ps));
+
+		__m256 pc = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(CosC2), y2), _mm256_set1_ps(CosC1));
+		pc = _mm256_add_ps(_mm256_mul_ps(pc, y2), _mm256_set1_ps(CosC0));
+		const __m256 cosY = _mm256_add_ps(_mm256_sub_ps(One, _mm256_mul_ps(Half, y2)),
+			_mm256_mul_ps(_mm256_mul_ps(y2, y2), pc));
+
+		const __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, IntOne), IntOne));
+		const __m256 sv = _mm256_blendv_ps(sinY, cosY, swap);
+		const __m256 cv = _mm256_blendv_ps(cosY, sinY, swap);
+
+		const __m256 sinSign = _mm256_and_ps(_mm256_castsi256_ps(_mm256_slli_epi32(q, 30)), Sign);
+		const __m256 cosSign = _mm256_and_ps(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(q, IntOne), 30)), Sign);
+		s = _mm256_xor_ps(sv, sinSign);
+		c = _mm256_xor_ps(cv, cosSign);
+	}
+
+	void SinCosSSE2(const float* x, float* s, float* c, UINT count)
+	{
+		UINT k = 0;
+		for (; k + 4 <= count; k += 4)
+		{
+			__m128 sv, cv;
+			SinCos4(_mm_loadu_ps(x + k), sv, cv);
+			_mm_storeu_ps(s + k, sv);
+			_mm_storeu_ps(c + k, cv);
+		}
+
+		for (; k < count; ++k)
+		{
+			SinCosScalar(x[k], s[k], c[k]);
+		}
+	}
+
+	void SinCosAVX2(const float* x, float* s, float* c, UINT count)
+	{
+		UINT k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			__m256 sv, cv;
+			SinCos8(_mm256_loadu_ps(x + k), sv, cv);
+			_mm256_storeu_ps(s + k, sv);
+			_mm256_storeu_ps(c + k, cv);
+		}
+
+		_mm256_zeroupper();
+
+		SinCosSSE2(x + k, s + k, c + k, count - k);
+	}
+
+	void GerstnerSSE2(const float* x, const float* z, UINT zStride, UINT count,
+		const WavesKernels::GerstnerTerm* terms, UINT termCount, float* outX, float* outY, float* outZ)
+	{
+		UINT k = 0;
+		for (; k + 4 <= count; k += 4)
+		{
+			const __m128 px = _mm_loadu_ps(x + k);
+			const __m128 pz = zStride == 0 ? _mm_set1_ps(z[0]) : _mm_loadu_ps(z + k);
+			__m128 sumX = _mm_setzero_ps();
+			__m128 sumY = _mm_setzero_ps();
+			__m128 sumZ = _mm_setzero_ps();
+
+			for (UINT w = 0; w < termCount; ++w)
+			{
+				const WavesKernels::GerstnerTerm& t = terms[w];
+				const __m128 theta = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.Kx), px),
+					_mm_mul_ps(_mm_set1_ps(t.Kz), pz)), _mm_set1_ps(t.Offset));
+
+				__m128 sv, cv;
+				SinCos4(theta, sv, cv);
+				sumX = _mm_add_ps(sumX, _mm_mul_ps(_mm_set1_ps(t.DisplaceX), cv));
+				sumY = _mm_add_ps(sumY, _mm_mul_ps(_mm_set1_ps(t.Amplitude), sv));
+				sumZ = _mm_add_ps(sumZ, _mm_mul_ps(_mm_set1_ps(t.DisplaceZ), cv));
+			}
+
+			_mm_storeu_ps(outX + k, _mm_add_ps(px, sumX));
+			_mm_storeu_ps(outY + k, sumY);
+			_mm_storeu_ps(outZ + k, _mm_add_ps(pz, sumZ));
+		}
+
+		GerstnerScalar(x + k, z + k * zStride, zStride, count - k, terms, termCount,
+			outX + k, outY + k, outZ + k);
+	}
+
+	void GerstnerAVX2(const float* x, const float* z, UINT zStride, UINT count,
+		const WavesKernels::GerstnerTerm* terms, UINT termCount, float* outX, float* outY, float* outZ)
+	{
+		UINT k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			const __m256 px = _mm256_loadu_ps(x + k);
+			const __m256 pz = zStride == 0 ? _mm256_set1_ps(z[0]) : _mm256_loadu_ps(z + k);
+			__m256 sumX = _mm256_setzero_ps();
+			__m256 sumY = _mm256_setzero_ps();
+			__m256 sumZ = _mm256_setzero_ps();
+
+			for (UINT w = 0; w < termCount; ++w)
+			{
+				const WavesKernels::GerstnerTerm& t = terms[w];
+				const __m256 theta = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(t.Kx), px),
+					_mm256_mul_ps(_mm256_set1_ps(t.Kz), pz)), _mm256_set1_ps(t.Offset));
+
+				__m256 sv, cv;
+				SinCos8(theta, sv, cv);
+				sumX = _mm256_add_ps(sumX, _mm256_mul_ps(_mm256_set1_ps(t.DisplaceX), cv));
+				sumY = _mm256_add_ps(sumY, _mm256_mul_ps(_mm256_set1_ps(t.Amplitude), sv));
+				sumZ = _mm256_add_ps(sumZ, _mm256_mul_ps(_mm256_set1_ps(t.DisplaceZ), cv));
+			}
+
+			_mm256_storeu_ps(outX + k, _mm256_add_ps(px, sumX));
+			_mm256_storeu_ps(outY + k, sumY);
+			_mm256_storeu_ps(outZ + k, _mm256_add_ps(pz, sumZ));
+		}
+
+		_mm256_zeroupper();
+
+		GerstnerSSE2(x + k, z + k * zStride, zStride, count - k, terms, termCount,
+			outX + k, outY + k, outZ + k);
+	}
+#endif
+}
+
+void WavesKernels::Butterfly(float* ar, float* ai, float* br, float* bi,
+	const float* wr, const float* wi, UINT count)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		ButterflyAVX2(ar, ai, br, bi, wr, wi, false, count);
+		return;
+	case SIMD_SSE2:
+		ButterflySSE2(ar, ai, br, bi, wr, wi, false, count);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	ButterflyScalar(ar, ai, br, bi, wr, wi, 1, count);
+}
+
+void WavesKernels::ButterflyBroadcast(float* ar, float* ai, float* br, float* bi,
+	float wr, float wi, UINT count)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		ButterflyAVX2(ar, ai, br, bi, &wr, &wi, true, count);
+		return;
+	case SIMD_SSE2:
+		ButterflySSE2(ar, ai, br, bi, &wr, &wi, true, count);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	ButterflyScalar(ar, ai, br, bi, &wr, &wi, 0, count);
+}
+
+void WavesKernels::SinCosRow(const float* x, float* s, float* c, UINT count)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		SinCosAVX2(x, s, c, count);
+		return;
+	case SIMD_SSE2:
+		SinCosSSE2(x, s, c, count);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	for (UINT k = 0; k < count; ++k)
+	{
+		SinCosScalar(x[k], s[k], c[k]);
+	}
+}
+
+void WavesKernels::GerstnerRow(const float* x, const float* z, UINT zStride, UINT count,
+	const GerstnerTerm* terms, UINT termCount, float* outX, float* outY, float* outZ)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		GerstnerAVX2(x, z, zStride, count, terms, termCount, outX, outY, outZ);
+		return;
+	case SIMD_SSE2:
+		GerstnerSSE2(x, z, zStride, count, terms, termCount, outX, outY, outZ);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	GerstnerScalar(x, z, zStride, count, terms, termCount, outX, outY, outZ);
+}
+
+namespace
+{
+	// The clamps are written as maxps / minps evaluate them, so a NaN
+	// coordinate lands on the same cell in every path.
+	void BilinearScalar(const WavesKernels::SampleGrid& g, const float* x, const float* z, UINT count,
+		float* outH, float* outGradX, float* outGradZ)
+	{
+		const float maxU = (float)(g.Cols - 1);
+		const float maxV = (float)(g.Rows - 1);
+		const float lastCol = (float)(g.Cols - 2);
+		const float lastRow = (float)(g.Rows - 2);
+
+		for (UINT k = 0; k < count; ++k)
+		{
+			float u = (x[k] - g.OriginX) * g.InvDx;
+			float v = (g.OriginZ - z[k]) * g.InvDx;
+			u = u > 0.f ? u : 0.f;
+			v = v > 0.f ? v : 0.f;
+			u = u < maxU ? u : maxU;
+			v = v < maxV ? v : maxV;
+
+			float col = (float)(int)u;
+			float row = (float)(int)v;
+			col = col < lastCol ? col : lastCol;
+			row = row < lastRow ? row : lastRow;
+			const float s = u - col;
+			const float t = v - row;
+
+			const float* p = g.Heights + (UINT)row * g.Pitch + (UINT)col * g.Stride;
+			const float h00 = p[0];
+			const float h01 = p[g.Stride];
+			const float h10 = p[g.Pitch];
+			const float h11 = p[g.Pitch + g.Stride];
+
+			const float d0 = h01 - h00;
+			const float d1 = h11 - h10;
+			const float a = h00 + s * d0;
+			const float b = h10 + s * d1;
+			outH[k] = a + t * (b - a);
+			outGradX[k] = (d0 + t * (d1 - d0)) * g.InvDx;
+			outGradZ[k] = (a - b) * g.InvDx;
+		}
+	}
+
+#if WAVES_X86
+	void BilinearSSE2(const WavesKernels::SampleGrid& g, const float* x, const float* z, UINT count,
+		float* outH, float* outGradX, float* outGradZ)
+	{
+		const __m128 originX = _mm_set1_ps(g.OriginX);
+		const __m128 originZ = _mm_set1_ps(g.OriginZ);
+		const __m128 invDx = _mm_set1_ps(g.InvDx);
+		const __m128 maxU = _mm_set1_ps((float)(g.Cols - 1));
+		const __m128 maxV = _mm_set1_ps((float)(g.Rows - 1));
+		const __m128 lastCol = _mm_set1_ps((float)(g.Cols - 2));
+		const __m128 lastRow = _mm_set1_ps((float)(g.Rows - 2));
+		const __m128 zero = _mm_setzero_ps();
+
+		UINT k = 0;
+		for (; k + 4 <= count; k += 4)
+		{
+			__m128 u = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(x + k), originX), invDx);
+			__m128 v = _mm_mul_ps(_mm_sub_ps(originZ, _mm_loadu_ps(z + k)), invDx);
+			u = _mm_min_ps(_mm_max_ps(u, zero), maxU);
+			v = _mm_min_ps(_mm_max_ps(v, zero), maxV);
+
+			const __m128 col = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(u)), lastCol);
+			const __m128 row = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(v)), lastRow);
+			const __m128 s = _mm_sub_ps(u, col);
+			const __m128 t = _mm_sub_ps(v, row);
+
+			// No gather before AVX2: fetch the corners lane by lane.
+			int cols[4];
+			int rows[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(cols), _mm_cvttps_epi32(col));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(rows), _mm_cvttps_epi32(row));
+			const float* p[4];
+			for (UINT lane = 0; lane < 4; ++lane)
+			{
+				p[lane] = g.Heights + rows[lane] * g.Pitch + cols[lane] * g.Stride;
+			}
+			const UINT across = g.Pitch + g.Stride;
+			const __m128 h00 = _mm_setr_ps(p[0][0], p[1][0], p[2][0], p[3][0]);
+			const __m128 h01 = _mm_setr_ps(p[0][g.Stride], p[1][g.Stride], p[2][g.Stride], p[3][g.Stride]);
+			const __m128 h10 = _mm_setr_ps(p[0][g.Pitch], p[1][g.Pitch], p[2][g.Pitch], p[3][g.Pitch]);
+			const __m128 h11 = _mm_setr_ps(p[0][across], p[1][across], p[2][across], p[3][across]);
+
+			const __m128 d0 = _mm_sub_ps(h01, h00);
+			const __m128 d1 = _mm_sub_ps(h11, h10);
+			const __m128 a = _mm_add_ps(h00, _mm_mul_ps(s, d0));
+			const __m128 b = _mm_add_ps(h10, _mm_mul_ps(s, d1));
+			_mm_storeu_ps(outH + k, _mm_add_ps(a, _mm_mul_ps(t, _mm_sub_ps(b, a))));
+			_mm_storeu_ps(outGradX + k, _mm_mul_ps(_mm_add_ps(d0, _mm_mul_ps(t, _mm_sub_ps(d1, d0))), invDx));
+			_mm_storeu_ps(outGradZ + k, _mm_mul_ps(_mm_sub_ps(a, b), invDx));
+		}
+
+		BilinearScalar(g, x + k, z + k, count - k, outH + k, outGradX + k, outGradZ + k);
+	}
+
+	void BilinearAVX2(const WavesKernels::SampleGrid& g, const float* x, const float* z, UINT count,
+		float* outH, float* outGradX, float* outGradZ)
+	{
+		const __m256 originX = _mm256_set1_ps(g.OriginX);
+		const __m256 originZ = _mm256_set1_ps(g.OriginZ);
+		const __m256 invDx = _mm256_set1_ps(g.InvDx);
+		const __m256 maxU = _mm256_set1_ps((float)(g.Cols - 1));
+		const __m256 maxV = _mm256_set1_ps((float)(g.Rows - 1));
+		const __m256 lastCol = _mm256_set1_ps((float)(g.Cols - 2));
+		const __m256 lastRow = _mm256_set1_ps((float)(g.Rows - 2));
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256i pitch = _mm256_set1_epi32((int)g.Pitch);
+		const __m256i stride = _mm256_set1_epi32((int)g.Stride);
+
+		UINT k = 0;
+		for (; k + 8 <= count; k += 8)
+		{
+			__m256 u = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(x + k), originX), invDx);
+			__m256 v = _mm256_mul_ps(_mm256_sub_ps(originZ, _mm256_loadu_ps(z + k)), invDx);
+			u = _mm256_min_ps(_mm256_max_ps(u, zero), maxU);
+			v = _mm256_min_ps(_mm256_max_ps(v, zero), maxV);
+
+			const __m256 col = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(u)), lastCol);
+			const __m256 row = _mm256_min_ps(_mm256_cvtepi32_ps(_mm256_cvttps_epi32(v)), lastRow);
+			const __m256 s = _mm256_sub_ps(u, col);
+			const __m256 t = _mm256_sub_ps(v, row);
+
+			const __m256i offset = _mm256_add_epi32(
+				_mm256_mullo_epi32(_mm256_cvttps_epi32(row), pitch),
+				_mm256_mullo_epi32(_mm256_cvttps_epi32(col), stride));
+			const __m256 h00 = _mm256_i32gather_ps(g.Heights, offset, 4);
+			const __m256 h01 = _mm256_i32gather_ps(g.Heights + g.Stride, offset, 4);
+			const __m256 h10 = _mm256_i32gather_ps(g.Heights + g.Pitch, offset, 4);
+			const __m256 h11 = _mm256_i32gather_ps(g.Heights + g.Pitch + g.Stride, offset, 4);
+
+			const __m256 d0 = _mm256_sub_ps(h01, h00);
+			const __m256 d1 = _mm256_sub_ps(h11, h10);
+			const __m256 a = _mm256_add_ps(h00, _mm256_mul_ps(s, d0));
+			const __m256 b = _mm256_add_ps(h10, _mm256_mul_ps(s, d1));
+			_mm256_storeu_ps(outH + k, _mm256_add_ps(a, _mm256_mul_ps(t, _mm256_sub_ps(b, a))));
+			_mm256_storeu_ps(outGradX + k, _mm256_mul_ps(_mm256_add_ps(d0, _mm256_mul_ps(t, _mm256_sub_ps(d1, d0))), invDx));
+			_mm256_storeu_ps(outGradZ + k, _mm256_mul_ps(_mm256_sub_ps(a, b), invDx));
+		}
+
+		_mm256_zeroupper();
+
+		BilinearSSE2(g, x + k, z + k, count - k, outH + k, outGradX + k, outGradZ + k);
+	}
+#endif
+}
+
+void WavesKernels::BilinearRow(const SampleGrid& grid, const float* x, const float* z, UINT count,
+	float* outH, float* outGradX, float* outGradZ)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		BilinearAVX2(grid, x, z, count, outH, outGradX, outGradZ);
+		return;
+	case SIMD_SSE2:
+		BilinearSSE2(grid, x, z, count, outH, outGradX, outGradZ);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	BilinearScalar(grid, x, z, count, outH, outGradX, outGradZ);
+}
+
+namespace
+{
+	// Written as minps / maxps evaluate them so NaNs propagate alike.
+	inline float MinLane(float a, float b)
+	{
+		return a < b ? a : b;
+	}
+
+	inline float MaxLane(float a, float b)
+	{
+		return a > b ? a : b;
+	}
+
+	void ReduceScalar(const float* minA, const float* minB, const float* maxA, const float* maxB,
+		const float* avgA, const float* avgB, UINT texelBegin, UINT srcCount,
+		float* outMin, float* outMax, float* outAvg)
+	{
+		const UINT texelEnd = (srcCount + 1) / 2;
+		for (UINT t = texelBegin; t < texelEnd; ++t)
+		{
+			const UINT c0 = 2 * t;
+			const UINT c1 = c0 + 1 < srcCount ? c0 + 1 : c0;
+			outMin[t] = MinLane(MinLane(minA[c0], minB[c0]), MinLane(minA[c1], minB[c1]));
+			outMax[t] = MaxLane(MaxLane(maxA[c0], maxB[c0]), MaxLane(maxA[c1], maxB[c1]));
+			outAvg[t] = ((avgA[c0] + avgA[c1]) + (avgB[c0] + avgB[c1])) * 0.25f;
+		}
+	}
+
+#if WAVES_X86
+	// Columns 0, 2, 4, 6 and 1, 3, 5, 7 of the eight in lo:hi.
+	inline __m128 EvenColumns(__m128 lo, __m128 hi)
+	{
+		return _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+	}
+
+	inline __m128 OddColumns(__m128 lo, __m128 hi)
+	{
+		return _mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+	}
+
+	void ReduceSSE2(const float* minA, const float* minB, const float* maxA, const float* maxB,
+		const float* avgA, const float* avgB, UINT srcCount, float* outMin, float* outMax, float* outAvg)
+	{
+		const __m128 quarter = _mm_set1_ps(0.25f);
+
+		UINT t = 0;
+		for (; 2 * t + 8 <= srcCount; t += 4)
+		{
+			const UINT c = 2 * t;
+
+			const __m128 minLo = _mm_min_ps(_mm_loadu_ps(minA + c), _mm_loadu_ps(minB + c));
+			const __m128 minHi = _mm_min_ps(_mm_loadu_ps(minA + c + 4), _mm_loadu_ps(minB + c + 4));
+			_mm_storeu_ps(outMin + t, _mm_min_ps(EvenColumns(minLo, minHi), OddColumns(minLo, minHi)));
+
+			const __m128 maxLo = _mm_max_ps(_mm_loadu_ps(maxA + c), _mm_loadu_ps(maxB + c));
+			const __m128 maxHi = _mm_max_ps(_mm_loadu_ps(maxA + c + 4), _mm_loadu_ps(maxB + c + 4));
+			_mm_storeu_ps(outMax + t, _mm_max_ps(EvenColumns(maxLo, maxHi), OddColumns(maxLo, maxHi)));
+
+			const __m128 aLo = _mm_loadu_ps(avgA + c);
+			const __m128 aHi = _mm_loadu_ps(avgA + c + 4);
+			const __m128 bLo = _mm_loadu_ps(avgB + c);
+			const __m128 bHi = _mm_loadu_ps(avgB + c + 4);
+			const __m128 a = _mm_add_ps(EvenColumns(aLo, aHi), OddColumns(aLo, aHi));
+			const __m128 b = _mm_add_ps(EvenColumns(bLo, bHi), OddColumns(bLo, bHi));
+			_mm_storeu_ps(outAvg + t, _mm_mul_ps(_mm_add_ps(a, b), quarter));
+		}
+
+		ReduceScalar(minA, minB, maxA, maxB, avgA, avgB, t, srcCount, outMin, outMax, outAvg);
+	}
+
+	// _mm256_shuffle_ps works within 128-bit halves, which leaves the texels
+	// of sixteen columns in the order 0 1 4 5 2 3 6 7; put them back.
+	inline __m256 TexelOrder(__m256 v)
+	{
+		return _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(v), _MM_SHUFFLE(3, 1, 2, 0)));
+	}
+
+	void ReduceAVX2(const float* minA, const float* minB, const float* maxA, const float* maxB,
+		const float* avgA, const float* avgB, UINT srcCount, float* outMin, float* outMax, float* outAvg)
+	{
+		const __m256 quarter = _mm256_set1_ps(0.25f);
+		const int even = _MM_SHUFFLE(2, 0, 2, 0);
+		const int odd = _MM_SHUFFLE(3, 1, 3, 1);
+
+		UINT t = 0;
+		for (; 2 * t + 16 <= srcCount; t += 8)
+		{
+			const UINT c = 2 * t;
+
+			const __m256 minLo = _mm256_min_ps(_mm256_loadu_ps(minA + c), _mm256_loadu_ps(minB + c));
+			const __m256 minHi = _mm256_min_ps(_mm256_loadu_ps(minA + c + 8), _mm256_loadu_ps(minB + c + 8));
+			_mm256_storeu_ps(outMin + t, TexelOrder(_mm256_min_ps(
+				_mm256_shuffle_ps(minLo, minHi, even), _mm256_shuffle_ps(minLo, minHi, odd))));
+
+			const __m256 maxLo = _mm256_max_ps(_mm256_loadu_ps(maxA + c), _mm256_loadu_ps(maxB + c));
+			const __m256 maxHi = _mm256_max_ps(_mm256_loadu_ps(maxA + c + 8), _mm256_loadu_ps(maxB + c + 8));
+			_mm256_storeu_ps(outMax + t, TexelOrder(_mm256_max_ps(
+				_mm256_shuffle_ps(maxLo, maxHi, even), _mm256_shuffle_ps(maxLo, maxHi, odd))));
+
+			const __m256 aLo = _mm256_loadu_ps(avgA + c);
+			const __m256 aHi = _mm256_loadu_ps(avgA + c + 8);
+			const __m256 bLo = _mm256_loadu_ps(avgB + c);
+			const __m256 bHi = _mm256_loadu_ps(avgB + c + 8);
+			const __m256 a = _mm256_add_ps(_mm256_shuffle_ps(aLo, aHi, even), _mm256_shuffle_ps(aLo, aHi, odd));
+			const __m256 b = _mm256_add_ps(_mm256_shuffle_ps(bLo, bHi, even), _mm256_shuffle_ps(bLo, bHi, odd));
+			_mm256_storeu_ps(outAvg + t, TexelOrder(_mm256_mul_ps(_mm256_add_ps(a, b), quarter)));
+		}
+
+		_mm256_zeroupper();
+
+		const UINT c = 2 * t;
+		ReduceSSE2(minA + c, minB + c, maxA + c, maxB + c, avgA + c, avgB + c, srcCount - c,
+			outMin + t, outMax + t, outAvg + t);
+	}
+#endif
+}
+
+void WavesKernels::ReduceRow2x2(const float* minA, const float* minB, const float* maxA, const float* maxB,
+	const float* avgA, const float* avgB, UINT srcCount, float* outMin, float* outMax, float* outAvg)
+{
+#if WAVES_X86
+	switch (ActiveSimdLevel())
+	{
+	case SIMD_AVX2:
+		ReduceAVX2(minA, minB, maxA, maxB, avgA, avgB, srcCount, outMin, outMax, outAvg);
+		return;
+	case SIMD_SSE2:
+		ReduceSSE2(minA, minB, maxA, maxB, avgA, avgB, srcCount, outMin, outMax, outAvg);
+		return;
+	default:
+		break;
+	}
+#endif
+
+	ReduceScalar(minA, minB, maxA, maxB, avgA, avgB, 0, srcCount, outMin, outMax, outAvg);
+}
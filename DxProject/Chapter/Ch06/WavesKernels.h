@@ -0,0 +1,227 @@
+#pragma once
+
+#include <Windows.h>
+
+// Inner loops of the wave solver.  They work on plain float rows so every
+// storage mode and scheduling strategy in Waves can share them.
+class WavesKernels
+{
+public:
+	enum SimdLevel
+	{
+		SIMD_SCALAR,
+		SIMD_SSE2,
+		SIMD_AVX2,
+	};
+
+	// 16-bit height encodings.
+	enum PackFormat
+	{
+		// IEEE half precision.
+		PACK_FP16,
+
+		// Signed 16-bit integer times a fixed scale.
+		PACK_FIXED16,
+	};
+
+	// Best instruction set supported by both the CPU and the OS.
+	static SimdLevel GetSimdLevel();
+
+	// Overrides the detected level (clamped to what the CPU supports).
+	// Handy for comparing the SIMD paths against the scalar fallback.
+	static void SetSimdLevel(SimdLevel level);
+
+	///<summary>
+	/// Advances count cells of one row in place:
+	///
+	///   prev[j] = k1 * prev[j] + k2 * curr[j] +
+	///             k3 * (down[j] + up[j] + curr[j + 1] + curr[j - 1])
+	///
+	/// All pointers address the first cell to update and step by stride floats.
+	/// Unit stride rows take the SIMD path; the summation order is identical in
+	/// every path so results are bit-for-bit the same as the scalar loop.
+	///</summary>
+	static void StepRow(float* prev, const float* up, const float* curr, const float* down,
+		UINT count, UINT stride, float k1, float k2, float k3);
+
+	///<summary>
+	/// Central-difference surface frame for count cells of one row:
+	///
+	///   dh/dx = (curr[j + 1] - curr[j - 1]) * invTwoDx
+	///   dh/dz = (up[j] - down[j]) * invTwoDx       (+z runs against the rows)
+	///   N     = normalize(-dh/dx, 1, -dh/dz)
+	///   T     = normalize(1, dh/dx, 0)
+	///
+	/// Heights step by stride floats; the outputs are unit-stride SoA rows.
+	/// T.z is always zero and is not written.
+	///</summary>
+	static void NormalRow(const float* up, const float* curr, const float* down,
+		UINT count, UINT stride, float invTwoDx,
+		float* nx, float* ny, float* nz, float* tx, float* ty);
+
+	// Largest |row[j]| over count cells stepping by stride floats.
+	static float MaxAbsRow(const float* row, UINT count, UINT stride);
+
+	///<summary>
+	/// Right-hand side of an implicit (ADI) step for count cells of one row:
+	///
+	///   out[j] = q1 * curr[j] + q2 * (down[j] + up[j] + curr[j + 1] + curr[j - 1]) +
+	///            q3 * prev[j] + q4 * (prevDown[j] + prevUp[j] + prev[j + 1] + prev[j - 1])
+	///
+	/// Unit-stride rows only.  Every path rounds the same way, as StepRow().
+	///</summary>
+	static void ImplicitRhsRow(float* out,
+		const float* prevUp, const float* prev, const float* prevDown,
+		const float* up, const float* curr, const float* down,
+		UINT count, float q1, float q2, float q3, float q4);
+
+	// Factors the constant system (1 + 2r) x[k] - r (x[k - 1] + x[k + 1]) = d[k]
+	// on lines of length cells into inv and upper, length floats each.
+	static void FactorTridiagonal(float r, UINT length, float* inv, float* upper);
+
+	///<summary>
+	/// Solves the FactorTridiagonal() system in place on lineCount independent
+	/// lines; cell k of line l is data[l * lineStride + k * elementStride].
+	/// Lines are solved side by side in SIMD lanes: adjacent lines (lineStride
+	/// 1) straight from memory, unit-stride lines four at a time through 4x4
+	/// transposes.  Results match the scalar Thomas sweep bit for bit.
+	///</summary>
+	static void SolveTridiagonal(float* data, UINT length, UINT elementStride,
+		UINT lineCount, UINT lineStride, float r, const float* inv, const float* upper);
+
+	///<summary>
+	/// Radix-2 butterflies on split-complex data, count at a time:
+	///
+	///   t = b[j] * w[j];  b[j] = a[j] - t;  a[j] = a[j] + t
+	///
+	/// Butterfly takes a twiddle per element; ButterflyBroadcast uses one for
+	/// every element, for transforms run across adjacent columns.  The
+	/// complex product is rounded the same way in every path.
+	///</summary>
+	static void Butterfly(float* ar, float* ai, float* br, float* bi,
+		const float* wr, const float* wi, UINT count);
+	static void ButterflyBroadcast(float* ar, float* ai, float* br, float* bi,
+		float wr, float wi, UINT count);
+
+	///<summary>
+	/// sin and cos of count angles by Cody-Waite reduction to [-pi/4, pi/4]
+	/// and minimax polynomials, within a few ulp for |x| up to a few
+	/// thousand.  Every path produces the same bits.
+	///</summary>
+	static void SinCosRow(const float* x, float* s, float* c, UINT count);
+
+	// One wave of a Gerstner sum, with its time-dependent phase folded into
+	// Offset: theta = Kx x + Kz z + Offset.
+	struct GerstnerTerm
+	{
+		float Kx;
+		float Kz;
+		float Offset;
+		float Amplitude;
+		float DisplaceX;
+		float DisplaceZ;
+	};
+
+	///<summary>
+	/// Sums termCount Gerstner waves at count points (x[k], z[k * zStride]);
+	/// zStride 0 shares one z across a grid row:
+	///
+	///   outX = x + sum DisplaceX cos theta
+	///   outY =     sum Amplitude sin theta
+	///   outZ = z + sum DisplaceZ cos theta
+	///
+	/// Points sit in SIMD lanes and the waves are summed in order in
+	/// registers, using the SinCosRow polynomials, so every path agrees bit
+	/// for bit.
+	///</summary>
+	static void GerstnerRow(const float* x, const float* z, UINT zStride, UINT count,
+		const GerstnerTerm* terms, UINT termCount, float* outX, float* outY, float* outZ);
+
+	// Height grid read by BilinearRow(): height (i, j) is Heights[i * Pitch +
+	// j * Stride] and point (x, z) falls at column (x - OriginX) * InvDx and
+	// row (OriginZ - z) * InvDx.
+	struct SampleGrid
+	{
+		const float* Heights;
+		UINT Pitch;
+		UINT Stride;
+		UINT Rows;
+		UINT Cols;
+		float OriginX;
+		float OriginZ;
+		float InvDx;
+	};
+
+	///<summary>
+	/// Bilinear height and slope at count scattered points (x[k], z[k]):
+	///
+	///   a = h00 + s (h01 - h00),  b = h10 + s (h11 - h10),  h = a + t (b - a)
+	///   dh/dx = ((h01 - h00) + t ((h11 - h10) - (h01 - h00))) * InvDx
+	///   dh/dz = (a - b) * InvDx                   (+z runs against the rows)
+	///
+	/// Points off the grid are clamped to its edge.  The AVX2 path fetches
+	/// the four corners with gathers; every path rounds the same way.
+	///</summary>
+	static void BilinearRow(const SampleGrid& grid, const float* x, const float* z, UINT count,
+		float* outH, float* outGradX, float* outGradZ);
+
+	///<summary>
+	/// One row of a 2x2 min / max / average reduction.  Texel j of the outputs
+	/// reduces columns 2j and 2j + 1 of rows a and b of its input:
+	///
+	///   min = min(min(a0, b0), min(a1, b1))      max likewise
+	///   avg = ((a0 + a1) + (b0 + b1)) * 0.25
+	///
+	/// srcCount columns give (srcCount + 1) / 2 texels; an odd last column is
+	/// paired with itself, and an odd last row is reduced by passing it as
+	/// both a and b.  The first level of a pyramid passes the same heights as
+	/// all three inputs.  Every path produces the same bits.
+	///</summary>
+	static void ReduceRow2x2(const float* minA, const float* minB, const float* maxA, const float* maxB,
+		const float* avgA, const float* avgB, UINT srcCount, float* outMin, float* outMax, float* outAvg);
+
+	// Treats denormal inputs and results as zero on the calling thread for
+	// its lifetime.  Every SIMD path and the scalar loops see the same mode,
+	// so they still agree bit for bit.
+	class FlushDenormalsScope
+	{
+	public:
+		FlushDenormalsScope();
+		~FlushDenormalsScope();
+
+	private:
+		FlushDenormalsScope(const FlushDenormalsScope&);
+		FlushDenormalsScope& operator=(const FlushDenormalsScope&);
+
+		UINT mSavedMode;
+	};
+
+	///<summary>
+	/// Convert count heights between fp32 and a 16-bit encoding.  scale is
+	/// the height of one PACK_FIXED16 unit and is ignored for PACK_FP16.
+	/// Packing rounds to nearest even (fixed point saturates), and every path
+	/// produces the same bits, so replays match on any x86 machine.
+	///</summary>
+	static void UnpackRow(const USHORT* src, float* dst, UINT count, PackFormat format, float scale);
+	static void PackRow(const float* src, USHORT* dst, UINT count, PackFormat format, float scale);
+
+	static float UnpackHeight(USHORT v, PackFormat format, float scale);
+	static USHORT PackHeight(float h, PackFormat format, float scale);
+
+	///<summary>
+	/// Writes count float3s (a[j], b[j], c[j]) to dest, dest + stride, ... with
+	/// non-temporal stores, for filling mapped GPU memory without pulling it
+	/// into the cache.  Each source steps by its own stride in floats; a
+	/// stride of 0 repeats one value.  Tightly packed float3s (stride 12)
+	/// from unit-stride a and b are interleaved four at a time with SSE2.
+	/// Call EndStreaming() before handing the memory to another agent.
+	///</summary>
+	static void StreamFloat3Row(BYTE* dest, UINT stride, UINT count,
+		const float* a, UINT aStride, const float* b, UINT bStride, const float* c, UINT cStride);
+
+	// One float per element, e.g. just the height of each vertex.
+	static void StreamFloatRow(BYTE* dest, UINT stride, UINT count, const float* a, UINT aStride);
+
+	// Orders the streaming stores before anything that follows.
+	static void EndStreaming();
+};
@@ -2,13 +2,102 @@
 
 #include "MathHelper.h"
 
+namespace
+{
+	const UINT64 EmptyEdge = ~0ull;
+
+	///<summary>
+	/// Open-addressed table from an undirected edge (a pair of vertex indices)
+	/// to the vertex at its midpoint, so the two triangles sharing an edge
+	/// share its midpoint too.
+	///</summary>
+	class EdgeMidpoints
+	{
+	public:
+		// Sized for at most edgeCount edges, at most half full.
+		explicit EdgeMidpoints(UINT edgeCount)
+			: mMask(0)
+		{
+			UINT capacity = 16;
+			while (capacity < 2 * edgeCount)
+			{
+				capacity *= 2;
+			}
+			mMask = capacity - 1;
+			mEdges.assign(capacity, EmptyEdge);
+			mMidpoints.resize(capacity);
+		}
+
+		// Returns the midpoint of edge (a, b) and sets added if the edge was
+		// new, in which case the midpoint is next and the caller creates it.
+		UINT Find(UINT a, UINT b, UINT next, bool& added)
+		{
+			const UINT64 edge = a < b ? ((UINT64)a << 32) | b : ((UINT64)b << 32) | a;
+
+			UINT slot = (UINT)((edge * 0x9E3779B97F4A7C15ull) >> 32) & mMask;
+			while (mEdges[slot] != EmptyEdge)
+			{
+				if (mEdges[slot] == edge)
+				{
+					added = false;
+					return mMidpoints[slot];
+				}
+				slot = (slot + 1) & mMask;
+			}
+
+			mEdges[slot] = edge;
+			mMidpoints[slot] = next;
+			added = true;
+			return next;
+		}
+
+	private:
+		UINT mMask;
+		std::vector<UINT64> mEdges;
+		std::vector<UINT> mMidpoints;
+	};
+
+	UINT Midpoint(EdgeMidpoints& midpoints, GeometryGenerator::Vertex* vertices, UINT& vertexCount, UINT a, UINT b)
+	{
+		bool added;
+		const UINT m = midpoints.Find(a, b, vertexCount, added);
+		if (added)
+		{
+			const XMFLOAT3& p0 = vertices[a].Position;
+			const XMFLOAT3& p1 = vertices[b].Position;
+			vertices[m].Position = XMFLOAT3(
+				0.5f * (p0.x + p1.x),
+				0.5f * (p0.y + p1.y),
+				0.5f * (p0.z + p1.z));
+			++vertexCount;
+		}
+		return m;
+	}
+}
+
 void GeometryGenerator::CreateBox(float width, float height, float depth, MeshData& meshData)
+{
+	UINT vertexCount, indexCount;
+	BoxCounts(vertexCount, indexCount);
+
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices.resize(indexCount);
+	FillBox(width, height, depth, &meshData.Vertices[0], &meshData.Indices[0]);
+}
+
+void GeometryGenerator::BoxCounts(UINT& vertexCount, UINT& indexCount)
+{
+	vertexCount = 24;
+	indexCount = 36;
+}
+
+void GeometryGenerator::FillBox(float width, float height, float depth, Vertex* vertices, UINT* indices)
 {
 	//
 	// Create the vertices.
 	//
 
-	Vertex v[24];
+	Vertex* v = vertices;
 
 	float w2 = 0.5f * width;
 	float h2 = 0.5f * height;
@@ -50,13 +139,11 @@ void GeometryGenerator::CreateBox(float width, float height, float depth, MeshDa
 	v[22] = Vertex(+w2, +h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 0.0f);
 	v[23] = Vertex(+w2, -h2, +d2, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f);
 
-	meshData.Vertices.assign(&v[0], &v[24]);
-
 	//
 	// Create the indices.
 	//
 
-	UINT i[36];
+	UINT* i = indices;
 
 	// Fill in the front face index data
 	i[0] = 0; i[1] = 1; i[2] = 2;
@@ -81,15 +168,28 @@ void GeometryGenerator::CreateBox(float width, float height, float depth, MeshDa
 	// Fill in the right face index data
 	i[30] = 20; i[31] = 21; i[32] = 22;
 	i[33] = 20; i[34] = 22; i[35] = 23;
-
-	meshData.Indices.assign(&i[0], &i[36]);
 }
 
 void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCount, MeshData& meshData)
 {
-	meshData.Vertices.clear();
-	meshData.Indices.clear();
+	UINT vertexCount, indexCount;
+	SphereCounts(sliceCount, stackCount, vertexCount, indexCount);
+
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices.resize(indexCount);
+	FillSphere(radius, sliceCount, stackCount, &meshData.Vertices[0], &meshData.Indices[0]);
+}
+
+void GeometryGenerator::SphereCounts(UINT sliceCount, UINT stackCount, UINT& vertexCount, UINT& indexCount)
+{
+	// Two poles and stackCount - 1 rings, each with a duplicated seam vertex;
+	// a fan at each pole and two triangles per quad in between.
+	vertexCount = 2 + (stackCount - 1) * (sliceCount + 1);
+	indexCount = 6 * sliceCount * (stackCount - 1);
+}
 
+void GeometryGenerator::FillSphere(float radius, UINT sliceCount, UINT stackCount, Vertex* vertices, UINT* indices)
+{
 	//
 	// Compute the vertices stating at the top pole and moving down the stacks.
 	//
@@ -100,7 +200,8 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 	Vertex topVertex(0.0f, +radius, 0.0f, 0.0f, +1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f);
 	Vertex bottomVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f);
 
-	meshData.Vertices.push_back(topVertex);
+	UINT next = 0;
+	vertices[next++] = topVertex;
 
 	float phiStep = XM_PI / stackCount;
 	float thetaStep = 2.0f * XM_PI / sliceCount;
@@ -136,22 +237,24 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 			v.Texcoord.x = theta / XM_2PI;
 			v.Texcoord.y = phi / XM_PI;
 
-			meshData.Vertices.push_back(v);
+			vertices[next++] = v;
 		}
 	}
 
-	meshData.Vertices.push_back(bottomVertex);
+	vertices[next++] = bottomVertex;
 
 	//
 	// Compute indices for top stack.  The top stack was written first to the vertex buffer
 	// and connects the top pole to the first ring.
 	//
 
+	UINT k = 0;
 	for (UINT i = 1; i <= sliceCount; ++i)
 	{
-		meshData.Indices.push_back(0);
-		meshData.Indices.push_back(i + 1);
-		meshData.Indices.push_back(i);
+		indices[k] = 0;
+		indices[k + 1] = i + 1;
+		indices[k + 2] = i;
+		k += 3;
 	}
 
 	//
@@ -166,13 +269,15 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 	{
 		for (UINT j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices.push_back(baseIndex + i * ringVertexCount + j);
-			meshData.Indices.push_back(baseIndex + i * ringVertexCount + j + 1);
-			meshData.Indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
+			indices[k] = baseIndex + i * ringVertexCount + j;
+			indices[k + 1] = baseIndex + i * ringVertexCount + j + 1;
+			indices[k + 2] = baseIndex + (i + 1) * ringVertexCount + j;
+
+			indices[k + 3] = baseIndex + (i + 1) * ringVertexCount + j;
+			indices[k + 4] = baseIndex + i * ringVertexCount + j + 1;
+			indices[k + 5] = baseIndex + (i + 1) * ringVertexCount + j + 1;
 
-			meshData.Indices.push_back(baseIndex + (i + 1) * ringVertexCount + j);
-			meshData.Indices.push_back(baseIndex + i * ringVertexCount + j + 1);
-			meshData.Indices.push_back(baseIndex + (i + 1) * ringVertexCount + j + 1);
+			k += 6;
 		}
 	}
 
@@ -182,20 +287,47 @@ void GeometryGenerator::CreateSphere(float radius, UINT sliceCount, UINT stackCo
 	//
 
 	// South pole vertex was added last.
-	UINT southPoleIndex = (UINT)meshData.Vertices.size() - 1;
+	UINT southPoleIndex = next - 1;
 
 	// Offset the indices to the index of the first vertex in the last ring.
 	baseIndex = southPoleIndex - ringVertexCount;
 
 	for (UINT i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices.push_back(southPoleIndex);
-		meshData.Indices.push_back(baseIndex + i);
-		meshData.Indices.push_back(baseIndex + i + 1);
+		indices[k] = southPoleIndex;
+		indices[k + 1] = baseIndex + i;
+		indices[k + 2] = baseIndex + i + 1;
+		k += 3;
 	}
 }
 
 void GeometryGenerator::CreateGeosphere(float radius, UINT numSubdivisions, MeshData& meshData)
+{
+	UINT vertexCount, indexCount;
+	GeosphereCounts(numSubdivisions, vertexCount, indexCount);
+
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices.resize(indexCount);
+	FillGeosphere(radius, numSubdivisions, &meshData.Vertices[0], &meshData.Indices[0]);
+}
+
+void GeometryGenerator::GeosphereCounts(UINT numSubdivisions, UINT& vertexCount, UINT& indexCount)
+{
+	numSubdivisions = MathHelper::Min(numSubdivisions, 5u);
+
+	// Every subdivision splits each triangle in four and adds one vertex per
+	// edge; a closed mesh has three edges for every two triangles.
+	UINT triangleCount = 20;
+	vertexCount = 12;
+	for (UINT i = 0; i < numSubdivisions; ++i)
+	{
+		vertexCount += triangleCount * 3 / 2;
+		triangleCount *= 4;
+	}
+	indexCount = 3 * triangleCount;
+}
+
+void GeometryGenerator::FillGeosphere(float radius, UINT numSubdivisions, Vertex* vertices, UINT* indices)
 {
 	// Put a cap on the number of subdivisions.
 	numSubdivisions = MathHelper::Min(numSubdivisions, 5u);
@@ -216,7 +348,7 @@ void GeometryGenerator::CreateGeosphere(float radius, UINT numSubdivisions, Mesh
 		XMFLOAT3(Z, -X, 0.0f),  XMFLOAT3(-Z, -X, 0.0f)
 	};
 
-	DWORD k[60] =
+	static const UINT k[60] =
 	{
 		1,4,0,  4,9,0,  4,5,9,  8,5,4,  1,8,4,
 		1,10,8, 10,3,8, 8,3,5,  3,2,5,  3,7,2,
@@ -224,57 +356,86 @@ void GeometryGenerator::CreateGeosphere(float radius, UINT numSubdivisions, Mesh
 		10,1,6, 11,0,9, 2,11,9, 5,2,9,  11,2,7
 	};
 
-	meshData.Vertices.resize(12);
-	meshData.Indices.resize(60);
-
+	UINT vertexCount = 12;
 	for (UINT i = 0; i < 12; ++i)
-		meshData.Vertices[i].Position = pos[i];
-
-	for (UINT i = 0; i < 60; ++i)
-		meshData.Indices[i] = k[i];
+		vertices[i].Position = pos[i];
 
 	// 정이십면체의 삼각형을 테셀레이션 방식으로 쪼갬
+	// Subdivision only appends vertices, so they grow in place.  The indices
+	// ping-pong between the output and one scratch buffer, starting on
+	// whichever one makes the last level land in the output.
+	std::vector<UINT> scratch(numSubdivisions > 1 ? 3 * (20u << 2 * (numSubdivisions - 1)) : 0);
+
+	const UINT* src = k;
+	UINT triangleCount = 20;
 	for (UINT i = 0; i < numSubdivisions; ++i)
-		Subdivide(meshData);
+	{
+		UINT* dst = (numSubdivisions - i) % 2 == 1 ? indices : &scratch[0];
+		Subdivide(vertices, vertexCount, src, triangleCount, dst);
+
+		src = dst;
+		triangleCount *= 4;
+	}
+
+	if (numSubdivisions == 0)
+	{
+		std::copy(k, k + 60, indices);
+	}
 
 	// 각 버텍스를 원 반지름 길이로 설정
 	// Project vertices onto sphere and scale.
-	for (UINT i = 0; i < meshData.Vertices.size(); ++i)
+	for (UINT i = 0; i < vertexCount; ++i)
 	{
 		// Project onto unit sphere.
-		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&meshData.Vertices[i].Position));
+		XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&vertices[i].Position));
 
 		// Project onto sphere.
 		XMVECTOR p = radius * n;
 
-		XMStoreFloat3(&meshData.Vertices[i].Position, p);
-		XMStoreFloat3(&meshData.Vertices[i].Normal, n);
+		XMStoreFloat3(&vertices[i].Position, p);
+		XMStoreFloat3(&vertices[i].Normal, n);
 
 		// Derive texture coordinates from spherical coordinates.
 		float theta = MathHelper::AngleFromXY(
-			meshData.Vertices[i].Position.x,
-			meshData.Vertices[i].Position.z);
+			vertices[i].Position.x,
+			vertices[i].Position.z);
 
-		float phi = acosf(meshData.Vertices[i].Position.y / radius);
+		float phi = acosf(vertices[i].Position.y / radius);
 
-		meshData.Vertices[i].Texcoord.x = theta / XM_2PI;
-		meshData.Vertices[i].Texcoord.y = phi / XM_PI;
+		vertices[i].Texcoord.x = theta / XM_2PI;
+		vertices[i].Texcoord.y = phi / XM_PI;
 
 		// Partial derivative of P with respect to theta
-		meshData.Vertices[i].TangentU.x = -radius * sinf(phi) * sinf(theta);
-		meshData.Vertices[i].TangentU.y = 0.0f;
-		meshData.Vertices[i].TangentU.z = +radius * sinf(phi) * cosf(theta);
+		vertices[i].TangentU.x = -radius * sinf(phi) * sinf(theta);
+		vertices[i].TangentU.y = 0.0f;
+		vertices[i].TangentU.z = +radius * sinf(phi) * cosf(theta);
 
-		XMVECTOR T = XMLoadFloat3(&meshData.Vertices[i].TangentU);
-		XMStoreFloat3(&meshData.Vertices[i].TangentU, XMVector3Normalize(T));
+		XMVECTOR T = XMLoadFloat3(&vertices[i].TangentU);
+		XMStoreFloat3(&vertices[i].TangentU, XMVector3Normalize(T));
 	}
 }
 
 void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount, MeshData& meshData)
 {
-	meshData.Vertices.clear();
-	meshData.Indices.clear();
+	UINT vertexCount, indexCount;
+	CylinderCounts(sliceCount, stackCount, vertexCount, indexCount);
+
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices.resize(indexCount);
+	FillCylinder(bottomRadius, topRadius, height, sliceCount, stackCount, &meshData.Vertices[0], &meshData.Indices[0]);
+}
+
+void GeometryGenerator::CylinderCounts(UINT sliceCount, UINT stackCount, UINT& vertexCount, UINT& indexCount)
+{
+	// stackCount + 1 rings with a duplicated seam vertex, then two caps of a
+	// ring and a center each.
+	vertexCount = (stackCount + 1) * (sliceCount + 1) + 2 * (sliceCount + 2);
+	indexCount = 6 * sliceCount * stackCount + 2 * 3 * sliceCount;
+}
 
+void GeometryGenerator::FillCylinder(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount,
+	Vertex* vertices, UINT* indices)
+{
 	//
 	// Build Stacks.
 	// 
@@ -287,6 +448,7 @@ void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, floa
 	const UINT ringCount = stackCount + 1;
 
 	// Compute vertices for each stack ring starting at the bottom and moving up.
+	UINT next = 0;
 	for (UINT i = 0; i < ringCount; ++i)
 	{
 		const float y = -0.5f * height + i * stackHeight;
@@ -337,7 +499,7 @@ void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, floa
 			XMVECTOR N = XMVector3Normalize(XMVector3Cross(T, B)); // 노말 방향
 			XMStoreFloat3(&vertex.Normal, N);
 
-			meshData.Vertices.push_back(vertex);
+			vertices[next++] = vertex;
 		}
 	}
 
@@ -346,29 +508,49 @@ void GeometryGenerator::CreateCylinder(float bottomRadius, float topRadius, floa
 	UINT ringVertexCount = sliceCount + 1;
 
 	// Compute indices for each stack.
+	UINT k = 0;
 	for (UINT i = 0; i < stackCount; ++i)
 	{
 		for (UINT j = 0; j < sliceCount; ++j)
 		{
-			meshData.Indices.push_back(i * ringVertexCount + j);
-			meshData.Indices.push_back((i + 1) * ringVertexCount + j);
-			meshData.Indices.push_back((i + 1) * ringVertexCount + j + 1);
+			indices[k] = i * ringVertexCount + j;
+			indices[k + 1] = (i + 1) * ringVertexCount + j;
+			indices[k + 2] = (i + 1) * ringVertexCount + j + 1;
+
+			indices[k + 3] = i * ringVertexCount + j;
+			indices[k + 4] = (i + 1) * ringVertexCount + j + 1;
+			indices[k + 5] = i * ringVertexCount + j + 1;
 
-			meshData.Indices.push_back(i * ringVertexCount + j);
-			meshData.Indices.push_back((i + 1) * ringVertexCount + j + 1);
-			meshData.Indices.push_back(i * ringVertexCount + j + 1);
+			k += 6;
 		}
 	}
 
-	BuildCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
-	BuildCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount, meshData);
+	// The caps follow the rings, top then bottom.
+	const UINT capVertexCount = sliceCount + 2;
+	FillCylinderTopCap(bottomRadius, topRadius, height, sliceCount, stackCount,
+		vertices + next, indices + k, next);
+	FillCylinderBottomCap(bottomRadius, topRadius, height, sliceCount, stackCount,
+		vertices + next + capVertexCount, indices + k + 3 * sliceCount, next + capVertexCount);
 }
 
 void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, MeshData& meshData)
 {
-	const UINT VertexCount = m * n;
-	const UINT TriCount = (m - 1) * (n - 1) * 2;
+	UINT vertexCount, indexCount;
+	GridCounts(m, n, vertexCount, indexCount);
+
+	meshData.Vertices.resize(vertexCount);
+	meshData.Indices.resize(indexCount);
+	FillGrid(width, depth, m, n, &meshData.Vertices[0], &meshData.Indices[0]);
+}
+
+void GeometryGenerator::GridCounts(UINT m, UINT n, UINT& vertexCount, UINT& indexCount)
+{
+	vertexCount = m * n;
+	indexCount = (m - 1) * (n - 1) * 2 * 3;
+}
 
+void GeometryGenerator::FillGrid(float width, float depth, UINT m, UINT n, Vertex* vertices, UINT* indices)
+{
 	//
 	// Create the vertices.
 	//
@@ -382,7 +564,6 @@ void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, Mes
 	float du = 1.0f / (n - 1);
 	float dv = 1.0f / (m - 1);
 
-	meshData.Vertices.resize(VertexCount);
 	for (UINT i = 0; i < m; ++i)
 	{
 		float z = halfDepth - i * dz;
@@ -390,13 +571,13 @@ void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, Mes
 		{
 			float x = -halfWidth + j * dx;
 
-			meshData.Vertices[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
-			meshData.Vertices[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
-			meshData.Vertices[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			vertices[i * n + j].Position = XMFLOAT3(x, 0.0f, z);
+			vertices[i * n + j].Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+			vertices[i * n + j].TangentU = XMFLOAT3(1.0f, 0.0f, 0.0f);
 
 			// Stretch texture over grid.
-			meshData.Vertices[i * n + j].Texcoord.x = j * du;
-			meshData.Vertices[i * n + j].Texcoord.y = i * dv;
+			vertices[i * n + j].Texcoord.x = j * du;
+			vertices[i * n + j].Texcoord.y = i * dv;
 		}
 	}
 
@@ -404,35 +585,31 @@ void GeometryGenerator::CreateGrid(float width, float depth, UINT m, UINT n, Mes
 	// Create the indices.
 	//
 
-	meshData.Indices.resize(TriCount * 3); // 3 indices per face
-
 	// Iterate over each quad and compute indices.
 	UINT k = 0;
 	for (UINT i = 0; i < m - 1; ++i)
 	{
 		for (UINT j = 0; j < n - 1; ++j)
 		{
-			meshData.Indices[k] = i * n + j;
-			meshData.Indices[k + 1] = i * n + j + 1;
-			meshData.Indices[k + 2] = (i + 1) * n + j;
+			indices[k] = i * n + j;
+			indices[k + 1] = i * n + j + 1;
+			indices[k + 2] = (i + 1) * n + j;
 
-			meshData.Indices[k + 3] = (i + 1) * n + j;
-			meshData.Indices[k + 4] = i * n + j + 1;
-			meshData.Indices[k + 5] = (i + 1) * n + j + 1;
+			indices[k + 3] = (i + 1) * n + j;
+			indices[k + 4] = i * n + j + 1;
+			indices[k + 5] = (i + 1) * n + j + 1;
 
 			k += 6; // next quad
 		}
 	}
 }
 
-void GeometryGenerator::Subdivide(MeshData& meshData)
+void GeometryGenerator::Subdivide(Vertex* vertices, UINT& vertexCount, const UINT* indices, UINT triangleCount,
+	UINT* subdividedIndices)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices.resize(0);
+	// Neighbouring triangles meet each shared edge from opposite ends; the
+	// table makes the second one reuse the midpoint the first created.
+	EdgeMidpoints midpoints(triangleCount * 3);
 
 	//       v1
 	//       *
@@ -444,71 +621,41 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	UINT numTris = inputCopy.Indices.size() / 3;
-	for (UINT i = 0; i < numTris; ++i)
+	// For subdivision, we just care about the position component.  We derive the other
+	// vertex components in FillGeosphere.
+
+	UINT k = 0;
+	for (UINT i = 0; i < triangleCount; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[inputCopy.Indices[i * 3 + 0]];
-		Vertex v1 = inputCopy.Vertices[inputCopy.Indices[i * 3 + 1]];
-		Vertex v2 = inputCopy.Vertices[inputCopy.Indices[i * 3 + 2]];
-
-		//
-		// Generate the midpoints.
-		//
-
-		Vertex m0, m1, m2;
-
-		// For subdivision, we just care about the position component.  We derive the other
-		// vertex components in CreateGeosphere.
-
-		m0.Position = XMFLOAT3(
-			0.5f * (v0.Position.x + v1.Position.x),
-			0.5f * (v0.Position.y + v1.Position.y),
-			0.5f * (v0.Position.z + v1.Position.z));
-
-		m1.Position = XMFLOAT3(
-			0.5f * (v1.Position.x + v2.Position.x),
-			0.5f * (v1.Position.y + v2.Position.y),
-			0.5f * (v1.Position.z + v2.Position.z));
-
-		m2.Position = XMFLOAT3(
-			0.5f * (v0.Position.x + v2.Position.x),
-			0.5f * (v0.Position.y + v2.Position.y),
-			0.5f * (v0.Position.z + v2.Position.z));
-
-		//
-		// Add new geometry.
-		//
-
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
-
-		meshData.Indices.push_back(i * 6 + 0);
-		meshData.Indices.push_back(i * 6 + 3);
-		meshData.Indices.push_back(i * 6 + 5);
-
-		meshData.Indices.push_back(i * 6 + 3);
-		meshData.Indices.push_back(i * 6 + 4);
-		meshData.Indices.push_back(i * 6 + 5);
-
-		meshData.Indices.push_back(i * 6 + 5);
-		meshData.Indices.push_back(i * 6 + 4);
-		meshData.Indices.push_back(i * 6 + 2);
-
-		meshData.Indices.push_back(i * 6 + 3);
-		meshData.Indices.push_back(i * 6 + 1);
-		meshData.Indices.push_back(i * 6 + 4);
+		const UINT v0 = indices[i * 3 + 0];
+		const UINT v1 = indices[i * 3 + 1];
+		const UINT v2 = indices[i * 3 + 2];
+
+		const UINT m0 = Midpoint(midpoints, vertices, vertexCount, v0, v1);
+		const UINT m1 = Midpoint(midpoints, vertices, vertexCount, v1, v2);
+		const UINT m2 = Midpoint(midpoints, vertices, vertexCount, v0, v2);
+
+		subdividedIndices[k++] = v0;
+		subdividedIndices[k++] = m0;
+		subdividedIndices[k++] = m2;
+
+		subdividedIndices[k++] = m0;
+		subdividedIndices[k++] = m1;
+		subdividedIndices[k++] = m2;
+
+		subdividedIndices[k++] = m2;
+		subdividedIndices[k++] = m1;
+		subdividedIndices[k++] = v2;
+
+		subdividedIndices[k++] = m0;
+		subdividedIndices[k++] = v1;
+		subdividedIndices[k++] = m1;
 	}
 }
 
-void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius, float height,
-	UINT sliceCount, UINT stackCount, MeshData& meshData)
+void GeometryGenerator::FillCylinderTopCap(float bottomRadius, float topRadius, float height,
+	UINT sliceCount, UINT stackCount, Vertex* vertices, UINT* indices, UINT baseIndex)
 {
-	UINT baseIndex = (UINT)meshData.Vertices.size();
-
 	const float y = 0.5f * height;
 	const float dTheta = 2.0f * XM_PI / sliceCount;
 
@@ -523,31 +670,30 @@ void GeometryGenerator::BuildCylinderTopCap(float bottomRadius, float topRadius,
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		vertices[i] = Vertex(x, y, z, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
+	vertices[sliceCount + 1] = Vertex(0.0f, y, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Index of center vertex.
-	UINT centerIndex = (UINT)meshData.Vertices.size() - 1;
+	UINT centerIndex = baseIndex + sliceCount + 1;
 
 	for (UINT i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices.push_back(centerIndex);
-		meshData.Indices.push_back(baseIndex + i + 1);
-		meshData.Indices.push_back(baseIndex + i);
+		indices[3 * i] = centerIndex;
+		indices[3 * i + 1] = baseIndex + i + 1;
+		indices[3 * i + 2] = baseIndex + i;
 	}
 }
 
-void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadius, float height,
-	UINT sliceCount, UINT stackCount, MeshData& meshData)
+void GeometryGenerator::FillCylinderBottomCap(float bottomRadius, float topRadius, float height,
+	UINT sliceCount, UINT stackCount, Vertex* vertices, UINT* indices, UINT baseIndex)
 {
 	// 
 	// Build bottom cap.
 	//
 
-	UINT baseIndex = (UINT)meshData.Vertices.size();
 	float y = -0.5f * height;
 
 	// vertices of ring
@@ -562,19 +708,19 @@ void GeometryGenerator::BuildCylinderBottomCap(float bottomRadius, float topRadi
 		float u = x / height + 0.5f;
 		float v = z / height + 0.5f;
 
-		meshData.Vertices.push_back(Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v));
+		vertices[i] = Vertex(x, y, z, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, u, v);
 	}
 
 	// Cap center vertex.
-	meshData.Vertices.push_back(Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f));
+	vertices[sliceCount + 1] = Vertex(0.0f, y, 0.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.5f, 0.5f);
 
 	// Cache the index of center vertex.
-	UINT centerIndex = (UINT)meshData.Vertices.size() - 1;
+	UINT centerIndex = baseIndex + sliceCount + 1;
 
 	for (UINT i = 0; i < sliceCount; ++i)
 	{
-		meshData.Indices.push_back(centerIndex);
-		meshData.Indices.push_back(baseIndex + i);
-		meshData.Indices.push_back(baseIndex + i + 1);
+		indices[3 * i] = centerIndex;
+		indices[3 * i + 1] = baseIndex + i;
+		indices[3 * i + 2] = baseIndex + i + 1;
 	}
 }
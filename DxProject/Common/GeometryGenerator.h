@@ -58,8 +58,40 @@ public:
 	///</summary>
 	static void CreateGrid(float width, float depth, UINT m, UINT n, MeshData& meshData);
 
+	///<summary>
+	/// Exact vertex and index counts of each primitive for the given
+	/// parameters, so callers can size their own arrays once and generate
+	/// into them with the matching Fill function.
+	///</summary>
+	static void BoxCounts(UINT& vertexCount, UINT& indexCount);
+	static void SphereCounts(UINT sliceCount, UINT stackCount, UINT& vertexCount, UINT& indexCount);
+	static void GeosphereCounts(UINT numSubdivisions, UINT& vertexCount, UINT& indexCount);
+	static void CylinderCounts(UINT sliceCount, UINT stackCount, UINT& vertexCount, UINT& indexCount);
+	static void GridCounts(UINT m, UINT n, UINT& vertexCount, UINT& indexCount);
+
+	///<summary>
+	/// Same primitives as the Create functions, written to caller-owned
+	/// arrays of exactly the sizes the Counts functions report, e.g. a
+	/// primitive's slice of a buffer shared by several.  Indices start at 0
+	/// for the primitive's first vertex, for drawing with a base vertex.
+	///</summary>
+	static void FillBox(float width, float height, float depth, Vertex* vertices, UINT* indices);
+	static void FillSphere(float radius, UINT sliceCount, UINT stackCount, Vertex* vertices, UINT* indices);
+	static void FillGeosphere(float radius, UINT numSubdivisions, Vertex* vertices, UINT* indices);
+	static void FillCylinder(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount,
+		Vertex* vertices, UINT* indices);
+	static void FillGrid(float width, float depth, UINT m, UINT n, Vertex* vertices, UINT* indices);
+
 private:
-	static void Subdivide(MeshData& meshData);
-	static void BuildCylinderTopCap(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount, MeshData& meshData);
-	static void BuildCylinderBottomCap(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount, MeshData& meshData);
+	// Splits each of triangleCount triangles into four, appending one vertex
+	// per edge to vertices and writing 12 indices per input triangle.
+	static void Subdivide(Vertex* vertices, UINT& vertexCount, const UINT* indices, UINT triangleCount,
+		UINT* subdividedIndices);
+
+	// Each cap is sliceCount + 2 vertices and sliceCount triangles; baseIndex
+	// is the index of its first vertex.
+	static void FillCylinderTopCap(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount,
+		Vertex* vertices, UINT* indices, UINT baseIndex);
+	static void FillCylinderBottomCap(float bottomRadius, float topRadius, float height, UINT sliceCount, UINT stackCount,
+		Vertex* vertices, UINT* indices, UINT baseIndex);
 };
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+
+///<summary>
+/// Fixed-capacity queue for exactly one producer thread and one consumer
+/// thread.  Neither side ever blocks or takes a lock: each index is written
+/// by one side only and published with release/acquire ordering.  Capacity
+/// must be a power of two; one slot is kept free to tell full from empty.
+///</summary>
+template<typename T, UINT Capacity>
+class SpscRing
+{
+public:
+	SpscRing()
+		: mHead(0)
+		, mTail(0)
+	{
+		static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+	}
+
+	// Producer side.  Returns false, dropping the item, if the ring is full.
+	bool Push(const T& item)
+	{
+		const UINT head = mHead.load(std::memory_order_relaxed);
+		const UINT next = (head + 1) & (Capacity - 1);
+		if (next == mTail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		mItems[head] = item;
+		mHead.store(next, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side.  Returns false if the ring is empty.
+	bool Pop(T& item)
+	{
+		const UINT tail = mTail.load(std::memory_order_relaxed);
+		if (tail == mHead.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+
+		item = mItems[tail];
+		mTail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+		return true;
+	}
+
+private:
+	SpscRing(const SpscRing&);
+	SpscRing& operator=(const SpscRing&);
+
+private:
+	T mItems[Capacity];
+
+	// Kept on separate cache lines so the two threads do not fight over them.
+	alignas(64) std::atomic<UINT> mHead;
+	alignas(64) std::atomic<UINT> mTail;
+};
@@ -0,0 +1,137 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool()
+	: mTask(NULL)
+	, mTaskCtx(NULL)
+	, mTaskCount(0)
+	, mGeneration(0)
+	, mActiveWorkers(0)
+	, mbQuit(false)
+	, mNextIndex(0)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	Stop();
+}
+
+void ThreadPool::Start(UINT numThreads)
+{
+	Stop();
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mbQuit = false;
+	}
+	for (UINT i = 1; i < numThreads; ++i)
+	{
+		mWorkers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+	}
+}
+
+void ThreadPool::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mbQuit = true;
+	}
+	mWakeCV.notify_all();
+
+	for (size_t i = 0; i < mWorkers.size(); ++i)
+	{
+		mWorkers[i].join();
+	}
+	mWorkers.clear();
+}
+
+UINT ThreadPool::ThreadCount() const
+{
+	return (UINT)mWorkers.size() + 1;
+}
+
+void ThreadPool::Run(UINT count, TaskFn fn, void* ctx)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Nothing to hand out; skip the wake-up round trip.
+	if (mWorkers.empty() || count == 1)
+	{
+		for (UINT i = 0; i < count; ++i)
+		{
+			fn(ctx, i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTask = fn;
+		mTaskCtx = ctx;
+		mTaskCount = count;
+		mNextIndex.store(0);
+		++mGeneration;
+	}
+	mWakeCV.notify_all();
+
+	// The calling thread works too instead of just waiting.
+	DrainTasks(fn, ctx, count);
+
+	// Every index has been claimed now; wait for the workers still running one.
+	// Clearing the job under the lock means a worker that wakes up late sees
+	// an empty job rather than indices of the next one.
+	std::unique_lock<std::mutex> lock(mMutex);
+	mDoneCV.wait(lock, [this]() { return mActiveWorkers == 0; });
+	mTask = NULL;
+	mTaskCtx = NULL;
+	mTaskCount = 0;
+}
+
+void ThreadPool::WorkerLoop()
+{
+	UINT seenGeneration = 0;
+
+	for (;;)
+	{
+		TaskFn task = NULL;
+		void* ctx = NULL;
+		UINT count = 0;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWakeCV.wait(lock, [&]() { return mbQuit || mGeneration != seenGeneration; });
+			if (mbQuit)
+			{
+				return;
+			}
+			seenGeneration = mGeneration;
+
+			if (mTaskCount == 0)
+			{
+				continue;
+			}
+			task = mTask;
+			ctx = mTaskCtx;
+			count = mTaskCount;
+			++mActiveWorkers;
+		}
+
+		DrainTasks(task, ctx, count);
+
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (--mActiveWorkers == 0)
+		{
+			mDoneCV.notify_one();
+		}
+	}
+}
+
+void ThreadPool::DrainTasks(TaskFn fn, void* ctx, UINT count)
+{
+	for (UINT i = mNextIndex.fetch_add(1); i < count; i = mNextIndex.fetch_add(1))
+	{
+		fn(ctx, i);
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Windows.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that stay alive between jobs so per-frame work
+// can be split without paying for thread creation every time.
+class ThreadPool
+{
+public:
+	ThreadPool();
+	~ThreadPool();
+
+	// Starts numThreads - 1 workers; the thread calling ParallelFor is the last one.
+	void Start(UINT numThreads);
+	void Stop();
+
+	// Number of threads that run ParallelFor tasks, including the caller.
+	UINT ThreadCount() const;
+
+	///<summary>
+	/// Calls fn(index) for every index in [0, count) and returns once all calls
+	/// have finished.  Indices are handed out dynamically, so fn must not depend
+	/// on which thread runs it.  Not reentrant: fn must not call ParallelFor.
+	///</summary>
+	template<typename Fn>
+	void ParallelFor(UINT count, Fn& fn)
+	{
+		Run(count, &Invoke<Fn>, &fn);
+	}
+
+private:
+	typedef void (*TaskFn)(void* ctx, UINT index);
+
+	template<typename Fn>
+	static void Invoke(void* ctx, UINT index)
+	{
+		(*static_cast<Fn*>(ctx))(index);
+	}
+
+	void Run(UINT count, TaskFn fn, void* ctx);
+	void WorkerLoop();
+	void DrainTasks(TaskFn fn, void* ctx, UINT count);
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+private:
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWakeCV;
+	std::condition_variable mDoneCV;
+
+	// Current job, published under mMutex.
+	TaskFn mTask;
+	void* mTaskCtx;
+	UINT mTaskCount;
+	UINT mGeneration;
+	UINT mActiveWorkers;
+	bool mbQuit;
+
+	std::atomic<UINT> mNextIndex;
+};
@@ -20,7 +20,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPreInstance, PWSTR pCmdLine,
 	switch (0)
 	{
 	case 0:
-		MainApp = new WavesApp(hInstance);
+		MainApp = new WavesApp(hInstance, pCmdLine);
 		break;
 	case 1:
 		MainApp = new SkullApp(hInstance);